@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "connectivity_manager.h"
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("net.conn");
+
+namespace particle {
+
+namespace {
+
+#define CONNECTIVITY_LOG_INTERVAL_MS (5000)
+// Retry interval after a probe that couldn't be made, much shorter than the policy's probe interval
+#define CONNECTIVITY_PROBE_RETRY_MS (2 * 60 * 1000)
+// Default relative cost of a kB over each bearer
+#define CONNECTIVITY_CELLULAR_COST (1)
+#define CONNECTIVITY_SATELLITE_COST (100)
+
+const char* bearerName(Bearer bearer) {
+    switch (bearer) {
+    case Bearer::CELLULAR: return "CELLULAR";
+    case Bearer::SATELLITE: return "SATELLITE";
+    default: return "NONE";
+    }
+}
+
+} // namespace annonymous
+
+ConnectivityManager::ConnectivityManager() :
+        policy_(&defaultPolicy_),
+        coverage_(nullptr),
+        cost_{CONNECTIVITY_CELLULAR_COST, CONNECTIVITY_SATELLITE_COST},
+        bearer_(Bearer::NONE),
+        connected_(false),
+        bearerSince_(0),
+        stateSince_(0),
+        lastProbe_(0),
+        lastProbeAttempt_(0),
+        probeResult_(-1),
+        probeFailed_(false),
+        lastLog_(0),
+        registered_(false) {
+}
+
+int ConnectivityManager::begin(Bearer bearer) {
+    bearer_ = bearer;
+    connected_ = false;
+    bearerSince_ = millis();
+    stateSince_ = bearerSince_;
+    probeResult_ = -1;
+    probeFailed_ = false;
+    registered_ = false;
+    return 0;
+}
+
+system_tick_t ConnectivityManager::connectedFor() const {
+    return connected_ ? millis() - stateSince_ : 0;
+}
+
+system_tick_t ConnectivityManager::disconnectedFor() const {
+    return connected_ ? 0 : millis() - stateSince_;
+}
+
+void ConnectivityManager::addSignalSample(Bearer bearer, int quality) {
+    if (bearer == Bearer::CELLULAR) {
+        cellularSignal_.add(quality);
+    } else if (bearer == Bearer::SATELLITE) {
+        satelliteSignal_.add(quality);
+    }
+}
+
+void ConnectivityManager::process(Bearer bearer, bool connected) {
+    if (bearer != bearer_) {
+        Log.info("Bearer changed to %s", bearerName(bearer));
+        begin(bearer);
+    }
+    if (connected != connected_) {
+        connected_ = connected;
+        stateSince_ = millis();
+        if (connected) {
+            int registrationTime = registered_ ? -1 : (int)((millis() - bearerSince_) / 1000);
+            registered_ = true;
+            updateCoverage(bearer_, true, signal(bearer_).latest(), registrationTime);
+        }
+    }
+
+    if (millis() - lastLog_ >= CONNECTIVITY_LOG_INTERVAL_MS) {
+        lastLog_ = millis();
+        Log.info("[%s %s] for %lu ms, on bearer for %lu ms", bearerName(bearer_), connected_ ? "CONNECTED" : "DISCONNECTED",
+                millis() - stateSince_, millis() - bearerSince_);
+    }
+
+    switch (policy_->decide(linkState())) {
+    case RadioAction::SWITCH_CELLULAR:
+        requestSwitch(Bearer::CELLULAR);
+        break;
+    case RadioAction::SWITCH_SATELLITE:
+        requestSwitch(Bearer::SATELLITE);
+        break;
+    case RadioAction::PROBE_CELLULAR:
+        probe();
+        break;
+    default:
+        break;
+    }
+}
+
+LinkState ConnectivityManager::linkState() const {
+    LinkState state = {};
+    state.bearer = bearer_;
+    state.connected = connected_;
+    state.onBearer = millis() - bearerSince_;
+    state.connectedFor = connectedFor();
+    state.disconnectedFor = disconnectedFor();
+    state.cellularSignal = &cellularSignal_;
+    state.satelliteSignal = &satelliteSignal_;
+    state.cellularCoverage = coverage_ ? coverage_->lookup(Bearer::CELLULAR) : CoverageHint::UNKNOWN;
+    state.satelliteCoverage = coverage_ ? coverage_->lookup(Bearer::SATELLITE) : CoverageHint::UNKNOWN;
+    state.sinceProbe = (probeResult_ < 0) ? 0 : millis() - lastProbe_;
+    state.probeResult = probeResult_;
+    state.cost = cost_;
+    return state;
+}
+
+void ConnectivityManager::requestSwitch(Bearer bearer) {
+    if (bearer == bearer_ || !onSwitch_) {
+        return;
+    }
+    Log.info("SWITCH to %s --------------------", bearerName(bearer));
+    if (!connected_) {
+        // The outage is what made us leave, remember it for this location
+        updateCoverage(bearer_, false);
+    }
+    int r = onSwitch_(bearer);
+    if (r < 0) {
+        Log.error("Failed to switch to %s: %d", bearerName(bearer), r);
+    }
+    // Give the current bearer another full period before the policy is asked again
+    stateSince_ = millis();
+    bearerSince_ = millis();
+    probeResult_ = -1;
+    registered_ = false;
+}
+
+void ConnectivityManager::probe() {
+    if (!onProbe_) {
+        return;
+    }
+    if (probeFailed_ && millis() - lastProbeAttempt_ < CONNECTIVITY_PROBE_RETRY_MS) {
+        return;
+    }
+    Log.info("Probing for cellular coverage");
+    lastProbeAttempt_ = millis();
+    int r = onProbe_();
+    if (r < 0) {
+        // A failed probe says nothing about the coverage, keep the last result and try again soon
+        Log.warn("Cellular probe failed: %d", r);
+        probeFailed_ = true;
+        return;
+    }
+    probeFailed_ = false;
+    Log.info("Cellular probe found %d networks", r);
+    probeResult_ = r;
+    lastProbe_ = millis();
+    updateCoverage(Bearer::CELLULAR, r > 0);
+}
+
+void ConnectivityManager::updateCoverage(Bearer bearer, bool available, int quality, int registrationTime) {
+    if (coverage_) {
+        CoverageSample sample = {};
+        sample.available = available;
+        sample.quality = quality;
+        sample.registrationTime = registrationTime;
+        coverage_->update(bearer, sample);
+    }
+}
+
+} // namespace particle
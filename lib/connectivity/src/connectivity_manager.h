@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+#include "radio_policy.h"
+
+#include <functional>
+
+namespace particle {
+
+struct CoverageSample {
+    bool available;
+    int quality; // Signal quality in percent, -1 if unknown
+    int registrationTime; // Seconds from selecting the bearer to connecting, -1 if unknown
+};
+
+// Location-tagged memory of where each bearer was available
+class CoverageProvider {
+
+public:
+
+    virtual ~CoverageProvider() = default;
+
+    virtual CoverageHint lookup(Bearer bearer) = 0;
+    virtual void update(Bearer bearer, const CoverageSample& sample) = 0;
+};
+
+// Tracks the connection state of the active bearer and asks a RadioPolicy when to switch or probe.
+// Switching and probing are done by the application through the callbacks
+class ConnectivityManager {
+
+public:
+
+    // Returns 0 if the switch was started
+    typedef std::function<int(Bearer bearer)> SwitchCallback;
+    // Returns the number of cellular networks found, or a negative error if no scan could be made,
+    // e.g. because the radio is busy. Failed probes are retried without updating the coverage
+    typedef std::function<int()> ProbeCallback;
+
+    ConnectivityManager();
+
+    int begin(Bearer bearer);
+
+    // Call from the loop with the active bearer and whether it is connected to the Cloud
+    void process(Bearer bearer, bool connected);
+
+    ConnectivityManager& policy(RadioPolicy* policy) {
+        policy_ = policy ? policy : &defaultPolicy_;
+        return *this;
+    }
+
+    ConnectivityManager& coverage(CoverageProvider* coverage) {
+        coverage_ = coverage;
+        return *this;
+    }
+
+    ConnectivityManager& cost(BearerCost cost) {
+        cost_ = cost;
+        return *this;
+    }
+
+    ConnectivityManager& onSwitch(SwitchCallback callback) {
+        onSwitch_ = std::move(callback);
+        return *this;
+    }
+
+    ConnectivityManager& onProbe(ProbeCallback callback) {
+        onProbe_ = std::move(callback);
+        return *this;
+    }
+
+    // Signal quality in percent, negative values are ignored
+    void addSignalSample(Bearer bearer, int quality);
+
+    Bearer bearer() const {
+        return bearer_;
+    }
+
+    bool connected() const {
+        return connected_;
+    }
+
+    system_tick_t connectedFor() const;
+    system_tick_t disconnectedFor() const;
+
+    const SignalHistory& signal(Bearer bearer) const {
+        return (bearer == Bearer::SATELLITE) ? satelliteSignal_ : cellularSignal_;
+    }
+
+private:
+
+    DefaultRadioPolicy defaultPolicy_;
+    RadioPolicy* policy_;
+    CoverageProvider* coverage_;
+    BearerCost cost_;
+    SwitchCallback onSwitch_;
+    ProbeCallback onProbe_;
+    SignalHistory cellularSignal_;
+    SignalHistory satelliteSignal_;
+    Bearer bearer_;
+    bool connected_;
+    system_tick_t bearerSince_;
+    system_tick_t stateSince_;
+    system_tick_t lastProbe_;
+    system_tick_t lastProbeAttempt_;
+    int probeResult_;
+    bool probeFailed_;
+    system_tick_t lastLog_;
+    bool registered_; // Connected at least once since the bearer was selected
+
+    LinkState linkState() const;
+    void requestSwitch(Bearer bearer);
+    void probe();
+    void updateCoverage(Bearer bearer, bool available, int quality = -1, int registrationTime = -1);
+};
+
+} // particle
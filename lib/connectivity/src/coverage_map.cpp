@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "coverage_map.h"
+
+namespace particle {
+
+namespace {
+
+#define COVERAGE_QUALITY_UNKNOWN (0xff)
+
+BearerCoverage* bearerCoverage(CoverageCell* cell, Bearer bearer) {
+    switch (bearer) {
+    case Bearer::CELLULAR: return &cell->cellular;
+    case Bearer::SATELLITE: return &cell->satellite;
+    default: return nullptr;
+    }
+}
+
+void clearBearerCoverage(BearerCoverage* coverage) {
+    coverage->available = 0;
+    coverage->unavailable = 0;
+    coverage->quality = COVERAGE_QUALITY_UNKNOWN;
+    coverage->registrationTime = 0;
+}
+
+void countSample(uint8_t* counter, uint8_t* other) {
+    if (*counter == UINT8_MAX) {
+        // Keep the ratio but let recent samples weigh more
+        *counter /= 2;
+        *other /= 2;
+    }
+    (*counter)++;
+}
+
+// Exponential moving average with a weight of 1/4 for the new sample
+unsigned average(unsigned current, unsigned sample) {
+    return (current * 3 + sample) / 4;
+}
+
+} // namespace annonymous
+
+uint32_t geohash(double latitude, double longitude, unsigned bits) {
+    double latMin = -90.0, latMax = 90.0;
+    double lonMin = -180.0, lonMax = 180.0;
+    uint32_t hash = 0;
+    if (bits > 32) {
+        bits = 32;
+    }
+    for (unsigned i = 0; i < bits; i++) {
+        hash <<= 1;
+        if (i % 2 == 0) {
+            double mid = (lonMin + lonMax) / 2;
+            if (longitude >= mid) {
+                hash |= 1;
+                lonMin = mid;
+            } else {
+                lonMax = mid;
+            }
+        } else {
+            double mid = (latMin + latMax) / 2;
+            if (latitude >= mid) {
+                hash |= 1;
+                latMin = mid;
+            } else {
+                latMax = mid;
+            }
+        }
+    }
+    return hash;
+}
+
+CoverageMap::CoverageMap() :
+        precision_(DEFAULT_PRECISION) {
+    clear();
+}
+
+void CoverageMap::clear() {
+    clock_ = 0;
+    count_ = 0;
+    for (auto& cell: cells_) {
+        cell = {};
+    }
+}
+
+void CoverageMap::record(double latitude, double longitude, Bearer bearer, bool available, int quality, int registrationTime) {
+    uint32_t hash = geohash(latitude, longitude, precision_);
+    CoverageCell* cell = findCell(hash);
+    if (!cell) {
+        cell = insertCell(hash);
+    }
+    cell->lastUsed = ++clock_;
+    BearerCoverage* coverage = bearerCoverage(cell, bearer);
+    if (!coverage) {
+        return;
+    }
+    if (available) {
+        countSample(&coverage->available, &coverage->unavailable);
+    } else {
+        countSample(&coverage->unavailable, &coverage->available);
+    }
+    if (quality >= 0) {
+        coverage->quality = (coverage->quality == COVERAGE_QUALITY_UNKNOWN) ? quality : average(coverage->quality, quality);
+    }
+    if (registrationTime >= 0) {
+        unsigned seconds = (registrationTime > UINT16_MAX) ? UINT16_MAX : registrationTime;
+        coverage->registrationTime = coverage->registrationTime ? average(coverage->registrationTime, seconds) : seconds;
+    }
+}
+
+const CoverageCell* CoverageMap::find(double latitude, double longitude) {
+    CoverageCell* cell = findCell(geohash(latitude, longitude, precision_));
+    if (cell) {
+        cell->lastUsed = ++clock_;
+    }
+    return cell;
+}
+
+CoverageHint CoverageMap::lookup(double latitude, double longitude, Bearer bearer) {
+    auto cell = find(latitude, longitude);
+    if (!cell) {
+        return CoverageHint::UNKNOWN;
+    }
+    const BearerCoverage* coverage = bearerCoverage(const_cast<CoverageCell*>(cell), bearer);
+    if (!coverage || (!coverage->available && !coverage->unavailable)) {
+        return CoverageHint::UNKNOWN;
+    }
+    return (coverage->available >= coverage->unavailable) ? CoverageHint::AVAILABLE : CoverageHint::UNAVAILABLE;
+}
+
+size_t CoverageMap::slot(uint32_t hash) const {
+    // Fibonacci hashing, SLOTS is a power of two
+    return (uint32_t)(hash * 2654435769u) % SLOTS;
+}
+
+CoverageCell* CoverageMap::findCell(uint32_t hash) {
+    for (size_t i = slot(hash), n = 0; n < SLOTS && cells_[i].used; i = (i + 1) % SLOTS, n++) {
+        if (cells_[i].hash == hash) {
+            return &cells_[i];
+        }
+    }
+    return nullptr;
+}
+
+CoverageCell* CoverageMap::insertCell(uint32_t hash) {
+    if (count_ >= MAX_CELLS) {
+        evictLeastRecentlyUsed();
+    }
+    size_t i = slot(hash);
+    while (cells_[i].used) {
+        i = (i + 1) % SLOTS;
+    }
+    CoverageCell* cell = &cells_[i];
+    cell->hash = hash;
+    cell->used = true;
+    clearBearerCoverage(&cell->cellular);
+    clearBearerCoverage(&cell->satellite);
+    count_++;
+    return cell;
+}
+
+void CoverageMap::evictLeastRecentlyUsed() {
+    // Only done when the map is full, lookups stay O(1)
+    size_t oldest = SLOTS;
+    for (size_t i = 0; i < SLOTS; i++) {
+        if (cells_[i].used && (oldest == SLOTS || cells_[i].lastUsed < cells_[oldest].lastUsed)) {
+            oldest = i;
+        }
+    }
+    if (oldest != SLOTS) {
+        removeAt(oldest);
+    }
+}
+
+void CoverageMap::removeAt(size_t index) {
+    // Backward shift deletion keeps the probe sequences of the following cells intact
+    cells_[index].used = false;
+    count_--;
+    size_t hole = index;
+    for (size_t i = (index + 1) % SLOTS; cells_[i].used; i = (i + 1) % SLOTS) {
+        size_t home = slot(cells_[i].hash);
+        // Move the cell into the hole unless its home slot lies cyclically in (hole, i]
+        bool inRange = (hole <= i) ? (home > hole && home <= i) : (home > hole || home <= i);
+        if (!inRange) {
+            cells_[hole] = cells_[i];
+            cells_[i].used = false;
+            hole = i;
+        }
+    }
+}
+
+} // namespace particle
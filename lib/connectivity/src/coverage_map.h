@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "connectivity_types.h"
+
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+// Geohash with the given number of bits (up to 32), longitude and latitude bits interleaved.
+// 30 bits are 6 geohash characters, a cell of about 1.2 x 0.6 km
+uint32_t geohash(double latitude, double longitude, unsigned bits);
+
+struct BearerCoverage {
+    uint8_t available; // Number of times the bearer was found available, halved on overflow
+    uint8_t unavailable;
+    uint8_t quality; // Average signal quality in percent, 0xff if unknown
+    uint16_t registrationTime; // Average time to register in seconds, 0 if unknown
+};
+
+struct CoverageCell {
+    uint32_t hash;
+    uint32_t lastUsed;
+    bool used;
+    BearerCoverage cellular;
+    BearerCoverage satellite;
+};
+
+// Bounded map of bearer availability per geohash cell. Lookups are O(1) using open addressing with
+// linear probing. When full, the least recently used cell is evicted. Plain data without dynamic
+// allocation, so that the whole map can be persisted as one record and exercised on the host
+class CoverageMap {
+
+public:
+
+    static const size_t SLOTS = 128;
+    static const size_t MAX_CELLS = 96;
+    static const unsigned DEFAULT_PRECISION = 30;
+
+    CoverageMap();
+
+    void clear();
+
+    // Bits of geohash precision, must be set before any cells are recorded
+    void precision(unsigned bits) {
+        precision_ = bits;
+    }
+
+    unsigned precision() const {
+        return precision_;
+    }
+
+    // quality is in percent and registrationTime in seconds, negative if unknown
+    void record(double latitude, double longitude, Bearer bearer, bool available, int quality = -1, int registrationTime = -1);
+
+    // Returns nullptr if nothing is known about the cell. The cell is marked as recently used
+    const CoverageCell* find(double latitude, double longitude);
+    CoverageHint lookup(double latitude, double longitude, Bearer bearer);
+
+    size_t size() const {
+        return count_;
+    }
+
+private:
+
+    uint32_t precision_;
+    uint32_t clock_;
+    uint32_t count_;
+    CoverageCell cells_[SLOTS];
+
+    size_t slot(uint32_t hash) const;
+    CoverageCell* findCell(uint32_t hash);
+    CoverageCell* insertCell(uint32_t hash);
+    void evictLeastRecentlyUsed();
+    void removeAt(size_t index);
+};
+
+} // particle
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "coverage_memory.h"
+#include "storage/record_storage.h"
+
+#include "check.h"
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("net.conn");
+
+namespace particle {
+
+namespace {
+
+#define CONNECTIVITY_COVERAGE_FILE SATELLITE_STORAGE_DIR "/coverage"
+#define CONNECTIVITY_COVERAGE_MAGIC (0x43564d31) // "CVM1"
+// Limits flash wear while moving through many cells
+#define CONNECTIVITY_COVERAGE_SAVE_INTERVAL_MS (10 * 60 * 1000)
+
+} // namespace annonymous
+
+CoverageMemory::CoverageMemory() :
+        record_(),
+        saveInterval_(CONNECTIVITY_COVERAGE_SAVE_INTERVAL_MS),
+        lastSave_(0) {
+}
+
+int CoverageMemory::begin() {
+    int r = loadRecord(CONNECTIVITY_COVERAGE_FILE, CONNECTIVITY_COVERAGE_MAGIC, &record_, sizeof(record_));
+    if (r < 0) {
+        record_ = {};
+        record_.map.clear();
+        if (r != SYSTEM_ERROR_NOT_FOUND) {
+            Log.warn("Discarding coverage map: %d", r);
+        }
+        return 0;
+    }
+    Log.info("Loaded coverage map with %u cells", (unsigned)record_.map.size());
+    return 0;
+}
+
+int CoverageMemory::save() {
+    CHECK(saveRecord(CONNECTIVITY_COVERAGE_FILE, CONNECTIVITY_COVERAGE_MAGIC, &record_, sizeof(record_)));
+    lastSave_ = millis();
+    return 0;
+}
+
+void CoverageMemory::position(double latitude, double longitude) {
+    record_.latitude = latitude;
+    record_.longitude = longitude;
+    record_.hasPosition = true;
+}
+
+Bearer CoverageMemory::preferredBearer() {
+    // Cellular is cheaper, only skip it where it was never available but satellite was not ruled out
+    if (lookup(Bearer::CELLULAR) == CoverageHint::UNAVAILABLE && lookup(Bearer::SATELLITE) != CoverageHint::UNAVAILABLE) {
+        return Bearer::SATELLITE;
+    }
+    return Bearer::CELLULAR;
+}
+
+CoverageHint CoverageMemory::lookup(Bearer bearer) {
+    if (!record_.hasPosition) {
+        return CoverageHint::UNKNOWN;
+    }
+    return record_.map.lookup(record_.latitude, record_.longitude, bearer);
+}
+
+void CoverageMemory::update(Bearer bearer, const CoverageSample& sample) {
+    if (!record_.hasPosition) {
+        return;
+    }
+    record_.map.record(record_.latitude, record_.longitude, bearer, sample.available, sample.quality, sample.registrationTime);
+    if (!lastSave_ || millis() - lastSave_ >= saveInterval_) {
+        int r = save();
+        if (r < 0) {
+            Log.error("Failed to save coverage map: %d", r);
+        }
+    }
+}
+
+} // namespace particle
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+#include "connectivity_manager.h"
+#include "coverage_map.h"
+
+namespace particle {
+
+// CoverageProvider backed by a CoverageMap on flash, tagged with the last known GNSS position
+class CoverageMemory : public CoverageProvider {
+
+public:
+
+    CoverageMemory();
+
+    // Loads the map and the last known position from flash
+    int begin(void);
+    int save(void);
+
+    // Minimum time between writes to flash
+    CoverageMemory& saveInterval(system_tick_t ms) {
+        saveInterval_ = ms;
+        return *this;
+    }
+
+    // The position is persisted along with the next update
+    void position(double latitude, double longitude);
+
+    bool hasPosition(void) const {
+        return record_.hasPosition;
+    }
+
+    // Bearer to try first at the last known position
+    Bearer preferredBearer(void);
+
+    CoverageHint lookup(Bearer bearer) override;
+    void update(Bearer bearer, const CoverageSample& sample) override;
+
+    CoverageMap& map(void) {
+        return record_.map;
+    }
+
+private:
+
+    struct CoverageRecord {
+        double latitude;
+        double longitude;
+        bool hasPosition;
+        CoverageMap map;
+    };
+
+    CoverageRecord record_;
+    system_tick_t saveInterval_;
+    system_tick_t lastSave_;
+};
+
+} // particle
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "radio_policy.h"
+
+#include <algorithm>
+
+namespace particle {
+
+namespace {
+
+#define CONNECTIVITY_CELLULAR_OUTAGE_TIMEOUT_MS (10 * 60 * 1000)
+#define CONNECTIVITY_POOR_CELLULAR_OUTAGE_TIMEOUT_MS (3 * 60 * 1000)
+#define CONNECTIVITY_NO_COVERAGE_OUTAGE_TIMEOUT_MS (60 * 1000)
+#define CONNECTIVITY_SATELLITE_OUTAGE_TIMEOUT_MS (20 * 60 * 1000)
+#define CONNECTIVITY_MIN_SATELLITE_DWELL_MS (5 * 60 * 1000)
+#define CONNECTIVITY_PROBE_INTERVAL_MS (15 * 60 * 1000)
+#define CONNECTIVITY_NO_COVERAGE_PROBE_INTERVAL_MS (60 * 60 * 1000)
+#define CONNECTIVITY_POOR_SIGNAL_THRESHOLD (20)
+
+} // namespace annonymous
+
+SignalHistory::SignalHistory() :
+        samples_(),
+        next_(0),
+        count_(0) {
+}
+
+void SignalHistory::add(int quality) {
+    if (quality < 0) {
+        return;
+    }
+    samples_[next_] = std::min(quality, 100);
+    next_ = (next_ + 1) % MAX_SAMPLES;
+    if (count_ < MAX_SAMPLES) {
+        count_++;
+    }
+}
+
+void SignalHistory::clear() {
+    next_ = 0;
+    count_ = 0;
+}
+
+int SignalHistory::latest() const {
+    if (!count_) {
+        return -1;
+    }
+    return samples_[(next_ + MAX_SAMPLES - 1) % MAX_SAMPLES];
+}
+
+int SignalHistory::average() const {
+    if (!count_) {
+        return -1;
+    }
+    int sum = 0;
+    for (size_t i = 0; i < count_; i++) {
+        sum += samples_[i];
+    }
+    return sum / (int)count_;
+}
+
+DefaultRadioPolicy::DefaultRadioPolicy() :
+        cellularOutageTimeout_(CONNECTIVITY_CELLULAR_OUTAGE_TIMEOUT_MS),
+        poorCellularOutageTimeout_(CONNECTIVITY_POOR_CELLULAR_OUTAGE_TIMEOUT_MS),
+        noCoverageOutageTimeout_(CONNECTIVITY_NO_COVERAGE_OUTAGE_TIMEOUT_MS),
+        satelliteOutageTimeout_(CONNECTIVITY_SATELLITE_OUTAGE_TIMEOUT_MS),
+        minSatelliteDwell_(CONNECTIVITY_MIN_SATELLITE_DWELL_MS),
+        probeInterval_(CONNECTIVITY_PROBE_INTERVAL_MS),
+        noCoverageProbeInterval_(CONNECTIVITY_NO_COVERAGE_PROBE_INTERVAL_MS),
+        poorSignalThreshold_(CONNECTIVITY_POOR_SIGNAL_THRESHOLD) {
+}
+
+RadioAction DefaultRadioPolicy::decide(const LinkState& state) {
+    switch (state.bearer) {
+    case Bearer::CELLULAR:
+        return decideCellular(state);
+    case Bearer::SATELLITE:
+        return decideSatellite(state);
+    default:
+        // No usable profile is active, retry cellular once in a while
+        return (state.onBearer >= noCoverageOutageTimeout_) ? RadioAction::SWITCH_CELLULAR : RadioAction::STAY;
+    }
+}
+
+RadioAction DefaultRadioPolicy::decideCellular(const LinkState& state) const {
+    if (state.connected) {
+        return RadioAction::STAY;
+    }
+    system_tick_t timeout = cellularOutageTimeout_;
+    if (state.cellularCoverage == CoverageHint::UNAVAILABLE) {
+        timeout = noCoverageOutageTimeout_;
+    } else if (state.cellularSignal && state.cellularSignal->count() > 0 &&
+            state.cellularSignal->average() < poorSignalThreshold_) {
+        timeout = poorCellularOutageTimeout_;
+    }
+    if (state.disconnectedFor < timeout) {
+        return RadioAction::STAY;
+    }
+    // Don't trade a known good satellite location for a blind attempt elsewhere
+    return RadioAction::SWITCH_SATELLITE;
+}
+
+RadioAction DefaultRadioPolicy::decideSatellite(const LinkState& state) const {
+    if (!state.connected && state.disconnectedFor >= satelliteOutageTimeout_) {
+        // Satellite isn't working either, cellular may have come back in the meantime
+        return RadioAction::SWITCH_CELLULAR;
+    }
+    if (state.onBearer < minSatelliteDwell_ || state.cost.cellular >= state.cost.satellite) {
+        return RadioAction::STAY;
+    }
+    system_tick_t interval = (state.cellularCoverage == CoverageHint::UNAVAILABLE) ? noCoverageProbeInterval_ : probeInterval_;
+    if (state.probeResult > 0 && state.sinceProbe < interval) {
+        return RadioAction::SWITCH_CELLULAR;
+    }
+    if (state.probeResult < 0 || state.sinceProbe >= interval) {
+        return RadioAction::PROBE_CELLULAR;
+    }
+    return RadioAction::STAY;
+}
+
+} // namespace particle
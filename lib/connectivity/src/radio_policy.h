@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+#include "connectivity_types.h"
+
+namespace particle {
+
+enum class RadioAction {
+    STAY,
+    SWITCH_CELLULAR,
+    SWITCH_SATELLITE,
+    // Check for cellular coverage without switching the eSIM profile
+    PROBE_CELLULAR
+};
+
+// Signal quality samples (0-100%) of one bearer, oldest samples are overwritten
+class SignalHistory {
+
+public:
+
+    static const size_t MAX_SAMPLES = 16;
+
+    SignalHistory();
+
+    void add(int quality);
+    void clear();
+
+    size_t count() const {
+        return count_;
+    }
+
+    // Returns -1 if there are no samples
+    int latest() const;
+    int average() const;
+
+private:
+
+    int8_t samples_[MAX_SAMPLES];
+    size_t next_;
+    size_t count_;
+};
+
+// Relative cost of moving data over each bearer, e.g. cents per kB
+struct BearerCost {
+    unsigned cellular;
+    unsigned satellite;
+};
+
+// Everything a policy may base its decision on. Durations are in milliseconds, 0 if not applicable
+struct LinkState {
+    Bearer bearer;
+    bool connected;
+    system_tick_t onBearer;
+    system_tick_t connectedFor;
+    system_tick_t disconnectedFor;
+    const SignalHistory* cellularSignal;
+    const SignalHistory* satelliteSignal;
+    CoverageHint cellularCoverage;
+    CoverageHint satelliteCoverage;
+    // Time since the last cellular probe and its result, probeResult is -1 if no probe was made yet
+    system_tick_t sinceProbe;
+    int probeResult;
+    BearerCost cost;
+};
+
+class RadioPolicy {
+
+public:
+
+    virtual ~RadioPolicy() = default;
+
+    virtual RadioAction decide(const LinkState& state) = 0;
+};
+
+// Prefers the cheaper cellular bearer. Outages are cut short where signal history or coverage memory say
+// cellular is unlikely to come back, and cellular is probed from satellite instead of swapping profiles blindly
+class DefaultRadioPolicy : public RadioPolicy {
+
+public:
+
+    DefaultRadioPolicy();
+
+    RadioAction decide(const LinkState& state) override;
+
+    // Time without a cellular connection before switching to satellite
+    DefaultRadioPolicy& cellularOutageTimeout(system_tick_t ms) {
+        cellularOutageTimeout_ = ms;
+        return *this;
+    }
+
+    // Used instead when recent cellular signal quality was below poorSignalThreshold()
+    DefaultRadioPolicy& poorCellularOutageTimeout(system_tick_t ms) {
+        poorCellularOutageTimeout_ = ms;
+        return *this;
+    }
+
+    // Used instead when cellular was never available at this location
+    DefaultRadioPolicy& noCoverageOutageTimeout(system_tick_t ms) {
+        noCoverageOutageTimeout_ = ms;
+        return *this;
+    }
+
+    // Time without a satellite connection before falling back to cellular
+    DefaultRadioPolicy& satelliteOutageTimeout(system_tick_t ms) {
+        satelliteOutageTimeout_ = ms;
+        return *this;
+    }
+
+    // Minimum time on satellite before cellular is probed
+    DefaultRadioPolicy& minSatelliteDwell(system_tick_t ms) {
+        minSatelliteDwell_ = ms;
+        return *this;
+    }
+
+    DefaultRadioPolicy& probeInterval(system_tick_t ms) {
+        probeInterval_ = ms;
+        return *this;
+    }
+
+    // Probe interval where cellular was never available
+    DefaultRadioPolicy& noCoverageProbeInterval(system_tick_t ms) {
+        noCoverageProbeInterval_ = ms;
+        return *this;
+    }
+
+    DefaultRadioPolicy& poorSignalThreshold(int quality) {
+        poorSignalThreshold_ = quality;
+        return *this;
+    }
+
+private:
+
+    system_tick_t cellularOutageTimeout_;
+    system_tick_t poorCellularOutageTimeout_;
+    system_tick_t noCoverageOutageTimeout_;
+    system_tick_t satelliteOutageTimeout_;
+    system_tick_t minSatelliteDwell_;
+    system_tick_t probeInterval_;
+    system_tick_t noCoverageProbeInterval_;
+    int poorSignalThreshold_;
+
+    RadioAction decideCellular(const LinkState& state) const;
+    RadioAction decideSatellite(const LinkState& state) const;
+};
+
+} // particle
@@ -16,6 +16,7 @@
 #include "cloud_protocol.h"
 
 #include "diag_query/diag_query.h"
+#include "satellite_log.h"
 
 #include <vector>
 #include <map>
@@ -29,9 +30,29 @@ namespace {
 enum RequestType {
     HELLO = 1,
     EVENT = 2,
-    DIAGNOSTICS = 3
+    DIAGNOSTICS = 3,
+    DESCRIBE = 4
 };
 
+// Time an event was handed to the network, shared by the acknowledgement and response handlers
+struct PublishTiming: RefCount {
+    system_tick_t timeSent = 0;
+    bool sent = false;
+};
+
+bool encodeString(pb_ostream_t* strm, const pb_field_iter_t* field, void* const* arg) {
+    auto str = (const String*)*arg;
+    if (!str->length()) {
+        return true;
+    }
+    return pb_encode_tag_for_field(strm, field) &&
+            pb_encode_string(strm, (const pb_byte_t*)str->c_str(), str->length());
+}
+
+bool encodeBytesField(pb_ostream_t* strm, uint32_t tag, const void* data, size_t size) {
+    return pb_encode_tag(strm, PB_WT_STRING, tag) && pb_encode_string(strm, (const pb_byte_t*)data, size);
+}
+
 class InputBufferStream: public Stream {
 public:
     explicit InputBufferStream(util::Buffer& buf) :
@@ -82,16 +103,34 @@ private:
 
 } // namespace
 
+CloudProtocol::CloudProtocol() :
+        state_(State::NEW),
+        sysDescValid_(false),
+        appDescValid_(false),
+        framesSentDiag_(DIAG_ID_SATELLITE_MSG_FRAMES_SENT, "msg:txFrames", &channel_.stats().framesSent),
+        bytesSentDiag_(DIAG_ID_SATELLITE_MSG_BYTES_SENT, "msg:txBytes", &channel_.stats().bytesSent),
+        framesReceivedDiag_(DIAG_ID_SATELLITE_MSG_FRAMES_RECEIVED, "msg:rxFrames", &channel_.stats().framesReceived),
+        bytesReceivedDiag_(DIAG_ID_SATELLITE_MSG_BYTES_RECEIVED, "msg:rxBytes", &channel_.stats().bytesReceived),
+        timeoutsDiag_(DIAG_ID_SATELLITE_MSG_TIMEOUTS, "msg:timeouts", &channel_.stats().timeouts),
+        retriesDiag_(DIAG_ID_SATELLITE_MSG_RETRIES, "msg:retries", &channel_.stats().retries),
+        allocFailuresDiag_(DIAG_ID_SATELLITE_MSG_ALLOC_FAILURES, "msg:allocFail", &channel_.stats().allocFailures),
+        queueDepthDiag_(DIAG_ID_SATELLITE_MSG_QUEUE_DEPTH, "msg:queue", &channel_.stats().queueDepth),
+        maxQueueDepthDiag_(DIAG_ID_SATELLITE_MSG_MAX_QUEUE_DEPTH, "msg:queueMax", &channel_.stats().maxQueueDepth),
+        rttMeanDiag_(DIAG_ID_SATELLITE_MSG_RTT_MEAN, "msg:rttAvg", channel_.stats().rtt.meanPtr()),
+        rttMaxDiag_(DIAG_ID_SATELLITE_MSG_RTT_MAX, "msg:rttMax", channel_.stats().rtt.maxPtr()) {
+}
+
 int CloudProtocol::init(CloudProtocolConfig conf) {
     if (state_ != State::NEW) {
         return 0;
     }
-    MessageChannelConfig chanConf;
+    MessageChannelConfig chanConf = conf.chanConf_;
     chanConf.onSend(conf.onSend_);
     chanConf.onRequest([this](auto type, auto data, auto onResp) {
         return receiveRequest(type, std::move(data), std::move(onResp));
     });
     CHECK(channel_.init(std::move(chanConf)));
+    conf_ = std::move(conf);
     state_ = State::DISCONNECTED;
     return 0;
 }
@@ -130,11 +169,12 @@ int CloudProtocol::subscribe(int code, OnEvent onEvent) {
     if (!subscrs_.set(code, std::move(onEvent))) {
         return Error::NO_MEMORY;
     }
+    appDescValid_ = false;
     // TODO: Send a subscription request
     return 0;
 }
 
-int CloudProtocol::publishImpl(int code, std::optional<Variant> data) {
+int CloudProtocol::publishImpl(int code, std::optional<Variant> data, PublishOptions opts) {
     String eventData;
     PB_CLOUD(EventRequest) reqMsg = {};
     reqMsg.which_type = PB_CLOUD(EventRequest_code_tag);
@@ -151,18 +191,34 @@ int CloudProtocol::publishImpl(int code, std::optional<Variant> data) {
     }
     util::Buffer reqData;
     CHECK(util::encodeProtobuf(reqData, &reqMsg, &PB_CLOUD(EventRequest_msg)));
-    Log.trace("Sending Event request");
-    CHECK(channel_.sendRequest(RequestType::EVENT, std::move(reqData), [](auto err, auto result, auto /* data */) {
+    SAT_LOG_TRACE("Sending Event request");
+    RefCountPtr<PublishTiming> timing = makeRefCountPtr<PublishTiming>();
+    if (!timing) {
+        return Error::NO_MEMORY;
+    }
+    auto reqOpts = RequestOptions().timeout(opts.timeout()).priority(opts.priority()).onAck([timing](int error) {
+        if (error >= 0) {
+            timing->timeSent = millis();
+            timing->sent = true;
+        }
+    });
+    auto onResp = [onComplete = opts.onComplete(), timing](auto err, auto result, auto /* data */) {
         if (err < 0) {
             Log.error("Failed to send Event request: %d", err);
         } else {
-            Log.trace("Received Event response");
+            SAT_LOG_TRACE("Received Event response");
             if (result != 0) {
                 Log.error("Event request failed: %d", result);
+                err = Error::PROTOCOL;
             }
         }
+        if (onComplete) {
+            // Not sent yet if the request failed in the send queue
+            onComplete(err, timing->sent ? millis() - timing->timeSent : 0);
+        }
         return 0;
-    }));
+    };
+    CHECK(channel_.sendRequest(RequestType::EVENT, std::move(reqData), std::move(onResp), std::move(reqOpts)));
     return 0;
 }
 
@@ -176,6 +232,10 @@ int CloudProtocol::receiveRequest(unsigned type, util::Buffer data, MessageChann
         CHECK(receiveDiagnosticsRequest(std::move(data), std::move(onResp)));
         break;
     }
+    case RequestType::DESCRIBE: {
+        CHECK(receiveDescribeRequest(std::move(data), std::move(onResp)));
+        break;
+    }
     default:
         Log.error("Received unsupported request, type: %u", type);
     }
@@ -203,8 +263,9 @@ int CloudProtocol::receiveEventRequest(util::Buffer data, MessageChannel::OnResp
     Variant v;
     InputBufferStream strm(buf);
     CHECK(decodeFromCBOR(v, strm));
-    Log.trace("Received event, code: %d", (int)code);
-    if (buf.size() > 0) {
+    SAT_LOG_TRACE("Received event, code: %d", (int)code);
+    if (buf.size() > 0 && SAT_LOG_ENABLED(TRACE)) {
+        // Only converted to JSON if the output is going to be seen
         Log.print(LOG_LEVEL_TRACE, v.toJSON().c_str());
         Log.print(LOG_LEVEL_TRACE, "\r\n");
     }
@@ -258,12 +319,12 @@ bool encodeDiagMap(pb_ostream_t *stream, const pb_field_t *field, void* const* a
         s.id = id;
         EncodedUint8Bytes myDataBytes(&s.data, (uint8_t*)val.second.data(), val.second.size());
         if (!pb_encode_tag_for_field(stream, field)) {
-            Log.print(LOG_LEVEL_TRACE, "Tag encoding failed\r\n");
+            SAT_LOG_PRINTF(TRACE, "Tag encoding failed\r\n");
             return false;
         }
 
         if (!pb_encode_submessage(stream, particle_cloud_DiagnosticsResponse_Source_fields, &s)) {
-            Log.print(LOG_LEVEL_TRACE, "Encoding failed\r\n");
+            SAT_LOG_PRINTF(TRACE, "Encoding failed\r\n");
             return false;
         }
     }
@@ -302,7 +363,7 @@ int CloudProtocol::receiveDiagnosticsRequest(util::Buffer data, MessageChannel::
         bool decoded = pb_decode(&stream, PB_CLOUD(DiagnosticsRequest_fields), &request);
 
         if (!decoded) {
-            Log.print(LOG_LEVEL_TRACE, "Decoding failed\r\n");
+            SAT_LOG_PRINTF(TRACE, "Decoding failed\r\n");
             if (onResp) {
                 onResp(!decoded /* error */, 0 /* result */, util::Buffer());
             }
@@ -315,7 +376,7 @@ int CloudProtocol::receiveDiagnosticsRequest(util::Buffer data, MessageChannel::
         // Place them in a map
 
         for (const auto& diagId : diagIds) {
-            Log.printf(LOG_LEVEL_TRACE, "Querying diag id: %lu\r\n", diagId);
+            SAT_LOG_PRINTF(TRACE, "Querying diag id: %lu\r\n", diagId);
             std::vector<uint8_t> res;
             if (!getDiagnosticValue(diagId, &res)) {
                 diagValueMap[diagId] = res;
@@ -345,19 +406,15 @@ int CloudProtocol::receiveDiagnosticsRequest(util::Buffer data, MessageChannel::
 
         int encodePassed = pb_encode(&ostream, PB_CLOUD(DiagnosticsResponse_fields), &response);
         if (!encodePassed) {
-            Log.printf(LOG_LEVEL_TRACE, "Encoding failed: %d \r\n", !encodePassed);
+            SAT_LOG_PRINTF(TRACE, "Encoding failed: %d \r\n", !encodePassed);
             onResp(1 /* error */, 0 /* result */, util::Buffer());
             return Error::ENCODING_FAILED;
         }
 
         buffer.resize(ostream.bytes_written);
 
-        Log.print(LOG_LEVEL_TRACE, "Encoded Bytes\r\n");
-        for (size_t i = 0; i < buffer.size(); ++i) {
-            Log.printf(LOG_LEVEL_TRACE, "%02X", buffer.data()[i]);
-        }
-
-        Log.print(LOG_LEVEL_TRACE, "\r\n");
+        SAT_LOG_PRINTF(TRACE, "Encoded Bytes\r\n");
+        SAT_LOG_DUMP(TRACE, buffer.data(), buffer.size());
 
         if (onResp) {
             onResp(0 /* error */, 0 /* result */, std::move(buffer));
@@ -367,4 +424,84 @@ int CloudProtocol::receiveDiagnosticsRequest(util::Buffer data, MessageChannel::
     return 0;
 }
 
+int CloudProtocol::receiveDescribeRequest(util::Buffer data, MessageChannel::OnResponse onResp) {
+    PB_CLOUD(DescriptionRequest) reqMsg = {};
+    CHECK(decodeProtobuf(data, &reqMsg, &PB_CLOUD(DescriptionRequest_msg)));
+    CHECK(updateSystemDescription());
+    CHECK(updateAppDescription());
+
+    // Unless the description is requested explicitly, only the hashes are sent so that the cloud
+    // can request the full description only when it differs from what it has on record
+    bool sendSysDesc = reqMsg.has_system_flags && reqMsg.system_flags != PB_CLOUD(DescriptionRequest_SystemFlag_SYSTEM_FLAG_NONE);
+    bool sendAppDesc = reqMsg.has_app_flags && reqMsg.app_flags != PB_CLOUD(DescriptionRequest_AppFlag_APP_FLAG_NONE);
+    SAT_LOG_TRACE("Received Describe request, system: %d, app: %d", (int)sendSysDesc, (int)sendAppDesc);
+
+    const size_t maxFieldOverhead = 6; // Tag and length
+    size_t size = (util::SHA1_HASH_SIZE + maxFieldOverhead) * 2;
+    if (sendSysDesc) {
+        size += sysDesc_.size() + maxFieldOverhead;
+    }
+    if (sendAppDesc) {
+        size += appDesc_.size() + maxFieldOverhead;
+    }
+    util::Buffer respData;
+    CHECK(respData.resize(size));
+    auto strm = pb_ostream_from_buffer((pb_byte_t*)respData.data(), respData.size());
+    if ((sendSysDesc && !encodeBytesField(&strm, PB_CLOUD(DescriptionResponse_system_description_tag), sysDesc_.data(), sysDesc_.size())) ||
+            (sendAppDesc && !encodeBytesField(&strm, PB_CLOUD(DescriptionResponse_app_description_tag), appDesc_.data(), appDesc_.size())) ||
+            !encodeBytesField(&strm, PB_CLOUD(DescriptionResponse_system_description_hash_tag), sysDescHash_, sizeof(sysDescHash_)) ||
+            !encodeBytesField(&strm, PB_CLOUD(DescriptionResponse_app_description_hash_tag), appDescHash_, sizeof(appDescHash_))) {
+        onResp(Error::ENCODING_FAILED, 0 /* result */, util::Buffer());
+        return Error::ENCODING_FAILED;
+    }
+    CHECK(respData.resize(strm.bytes_written));
+
+    onResp(0 /* error */, 0 /* result */, std::move(respData));
+    return 0;
+}
+
+int CloudProtocol::updateSystemDescription() {
+    if (sysDescValid_) {
+        return 0;
+    }
+    PB_CLOUD(SystemDescribe) msg = {};
+    msg.iccid.arg = &conf_.iccid_;
+    msg.iccid.funcs.encode = encodeString;
+    util::Buffer buf;
+    CHECK(util::encodeProtobuf(buf, &msg, &PB_CLOUD(SystemDescribe_msg)));
+    util::sha1(buf.data(), buf.size(), sysDescHash_);
+    sysDesc_ = std::move(buf);
+    sysDescValid_ = true;
+    return 0;
+}
+
+int CloudProtocol::updateAppDescription() {
+    if (appDescValid_) {
+        return 0;
+    }
+    PB_CLOUD(DescriptionResponse_AppDescription) msg = {};
+    msg.subscriptions.arg = &subscrs_;
+    msg.subscriptions.funcs.encode = [](pb_ostream_t* strm, const pb_field_iter_t* field, void* const* arg) {
+        auto subscrs = (const Map<int, OnEvent>*)*arg;
+        for (auto& [code, onEvent]: *subscrs) {
+            String prefix(code);
+            PB_CLOUD(DescriptionResponse_AppDescription_Subscription) s = {};
+            s.prefix.arg = &prefix;
+            s.prefix.funcs.encode = encodeString;
+            s.constrained = true;
+            if (!pb_encode_tag_for_field(strm, field) ||
+                    !pb_encode_submessage(strm, &PB_CLOUD(DescriptionResponse_AppDescription_Subscription_msg), &s)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    util::Buffer buf;
+    CHECK(util::encodeProtobuf(buf, &msg, &PB_CLOUD(DescriptionResponse_AppDescription_msg)));
+    util::sha1(buf.data(), buf.size(), appDescHash_);
+    appDesc_ = std::move(buf);
+    appDescValid_ = true;
+    return 0;
+}
+
 } // namespace particle::constrained
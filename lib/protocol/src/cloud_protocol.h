@@ -6,6 +6,8 @@
 #include <spark_wiring_map.h>
 
 #include "message_channel.h"
+#include "util/sha1.h"
+#include "diag_query/diag_query.h"
 
 namespace particle::constrained {
 
@@ -20,19 +22,89 @@ public:
         return *this;
     }
 
+    CloudProtocolConfig& onCanSend(MessageChannel::OnCanSend fn) {
+        chanConf_.onCanSend(std::move(fn));
+        return *this;
+    }
+
+    CloudProtocolConfig& budget(MessagePriority priority, size_t bytes) {
+        chanConf_.budget(priority, bytes);
+        return *this;
+    }
+
+    CloudProtocolConfig& budgetWindow(system_tick_t window) {
+        chanConf_.budgetWindow(window);
+        return *this;
+    }
+
+    CloudProtocolConfig& maxQueuedFrames(size_t count) {
+        chanConf_.maxQueuedFrames(count);
+        return *this;
+    }
+
+    CloudProtocolConfig& iccid(String iccid) {
+        iccid_ = std::move(iccid);
+        return *this;
+    }
+
 private:
     MessageChannel::OnSend onSend_;
+    MessageChannelConfig chanConf_;
+    String iccid_;
 
     friend class CloudProtocol;
 };
 
+class PublishOptions {
+public:
+    // Invoked when the cloud acknowledges the event or the request fails. The latency is measured
+    // from the time the event was handed to the network, time spent in the send queue isn't
+    // included. It is 0 if the event was never sent
+    typedef std::function<void(int error, system_tick_t latency)> OnComplete;
+
+    PublishOptions() :
+            timeout_(MessageChannelBase::DEFAULT_REQUEST_TIMEOUT),
+            priority_(MessagePriority::TELEMETRY) {
+    }
+
+    PublishOptions& onComplete(OnComplete fn) {
+        onComplete_ = std::move(fn);
+        return *this;
+    }
+
+    const OnComplete& onComplete() const {
+        return onComplete_;
+    }
+
+    PublishOptions& timeout(system_tick_t timeout) {
+        timeout_ = timeout;
+        return *this;
+    }
+
+    system_tick_t timeout() const {
+        return timeout_;
+    }
+
+    PublishOptions& priority(MessagePriority priority) {
+        priority_ = priority;
+        return *this;
+    }
+
+    MessagePriority priority() const {
+        return priority_;
+    }
+
+private:
+    OnComplete onComplete_;
+    system_tick_t timeout_;
+    MessagePriority priority_;
+};
+
 class CloudProtocol {
 public:
     typedef std::function<void(int code, Variant data)> OnEvent;
 
-    CloudProtocol() :
-            state_(State::NEW) {
-    }
+    CloudProtocol();
 
     int init(CloudProtocolConfig conf);
 
@@ -41,16 +113,24 @@ public:
     int receive(util::Buffer data, int port);
     int run();
 
-    int publish(int code) {
-        return publishImpl(code, std::nullopt);
+    int publish(int code, PublishOptions opts = PublishOptions()) {
+        return publishImpl(code, std::nullopt, std::move(opts));
     }
 
-    int publish(int code, Variant data) {
-        return publishImpl(code, std::move(data));
+    int publish(int code, Variant data, PublishOptions opts = PublishOptions()) {
+        return publishImpl(code, std::move(data), std::move(opts));
     }
 
     int subscribe(int code, OnEvent onEvent);
 
+    bool hasPendingMessages() const {
+        return channel_.hasPendingMessages();
+    }
+
+    const MessageChannelStats& stats() const {
+        return channel_.stats();
+    }
+
 private:
     enum class State {
         NEW,
@@ -63,12 +143,38 @@ private:
     Map<int, OnEvent> subscrs_;
     State state_;
 
-    int publishImpl(int code, std::optional<Variant> data);
+    // Encoded system and application descriptions and their SHA-1 hashes. The descriptions are
+    // built on the first Describe request and rebuilt only when invalidated
+    util::Buffer sysDesc_;
+    util::Buffer appDesc_;
+    uint8_t sysDescHash_[util::SHA1_HASH_SIZE];
+    uint8_t appDescHash_[util::SHA1_HASH_SIZE];
+    bool sysDescValid_;
+    bool appDescValid_;
+
+    // Message channel counters published as diagnostic sources
+    UintDiagnosticSource framesSentDiag_;
+    UintDiagnosticSource bytesSentDiag_;
+    UintDiagnosticSource framesReceivedDiag_;
+    UintDiagnosticSource bytesReceivedDiag_;
+    UintDiagnosticSource timeoutsDiag_;
+    UintDiagnosticSource retriesDiag_;
+    UintDiagnosticSource allocFailuresDiag_;
+    UintDiagnosticSource queueDepthDiag_;
+    UintDiagnosticSource maxQueueDepthDiag_;
+    UintDiagnosticSource rttMeanDiag_;
+    UintDiagnosticSource rttMaxDiag_;
+
+    int publishImpl(int code, std::optional<Variant> data, PublishOptions opts);
 
     int receiveRequest(unsigned type, util::Buffer data, MessageChannel::OnResponse onResp);
 
     int receiveEventRequest(util::Buffer data, MessageChannel::OnResponse onResp);
     int receiveDiagnosticsRequest(util::Buffer data, MessageChannel::OnResponse onResp);
+    int receiveDescribeRequest(util::Buffer data, MessageChannel::OnResponse onResp);
+
+    int updateSystemDescription();
+    int updateAppDescription();
 };
 
 } // namespace particle::constrained
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <utility>
 #include <cstring>
+#include <cassert>
 
 #include <spark_wiring_logging.h>
 #include <spark_wiring_error.h>
@@ -17,6 +19,12 @@ namespace {
 const unsigned MIN_LORAWAN_APP_PORT = 1;
 const unsigned MAX_LORAWAN_APP_PORT = 223;
 
+void logResponseAck(int error) {
+    if (error < 0) {
+        Log.error("Failed to send response: %d", error);
+    }
+}
+
 } // namespace
 
 struct MessageChannel::InRequest: RefCount {
@@ -29,17 +37,54 @@ struct MessageChannel::InRequest: RefCount {
     }
 };
 
+struct MessageChannel::OutBlockTransfer: RefCount {
+    util::Buffer data;
+    size_t offset;
+    unsigned reqId;
+    unsigned blockNum;
+    int result;
+    int error;
+    bool blockPending;
+
+    OutBlockTransfer() :
+            offset(0),
+            reqId(0),
+            blockNum(0),
+            result(0),
+            error(0),
+            blockPending(false) {
+    }
+};
+
+struct MessageChannel::OutFrame: RefCount {
+    util::Buffer data;
+    OnAck onAck;
+    int reqId; // ID of the request carried by the frame, or -1
+    bool deferred; // The network asked to keep the frame queued at least once
+
+    OutFrame() :
+            reqId(-1),
+            deferred(false) {
+    }
+};
+
 struct MessageChannel::OutRequest: RefCount {
     RequestOptions options;
     OnResponse onResponse;
+    system_tick_t timeSent;
     unsigned id;
+    bool sent; // The timeout only runs once the frame has been handed to the network
 
     OutRequest() :
-            id(0) {
+            timeSent(0),
+            id(0),
+            sent(false) {
     }
 };
 
 MessageChannel::MessageChannel() :
+        budgetUsed_(),
+        budgetWindowStart_(0),
         maxPayloadSize_(100), // TODO
         nextOutReqId_(0),
         sessId_(0),
@@ -66,6 +111,9 @@ int MessageChannel::receive(util::Buffer data, int port) {
         return Error::INVALID_STATE;
     }
 
+    ++stats_.framesReceived;
+    stats_.bytesReceived += data.size();
+
     FrameHeader h;
     size_t headerSize = CHECK(decodeFrameHeader(data.data(), data.size(), h));
 
@@ -83,7 +131,7 @@ int MessageChannel::receive(util::Buffer data, int port) {
         if (!noResp) {
             RefCountPtr<InRequest> req = makeRefCountPtr<InRequest>();
             if (!req) {
-                return Error::NO_MEMORY;
+                return noMemory();
             }
             req->id = h.requestId();
             req->sessionId = sessId_;
@@ -111,10 +159,13 @@ int MessageChannel::receive(util::Buffer data, int port) {
         // Handle a response
         auto it = outReqs_.find(h.requestId());
         if (it == outReqs_.end()) {
+            ++stats_.lateResponses;
             return 0;
         }
         auto req = std::move(it->second);
         outReqs_.erase(it);
+        ++stats_.responsesReceived;
+        stats_.rtt.add(millis() - req->timeSent);
         if (req->onResponse) {
             int r = req->onResponse(0 /* error */, h.requestTypeOrResultCode(), std::move(data));
             if (r < 0) {
@@ -136,7 +187,39 @@ int MessageChannel::run() {
     if (!inited_) {
         return 0;
     }
-    // TODO
+    // Expire outgoing requests that didn't receive a response in time
+    auto now = millis();
+    Vector<unsigned> expiredIds;
+    for (auto& [id, req]: outReqs_) {
+        if (req->sent && now - req->timeSent >= req->options.timeout()) {
+            expiredIds.append(id);
+        }
+    }
+    for (auto id: expiredIds) {
+        Log.warn("Request timeout, ID: %u", id);
+        ++stats_.timeouts;
+        failRequest(id, Error::TIMEOUT);
+    }
+    // Queue the next block of each block transfer. Only one block per transfer is queued at a time
+    // so that higher priority frames can be sent between the blocks
+    for (int i = 0; i < outBlocks_.size();) {
+        auto transfer = outBlocks_.at(i);
+        if (!transfer->blockPending && !transfer->error && transfer->offset < transfer->data.size()) {
+            int r = sendNextBlock(transfer);
+            if (r < 0) {
+                transfer->error = r;
+            }
+        }
+        if (transfer->error < 0 || (!transfer->blockPending && transfer->offset >= transfer->data.size())) {
+            if (transfer->error < 0) {
+                Log.error("Failed to send block: %d", transfer->error);
+            }
+            outBlocks_.removeAt(i);
+        } else {
+            ++i;
+        }
+    }
+    CHECK(sendQueuedFrame());
     return 0;
 }
 
@@ -154,13 +237,13 @@ int MessageChannel::sendRequest(unsigned type, util::Buffer data, OnResponse onR
     if (!noResp) {
         RefCountPtr<OutRequest> req = makeRefCountPtr<OutRequest>();
         if (!req) {
-            return Error::NO_MEMORY;
+            return noMemory();
         }
         req->id = id;
         req->onResponse = std::move(onResp);
-        req->options = std::move(opts);
+        req->options = opts;
         if (!outReqs_.set(id, std::move(req))) {
-            return Error::NO_MEMORY;
+            return noMemory();
         }
     }
     NAMED_SCOPE_GUARD(removeReqGuard, {
@@ -183,10 +266,17 @@ int MessageChannel::sendRequest(unsigned type, util::Buffer data, OnResponse onR
     std::memcpy(buf.data(), headerData, headerSize);
     std::memcpy(buf.data() + headerSize, data.data(), data.size());
 
-    assert(conf_.onSend_);
-    CHECK(conf_.onSend_(std::move(buf), conf_.port_, nullptr /* TODO: onAck */));
+    CHECK(enqueueFrame(std::move(buf), opts.priority(), [this, id, noResp, sessId = sessId_, onAck = opts.onAck()](int error) {
+        if (onAck) {
+            onAck(error);
+        }
+        if (error < 0 && !noResp && sessId == sessId_) {
+            failRequest(id, error);
+        }
+    }, noResp ? -1 : (int)id));
 
     removeReqGuard.dismiss();
+    ++stats_.requestsSent;
 
     return 0;
 }
@@ -200,6 +290,12 @@ void MessageChannel::reset() {
     using std::swap;
     swap(outReqs, outReqs_);
 
+    outBlocks_.clear();
+    for (auto& frames: outFrames_) {
+        frames.clear();
+    }
+    updateQueueDepth();
+
     ++sessId_;
 
     // Cancel outgoing requests
@@ -216,6 +312,25 @@ int MessageChannel::sendResponse(int result, util::Buffer data, RefCountPtr<InRe
         return Error::CANCELLED;
     }
 
+    if (data.size() + MAX_FRAME_HEADER_SIZE > maxPayloadSize_) {
+        // Send the response in blocks
+        size_t blockSize = maxPayloadSize_ - MAX_FRAME_HEADER_SIZE;
+        if ((data.size() + blockSize - 1) / blockSize > MAX_BLOCK_NUMBER + 1) {
+            return Error::TOO_LARGE;
+        }
+        RefCountPtr<OutBlockTransfer> transfer = makeRefCountPtr<OutBlockTransfer>();
+        if (!transfer) {
+            return noMemory();
+        }
+        transfer->data = std::move(data);
+        transfer->reqId = req->id;
+        transfer->result = result;
+        if (!outBlocks_.append(std::move(transfer))) {
+            return noMemory();
+        }
+        return 0;
+    }
+
     FrameHeader h;
     h.requestTypeOrResultCode(result);
     h.frameType(FrameType::RESPONSE);
@@ -229,8 +344,163 @@ int MessageChannel::sendResponse(int result, util::Buffer data, RefCountPtr<InRe
     std::memcpy(buf.data(), headerData, headerSize);
     std::memcpy(buf.data() + headerSize, data.data(), data.size());
 
-    assert(conf_.onSend_);
-    CHECK(conf_.onSend_(std::move(buf), conf_.port_, nullptr /* TODO: onAck */));
+    CHECK(enqueueFrame(std::move(buf), MessagePriority::RESPONSE, logResponseAck));
+
+    return 0;
+}
+
+int MessageChannel::enqueueFrame(util::Buffer data, MessagePriority priority, OnAck onAck, int reqId) {
+    if (queuedFrameCount() >= conf_.maxQueuedFrames_) {
+        Log.warn("Send queue is full, %u frames", (unsigned)conf_.maxQueuedFrames_);
+        ++stats_.queueOverflows;
+        return Error::LIMIT_EXCEEDED;
+    }
+    RefCountPtr<OutFrame> frame = makeRefCountPtr<OutFrame>();
+    if (!frame) {
+        return noMemory();
+    }
+    frame->data = std::move(data);
+    frame->onAck = std::move(onAck);
+    frame->reqId = reqId;
+    if (!outFrames_[(unsigned)priority].append(std::move(frame))) {
+        return noMemory();
+    }
+    updateQueueDepth();
+    return 0;
+}
+
+int MessageChannel::sendQueuedFrame() {
+    auto now = millis();
+    if (now - budgetWindowStart_ >= conf_.budgetWindow_) {
+        std::memset(budgetUsed_, 0, sizeof(budgetUsed_));
+        budgetWindowStart_ = now;
+    }
+    for (unsigned i = 0; i < MESSAGE_PRIORITY_COUNT; ++i) {
+        auto& frames = outFrames_[i];
+        if (frames.isEmpty()) {
+            continue;
+        }
+        auto frame = frames.first();
+        auto size = frame->data.size();
+        // A frame that is larger than the entire budget is allowed at the beginning of a window
+        auto budget = conf_.budgets_[i];
+        if (budget && budgetUsed_[i] && budgetUsed_[i] + size > budget) {
+            continue;
+        }
+        if (conf_.onCanSend_ && !conf_.onCanSend_((MessagePriority)i, size)) {
+            continue;
+        }
+        assert(conf_.onSend_);
+        int r = conf_.onSend_(frame->data, conf_.port_, frame->onAck);
+        if (r == Error::WOULD_BLOCK) {
+            // Keep the frame queued. Lower priority frames are not sent either so that they don't
+            // take the link from the higher priority ones
+            if (!frame->deferred) {
+                frame->deferred = true;
+                ++stats_.retries;
+            }
+            return 0;
+        }
+        // The acknowledgement handler may have removed the frame already
+        if (!frames.isEmpty() && frames.first() == frame) {
+            frames.removeAt(0);
+        }
+        updateQueueDepth();
+        if (r >= 0 && frame->reqId >= 0) {
+            auto it = outReqs_.find(frame->reqId);
+            if (it != outReqs_.end()) {
+                it->second->timeSent = millis();
+                it->second->sent = true;
+            }
+        }
+        if (r < 0) {
+            ++stats_.sendErrors;
+            if (frame->onAck) {
+                frame->onAck(r);
+            }
+            return r;
+        }
+        budgetUsed_[i] += size;
+        ++stats_.framesSent;
+        stats_.bytesSent += size;
+        return 0;
+    }
+    return 0;
+}
+
+size_t MessageChannel::queuedFrameCount() const {
+    size_t n = 0;
+    for (auto& frames: outFrames_) {
+        n += frames.size();
+    }
+    return n;
+}
+
+void MessageChannel::failRequest(unsigned id, int error) {
+    auto it = outReqs_.find(id);
+    if (it == outReqs_.end()) {
+        return;
+    }
+    auto req = std::move(it->second);
+    outReqs_.erase(it);
+    // Don't send a request that was already reported as failed
+    removeQueuedFrame(id);
+    if (req->onResponse) {
+        req->onResponse(error, 0 /* result */, util::Buffer());
+    }
+}
+
+void MessageChannel::removeQueuedFrame(unsigned reqId) {
+    for (auto& frames: outFrames_) {
+        for (int i = 0; i < frames.size(); ++i) {
+            if (frames.at(i)->reqId == (int)reqId) {
+                frames.removeAt(i);
+                updateQueueDepth();
+                return;
+            }
+        }
+    }
+}
+
+void MessageChannel::updateQueueDepth() {
+    stats_.queueDepth = queuedFrameCount();
+    if (stats_.queueDepth > stats_.maxQueueDepth) {
+        stats_.maxQueueDepth = stats_.queueDepth;
+    }
+}
+
+int MessageChannel::sendNextBlock(RefCountPtr<OutBlockTransfer> transfer) {
+    size_t blockSize = maxPayloadSize_ - MAX_FRAME_HEADER_SIZE;
+    size_t n = std::min(blockSize, transfer->data.size() - transfer->offset);
+    bool more = transfer->offset + n < transfer->data.size();
+
+    FrameHeader h;
+    h.requestTypeOrResultCode(transfer->result);
+    h.frameType(FrameType::REQUEST_RESPONSE_BLOCK);
+    h.requestId(transfer->reqId);
+    h.blockNumber(transfer->blockNum);
+    h.more(more);
+
+    char headerData[MAX_FRAME_HEADER_SIZE] = {};
+    size_t headerSize = CHECK(encodeFrameHeader(headerData, sizeof(headerData), h));
+
+    util::Buffer buf;
+    CHECK(buf.resize(headerSize + n));
+    std::memcpy(buf.data(), headerData, headerSize);
+    std::memcpy(buf.data() + headerSize, transfer->data.data() + transfer->offset, n);
+
+    // Long block transfers are sent at the lowest priority so that urgent frames can preempt them
+    CHECK(enqueueFrame(std::move(buf), MessagePriority::BULK, [transfer](int error) {
+        logResponseAck(error);
+        if (error < 0) {
+            transfer->error = error;
+        }
+        transfer->blockPending = false;
+    }));
+
+    transfer->offset += n;
+    ++transfer->blockNum;
+    transfer->blockPending = true;
 
     return 0;
 }
@@ -4,32 +4,74 @@
 
 #include <spark_wiring_ticks.h>
 #include <spark_wiring_map.h>
+#include <spark_wiring_vector.h>
+#include <spark_wiring_error.h>
 
 #include <ref_count.h>
 
 #include "util/buffer.h"
+#include "message_channel_stats.h"
 
 namespace particle::constrained {
 
 class MessageChannel;
 
+// Outgoing frames are scheduled in the order of their priority class
+enum class MessagePriority: unsigned {
+    ALARM = 0,
+    RESPONSE = 1,
+    TELEMETRY = 2,
+    BULK = 3
+};
+
+const unsigned MESSAGE_PRIORITY_COUNT = 4;
+
 class MessageChannelBase {
 public:
+    // Invoked once the frame has been handed off to the network, or failed to be. Not invoked if the
+    // send callback returns an error
     typedef std::function<void(int error)> OnAck;
     typedef std::function<int(int error, int result, util::Buffer data)> OnResponse;
     typedef std::function<int(int type, util::Buffer data, OnResponse onResp)> OnRequest;
+    // The send callback can return Error::WOULD_BLOCK to keep the frame queued and retry it later
     typedef std::function<int(util::Buffer data, int port, OnAck onAck)> OnSend;
+    // Returns false to defer frames of the given priority class
+    typedef std::function<bool(MessagePriority priority, size_t size)> OnCanSend;
 
     static const system_tick_t DEFAULT_REQUEST_TIMEOUT = 60000;
+    static const system_tick_t DEFAULT_BUDGET_WINDOW = 60000;
     static const unsigned DEFAULT_PORT = 223;
+    static const size_t MAX_QUEUED_FRAMES = 16;
 };
 
 class MessageChannelConfig {
 public:
     MessageChannelConfig() :
+            budgets_(),
+            budgetWindow_(MessageChannelBase::DEFAULT_BUDGET_WINDOW),
+            maxQueuedFrames_(MessageChannelBase::MAX_QUEUED_FRAMES),
             port_(MessageChannelBase::DEFAULT_PORT) {
     }
 
+    // Maximum number of bytes that can be sent in a given priority class per budget window.
+    // 0 means unlimited, which is the default for all classes
+    MessageChannelConfig& budget(MessagePriority priority, size_t bytes) {
+        budgets_[(unsigned)priority] = bytes;
+        return *this;
+    }
+
+    MessageChannelConfig& budgetWindow(system_tick_t window) {
+        budgetWindow_ = window;
+        return *this;
+    }
+
+    // Maximum number of frames waiting to be sent. Sending fails with Error::LIMIT_EXCEEDED when
+    // the queue is full
+    MessageChannelConfig& maxQueuedFrames(size_t count) {
+        maxQueuedFrames_ = count;
+        return *this;
+    }
+
     MessageChannelConfig& onRequest(MessageChannelBase::OnRequest fn) {
         onReq_ = std::move(fn);
         return *this;
@@ -40,6 +82,11 @@ public:
         return *this;
     }
 
+    MessageChannelConfig& onCanSend(MessageChannelBase::OnCanSend fn) {
+        onCanSend_ = std::move(fn);
+        return *this;
+    }
+
     MessageChannelConfig& port(unsigned port) {
         port_ = port;
         return *this;
@@ -48,6 +95,10 @@ public:
 private:
     MessageChannelBase::OnRequest onReq_;
     MessageChannelBase::OnSend onSend_;
+    MessageChannelBase::OnCanSend onCanSend_;
+    size_t budgets_[MESSAGE_PRIORITY_COUNT];
+    system_tick_t budgetWindow_;
+    size_t maxQueuedFrames_;
     unsigned port_;
 
     friend class MessageChannel;
@@ -57,9 +108,12 @@ class RequestOptions {
 public:
     RequestOptions() :
             timeout_(MessageChannelBase::DEFAULT_REQUEST_TIMEOUT),
+            priority_(MessagePriority::TELEMETRY),
             noResp_(false) {
     }
 
+    // Time to wait for a response once the request has been handed to the network. Time spent in the
+    // send queue doesn't count
     RequestOptions& timeout(system_tick_t timeout) {
         timeout_ = timeout;
         return *this;
@@ -78,8 +132,28 @@ public:
         return noResp_;
     }
 
+    RequestOptions& onAck(MessageChannelBase::OnAck fn) {
+        onAck_ = std::move(fn);
+        return *this;
+    }
+
+    const MessageChannelBase::OnAck& onAck() const {
+        return onAck_;
+    }
+
+    RequestOptions& priority(MessagePriority priority) {
+        priority_ = priority;
+        return *this;
+    }
+
+    MessagePriority priority() const {
+        return priority_;
+    }
+
 private:
+    MessageChannelBase::OnAck onAck_;
     system_tick_t timeout_;
+    MessagePriority priority_;
     bool noResp_;
 };
 
@@ -100,20 +174,48 @@ public:
         return sendRequest(type, util::Buffer(), std::move(onResp), std::move(opts));
     }
 
+    // Returns true if frames are queued for sending or requests are awaiting a response
+    bool hasPendingMessages() const {
+        return queuedFrameCount() > 0 || outReqs_.size() > 0 || !outBlocks_.isEmpty();
+    }
+
     void reset();
 
+    const MessageChannelStats& stats() const {
+        return stats_;
+    }
+
 private:
     struct InRequest;
     struct OutRequest;
+    struct OutBlockTransfer;
+    struct OutFrame;
 
     Map<unsigned, RefCountPtr<OutRequest>> outReqs_;
+    Vector<RefCountPtr<OutBlockTransfer>> outBlocks_;
+    Vector<RefCountPtr<OutFrame>> outFrames_[MESSAGE_PRIORITY_COUNT];
+    size_t budgetUsed_[MESSAGE_PRIORITY_COUNT];
+    system_tick_t budgetWindowStart_;
     MessageChannelConfig conf_;
+    MessageChannelStats stats_;
     size_t maxPayloadSize_;
     unsigned nextOutReqId_;
     unsigned sessId_;
     bool inited_;
 
     int sendResponse(int result, util::Buffer data, RefCountPtr<InRequest> req);
+    int sendNextBlock(RefCountPtr<OutBlockTransfer> transfer);
+    int enqueueFrame(util::Buffer data, MessagePriority priority, OnAck onAck, int reqId = -1);
+    int sendQueuedFrame();
+    size_t queuedFrameCount() const;
+    void failRequest(unsigned id, int error);
+    void removeQueuedFrame(unsigned reqId);
+    void updateQueueDepth();
+
+    int noMemory() {
+        ++stats_.allocFailures;
+        return Error::NO_MEMORY;
+    }
 };
 
 } // namespace particle::constrained
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace particle::constrained {
+
+// Distribution of request round trip times. Bucket i counts the times up to BASE << i
+// milliseconds, the last bucket counts everything above that
+class RttHistogram {
+public:
+    static const uint32_t BASE = 250;
+    static const size_t BUCKET_COUNT = 11;
+
+    RttHistogram() :
+            buckets_(),
+            count_(0),
+            sum_(0),
+            min_(0),
+            max_(0),
+            mean_(0) {
+    }
+
+    void add(uint32_t ms) {
+        size_t i = 0;
+        while (i < BUCKET_COUNT - 1 && ms > (BASE << i)) {
+            ++i;
+        }
+        ++buckets_[i];
+        ++count_;
+        sum_ += ms;
+        mean_ = sum_ / count_;
+        if (count_ == 1 || ms < min_) {
+            min_ = ms;
+        }
+        if (ms > max_) {
+            max_ = ms;
+        }
+    }
+
+    // Upper bound of the bucket the given percentile (0-100) falls in. Times in the last bucket are
+    // reported as the maximum seen
+    uint32_t percentile(unsigned p) const {
+        if (!count_) {
+            return 0;
+        }
+        uint64_t rank = ((uint64_t)count_ * p + 99) / 100;
+        uint64_t n = 0;
+        for (size_t i = 0; i < BUCKET_COUNT - 1; ++i) {
+            n += buckets_[i];
+            if (n >= rank) {
+                return BASE << i;
+            }
+        }
+        return max_;
+    }
+
+    // Upper bound of a bucket in milliseconds, 0 for the last one which is unbounded
+    static uint32_t bucketLimit(size_t i) {
+        return (i < BUCKET_COUNT - 1) ? BASE << i : 0;
+    }
+
+    uint32_t bucket(size_t i) const {
+        return buckets_[i];
+    }
+
+    uint32_t count() const {
+        return count_;
+    }
+
+    uint32_t min() const {
+        return min_;
+    }
+
+    uint32_t max() const {
+        return max_;
+    }
+
+    uint32_t mean() const {
+        return mean_;
+    }
+
+    // Pointers to the values published as diagnostic sources
+    const uint32_t* meanPtr() const {
+        return &mean_;
+    }
+
+    const uint32_t* maxPtr() const {
+        return &max_;
+    }
+
+private:
+    uint32_t buckets_[BUCKET_COUNT];
+    uint32_t count_;
+    uint64_t sum_;
+    uint32_t min_;
+    uint32_t max_;
+    uint32_t mean_;
+};
+
+// Counters maintained by MessageChannel. The values only ever grow, except for the queue depth, and
+// are kept as plain 32-bit integers so that they can be published as diagnostic sources
+struct MessageChannelStats {
+    uint32_t framesSent = 0;
+    uint32_t bytesSent = 0;
+    uint32_t framesReceived = 0;
+    uint32_t bytesReceived = 0;
+    uint32_t requestsSent = 0;
+    uint32_t responsesReceived = 0;
+    // Responses that arrived after their request timed out or was cancelled
+    uint32_t lateResponses = 0;
+    uint32_t timeouts = 0;
+    // Frames deferred by the network layer at least once. They stay queued and are sent again later
+    uint32_t retries = 0;
+    uint32_t sendErrors = 0;
+    uint32_t allocFailures = 0;
+    uint32_t queueDepth = 0;
+    uint32_t maxQueueDepth = 0;
+    // Frames rejected because the send queue was full
+    uint32_t queueOverflows = 0;
+    // Time from handing a request to the network to receiving its response. Time spent in the send
+    // queue isn't included
+    RttHistogram rtt;
+};
+
+} // namespace particle::constrained
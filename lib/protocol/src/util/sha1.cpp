@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstring>
+
+#include "sha1.h"
+
+namespace particle::util {
+
+namespace {
+
+inline uint32_t rotl(uint32_t v, unsigned n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+} // namespace
+
+Sha1::Sha1() :
+        h_{ 0x67452301u, 0xefcdab89u, 0x98badcfeu, 0x10325476u, 0xc3d2e1f0u },
+        len_(0),
+        block_(),
+        blockSize_(0) {
+}
+
+void Sha1::update(const void* data, size_t size) {
+    auto d = (const uint8_t*)data;
+    len_ += size;
+    while (size > 0) {
+        auto n = std::min(size, sizeof(block_) - blockSize_);
+        std::memcpy(block_ + blockSize_, d, n);
+        blockSize_ += n;
+        d += n;
+        size -= n;
+        if (blockSize_ == sizeof(block_)) {
+            processBlock(block_);
+            blockSize_ = 0;
+        }
+    }
+}
+
+void Sha1::finish(uint8_t* hash) {
+    uint64_t bits = len_ * 8;
+    uint8_t pad = 0x80;
+    update(&pad, 1);
+    pad = 0;
+    while (blockSize_ != sizeof(block_) - 8) {
+        update(&pad, 1);
+    }
+    uint8_t lenData[8];
+    for (int i = 0; i < 8; ++i) {
+        lenData[i] = bits >> (56 - i * 8);
+    }
+    update(lenData, sizeof(lenData));
+    for (int i = 0; i < 5; ++i) {
+        hash[i * 4] = h_[i] >> 24;
+        hash[i * 4 + 1] = h_[i] >> 16;
+        hash[i * 4 + 2] = h_[i] >> 8;
+        hash[i * 4 + 3] = h_[i];
+    }
+}
+
+void Sha1::processBlock(const uint8_t* block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+                ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999u;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1u;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdcu;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6u;
+        }
+        uint32_t t = rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = t;
+    }
+    h_[0] += a;
+    h_[1] += b;
+    h_[2] += c;
+    h_[3] += d;
+    h_[4] += e;
+}
+
+} // namespace particle::util
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace particle::util {
+
+const size_t SHA1_HASH_SIZE = 20;
+
+class Sha1 {
+public:
+    Sha1();
+
+    void update(const void* data, size_t size);
+    void finish(uint8_t* hash);
+
+private:
+    uint32_t h_[5];
+    uint64_t len_;
+    uint8_t block_[64];
+    size_t blockSize_;
+
+    void processBlock(const uint8_t* block);
+};
+
+inline void sha1(const void* data, size_t size, uint8_t* hash) {
+    Sha1 s;
+    s.update(data, size);
+    s.finish(hash);
+}
+
+} // namespace particle::util
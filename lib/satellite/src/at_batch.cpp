@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "at_batch.h"
+#include "satellite_log.h"
+
+LOG_SOURCE_CATEGORY("ncp.at")
+
+namespace particle {
+
+AtBatch::AtBatch() :
+        groupBegin_(0),
+        groupEnd_(0),
+        stopOnError_(false) {
+}
+
+AtBatch& AtBatch::addImpl(const char* cmd, Callback cb, void* param, const char* prefix, system_tick_t timeout) {
+    if (strncasecmp(cmd, "AT", 2) == 0) {
+        cmd += 2;
+    }
+    Entry e = {};
+    e.cmd = cmd;
+    e.cb = cb;
+    e.param = param;
+    e.prefix = prefix;
+    e.timeout = timeout;
+    e.result = RESP_ABORTED;
+    entries_.append(std::move(e));
+    return *this;
+}
+
+int AtBatch::run() {
+    for (auto& e: entries_) {
+        e.result = RESP_ABORTED;
+    }
+    int ret = 0;
+    size_t begin = 0;
+    while (begin < (size_t)entries_.size()) {
+        // Chain as many commands as fit in a single command line
+        size_t end = begin + 1;
+        size_t len = 2 + entries_.at(begin).cmd.length();
+        while (end < (size_t)entries_.size() && len + 1 + entries_.at(end).cmd.length() <= MAX_LINE_LENGTH) {
+            len += 1 + entries_.at(end).cmd.length();
+            ++end;
+        }
+        int r = runGroup(begin, end);
+        if (r == RESP_OK) {
+            for (size_t i = begin; i < end; ++i) {
+                entries_.at(i).result = RESP_OK;
+            }
+        } else if (end - begin == 1) {
+            entries_.at(begin).result = r;
+        } else {
+            // The modem aborts the whole line at the first failing command, so run the commands one
+            // by one to find out which one failed
+            SAT_LOG_TRACE("Chained command failed: %d, retrying one by one", r);
+            for (size_t i = begin; i < end; ++i) {
+                entries_.at(i).result = runGroup(i, i + 1);
+                if (entries_.at(i).result != RESP_OK && stopOnError_) {
+                    break;
+                }
+            }
+        }
+        for (size_t i = begin; i < end; ++i) {
+            if (entries_.at(i).result != RESP_OK) {
+                ret = SYSTEM_ERROR_AT_NOT_OK;
+                if (stopOnError_) {
+                    return ret;
+                }
+            }
+        }
+        begin = end;
+    }
+    return ret;
+}
+
+int AtBatch::runGroup(size_t begin, size_t end) {
+    String line = "AT";
+    system_tick_t timeout = 0;
+    for (size_t i = begin; i < end; ++i) {
+        if (i != begin) {
+            line += ';';
+        }
+        line += entries_.at(i).cmd;
+        timeout += entries_.at(i).timeout;
+    }
+    groupBegin_ = begin;
+    groupEnd_ = end;
+    return Cellular.command(cbRoute, this, timeout, "%s\r\n", line.c_str());
+}
+
+int AtBatch::cbRoute(int type, const char* buf, int len, AtBatch* batch) {
+    if (type != TYPE_PLUS && type != TYPE_UNKNOWN) {
+        return WAIT;
+    }
+    // Lines are prefixed with "\r\n"
+    const char* line = buf;
+    while (*line == '\r' || *line == '\n') {
+        ++line;
+    }
+    bool routed = false;
+    for (size_t i = batch->groupBegin_; i < batch->groupEnd_; ++i) {
+        const auto& e = batch->entries_.at(i);
+        if (e.cb && e.prefix && strncmp(line, e.prefix, strlen(e.prefix)) == 0) {
+            e.cb(type, buf, len, e.param);
+            routed = true;
+        }
+    }
+    if (!routed) {
+        for (size_t i = batch->groupBegin_; i < batch->groupEnd_; ++i) {
+            const auto& e = batch->entries_.at(i);
+            if (e.cb && !e.prefix) {
+                e.cb(type, buf, len, e.param);
+            }
+        }
+    }
+    return WAIT;
+}
+
+} // namespace particle
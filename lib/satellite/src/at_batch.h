@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+#include <spark_wiring_vector.h>
+
+namespace particle {
+
+// Runs a sequence of AT commands with as few round trips as possible. Commands are concatenated
+// with ';' into a single command line (e.g. AT+CEREG?;+QCFGEXT="nipdcfg") and the response lines
+// are routed to the per-command callbacks by their prefix
+class AtBatch {
+
+public:
+
+    typedef int (*Callback)(int type, const char* buf, int len, void* param);
+
+    AtBatch();
+
+    // cmd is given with or without the leading "AT". Lines starting with prefix (e.g. "+CEREG:")
+    // are passed to cb, a null prefix receives the lines that match no other command
+    template<typename T>
+    AtBatch& add(const char* cmd, int (*cb)(int, const char*, int, T*), T* param, const char* prefix,
+            system_tick_t timeout = DEFAULT_TIMEOUT) {
+        return addImpl(cmd, (Callback)cb, param, prefix, timeout);
+    }
+
+    AtBatch& add(const char* cmd, system_tick_t timeout = DEFAULT_TIMEOUT) {
+        return addImpl(cmd, nullptr, nullptr, nullptr, timeout);
+    }
+
+    // Skip the remaining commands once one of them fails
+    AtBatch& stopOnError(bool enabled) {
+        stopOnError_ = enabled;
+        return *this;
+    }
+
+    // Returns 0 if every command succeeded
+    int run();
+
+    // RESP_OK, RESP_ERROR, etc. RESP_ABORTED if the command was not run
+    int result(size_t index) const {
+        return (index < (size_t)entries_.size()) ? entries_.at(index).result : RESP_ABORTED;
+    }
+
+    size_t size() const {
+        return entries_.size();
+    }
+
+    void clear() {
+        entries_.clear();
+    }
+
+    static const system_tick_t DEFAULT_TIMEOUT = 2000;
+    static const size_t MAX_LINE_LENGTH = 200;
+
+private:
+
+    struct Entry {
+        String cmd; // Without the leading "AT"
+        Callback cb;
+        void* param;
+        const char* prefix;
+        system_tick_t timeout;
+        int result;
+    };
+
+    Vector<Entry> entries_;
+    size_t groupBegin_;
+    size_t groupEnd_;
+    bool stopOnError_;
+
+    AtBatch& addImpl(const char* cmd, Callback cb, void* param, const char* prefix, system_tick_t timeout);
+    int runGroup(size_t begin, size_t end);
+
+    static int cbRoute(int type, const char* buf, int len, AtBatch* batch);
+};
+
+} // particle
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "at_response.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace particle {
+
+namespace {
+
+inline bool isLineEnd(char c) {
+    return c == '\r' || c == '\n';
+}
+
+const char* skipLineEnds(const char* p, const char* end) {
+    while (p < end && isLineEnd(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && *p == ' ') {
+        ++p;
+    }
+    return p;
+}
+
+} // namespace
+
+AtResponse::AtResponse() :
+        params_(),
+        count_(0) {
+}
+
+bool AtResponse::parse(const char* buf, size_t len, const char* prefix) {
+    count_ = 0;
+    const char* end = buf + len;
+    const char* p = skipLineEnds(buf, end);
+    const size_t prefixLen = strlen(prefix);
+    if ((size_t)(end - p) < prefixLen || memcmp(p, prefix, prefixLen) != 0) {
+        return false;
+    }
+    p += prefixLen;
+    if (p < end && *p == ':') {
+        ++p;
+    } else if (p < end && !isLineEnd(*p)) {
+        return false; // e.g. "+QCFGEXT" given "+QCFG"
+    }
+    p = skipSpaces(p, end);
+    if (p == end || isLineEnd(*p)) {
+        return true;
+    }
+    while (count_ < MAX_PARAMS) {
+        auto& param = params_[count_++];
+        param.quoted = false;
+        p = skipSpaces(p, end);
+        const char* start = p;
+        if (p < end && *p == '"') {
+            start = ++p;
+            while (p < end && *p != '"' && !isLineEnd(*p)) {
+                ++p;
+            }
+            param.quoted = true;
+            param.data = start;
+            param.size = p - start;
+            if (p < end && *p == '"') {
+                ++p;
+            }
+            // Anything between the closing quote and the delimiter is ignored
+            while (p < end && *p != ',' && !isLineEnd(*p)) {
+                ++p;
+            }
+        } else {
+            while (p < end && *p != ',' && !isLineEnd(*p)) {
+                ++p;
+            }
+            const char* last = p;
+            while (last > start && last[-1] == ' ') {
+                --last;
+            }
+            param.data = start;
+            param.size = last - start;
+        }
+        if (p == end || *p != ',') {
+            break;
+        }
+        ++p;
+    }
+    return true;
+}
+
+bool AtResponse::parseLine(const char* buf, size_t len) {
+    count_ = 0;
+    const char* end = buf + len;
+    const char* p = skipLineEnds(buf, end);
+    const char* start = p;
+    while (p < end && !isLineEnd(*p)) {
+        ++p;
+    }
+    if (p == start) {
+        return false;
+    }
+    params_[0].data = start;
+    params_[0].size = p - start;
+    params_[0].quoted = false;
+    count_ = 1;
+    return true;
+}
+
+const char* AtResponse::data(size_t index, size_t* size) const {
+    if (index >= count_) {
+        return nullptr;
+    }
+    if (size) {
+        *size = params_[index].size;
+    }
+    return params_[index].data;
+}
+
+bool AtResponse::equals(size_t index, const char* str) const {
+    size_t size = 0;
+    auto d = data(index, &size);
+    return d && strlen(str) == size && memcmp(d, str, size) == 0;
+}
+
+bool AtResponse::getInt(size_t index, int* value, int base) const {
+    // Integers are short enough to be converted from a bounded copy
+    char s[16];
+    if (!getString(index, s, sizeof(s)) || !*s) {
+        return false;
+    }
+    char* last = nullptr;
+    long v = strtol(s, &last, base);
+    if (*last) {
+        return false;
+    }
+    *value = (int)v;
+    return true;
+}
+
+bool AtResponse::getDouble(size_t index, double* value) const {
+    char s[32];
+    if (!getString(index, s, sizeof(s)) || !*s) {
+        return false;
+    }
+    char* last = nullptr;
+    double v = strtod(s, &last);
+    if (*last) {
+        return false;
+    }
+    *value = v;
+    return true;
+}
+
+bool AtResponse::getString(size_t index, char* dst, size_t size) const {
+    size_t n = 0;
+    auto d = data(index, &n);
+    if (!d || !size) {
+        return false;
+    }
+    bool fits = n < size;
+    if (!fits) {
+        n = size - 1;
+    }
+    memcpy(dst, d, n);
+    dst[n] = '\0';
+    return fits;
+}
+
+} // namespace particle
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+// Destination for string parameters, copies are truncated to fit
+struct AtBuffer {
+    char* data;
+    size_t size;
+};
+
+// Single-pass tokenizer for AT response and URC lines such as +CEREG: 2,1,"1A2B","01234567",9.
+// Parameters reference the source buffer, nothing is copied or allocated until a value is read
+class AtResponse {
+
+public:
+
+    // +QENG: "servingcell" has the most parameters of the responses parsed by this library
+    static const size_t MAX_PARAMS = 20;
+
+    AtResponse();
+
+    // Tokenizes a line starting with prefix (e.g. "+CEREG"). Leading and trailing CR/LF are
+    // ignored. Returns false if the line has a different prefix
+    bool parse(const char* buf, size_t len, const char* prefix);
+
+    // Treats the whole line as a single unquoted parameter, for responses without a prefix
+    bool parseLine(const char* buf, size_t len);
+
+    size_t count() const {
+        return count_;
+    }
+
+    bool isQuoted(size_t index) const {
+        return index < count_ && params_[index].quoted;
+    }
+
+    // Quotes are not included
+    const char* data(size_t index, size_t* size) const;
+
+    bool equals(size_t index, const char* str) const;
+
+    bool getInt(size_t index, int* value, int base = 10) const;
+    bool getDouble(size_t index, double* value) const;
+
+    // Returns false if the parameter is missing or had to be truncated
+    bool getString(size_t index, char* dst, size_t size) const;
+
+    bool getString(size_t index, const AtBuffer& dst) const {
+        return getString(index, dst.data, dst.size);
+    }
+
+private:
+
+    struct Param {
+        const char* data;
+        uint16_t size;
+        bool quoted;
+    };
+
+    Param params_[MAX_PARAMS];
+    size_t count_;
+};
+
+} // particle
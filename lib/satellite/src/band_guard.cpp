@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "band_guard.h"
+#include "event_log.h"
+#include "at_response.h"
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.band");
+
+namespace particle {
+
+namespace {
+
+#define SATELLITE_BAND_CHECK_INTERVAL_MS (10 * 60 * 1000)
+
+} // namespace annonymous
+
+bool BandConfig::operator==(const BandConfig& other) const {
+    if (count != other.count) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (strcasecmp(masks[i], other.masks[i]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BandGuard::BandGuard() :
+        snapshot_(),
+        current_(),
+        valid_(false),
+        checkRequested_(false),
+        checkInterval_(SATELLITE_BAND_CHECK_INTERVAL_MS),
+        lastCheck_(0),
+        drifts_(0),
+        driftsDiag_(DIAG_ID_SATELLITE_BAND_DRIFTS, "sat:bandDrift", &drifts_) {
+}
+
+int BandGuard::cbQCFGband(int type, const char* buf, int len, BandConfig* config)
+{
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && config && resp.parse(buf, len, "+QCFG") && resp.equals(0, "band") && resp.count() >= 2) {
+        config->count = 0;
+        for (size_t i = 1; i < resp.count() && config->count < BandConfig::MAX_MASKS; i++) {
+            if (!resp.getString(i, config->masks[config->count], sizeof(config->masks[0]))) {
+                config->count = 0;
+                break;
+            }
+            config->count++;
+        }
+    }
+    return WAIT;
+}
+
+int BandGuard::snapshot() {
+    BandConfig config = {};
+    if (RESP_OK != Cellular.command(cbQCFGband, &config, 2000, "AT+QCFG=\"band\"\r\n") || !config.count) {
+        return SYSTEM_ERROR_AT_NOT_OK;
+    }
+    snapshot_ = config;
+    valid_ = true;
+    lastCheck_ = millis();
+    return 0;
+}
+
+bool BandGuard::due() const {
+    return valid_ && (checkRequested_ || millis() - lastCheck_ >= checkInterval_);
+}
+
+void BandGuard::addCheck(AtBatch& batch) {
+    current_ = {};
+    batch.add("AT+QCFG=\"band\"", cbQCFGband, &current_, "+QCFG: \"band\"");
+}
+
+int BandGuard::verify() {
+    checkRequested_ = false;
+    lastCheck_ = millis();
+    if (!valid_ || !current_.count) {
+        // The query didn't run or failed, try again at the next interval
+        return 0;
+    }
+    if (current_ == snapshot_) {
+        return 0;
+    }
+    drifts_++;
+    EventLog::instance().record(EventId::BAND_DRIFT);
+    Log.warn("Uncommanded band change: %s,%s,%s expected %s,%s,%s", current_.masks[0], current_.masks[1],
+            current_.masks[2], snapshot_.masks[0], snapshot_.masks[1], snapshot_.masks[2]);
+    return restore();
+}
+
+int BandGuard::restore() {
+    // The last parameter applies the configuration immediately
+    int r = RESP_ERROR;
+    if (snapshot_.count >= 4) {
+        r = Cellular.command(5000, "AT+QCFG=\"band\",%s,%s,%s,%s,1\r\n", snapshot_.masks[0], snapshot_.masks[1],
+                snapshot_.masks[2], snapshot_.masks[3]);
+    } else if (snapshot_.count == 3) {
+        r = Cellular.command(5000, "AT+QCFG=\"band\",%s,%s,%s,1\r\n", snapshot_.masks[0], snapshot_.masks[1],
+                snapshot_.masks[2]);
+    }
+    if (r != RESP_OK) {
+        Log.error("Failed to restore the band configuration");
+        return SYSTEM_ERROR_AT_NOT_OK;
+    }
+    Log.info("Band configuration restored");
+    return 0;
+}
+
+} // namespace particle
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+#include "at_batch.h"
+#include "diag_query/diag_query.h"
+
+namespace particle {
+
+// Band masks reported by AT+QCFG="band", e.g. +QCFG: "band",0xf,0x100002000000000f0e189f,0x10004200000000090e189f,0x7
+struct BandConfig {
+    static const size_t MAX_MASKS = 4;
+    static const size_t MAX_MASK_LENGTH = 35;
+
+    char masks[MAX_MASKS][MAX_MASK_LENGTH + 1];
+    size_t count;
+
+    bool operator==(const BandConfig& other) const;
+    bool operator!=(const BandConfig& other) const {
+        return !(*this == other);
+    }
+};
+
+// Detects uncommanded band configuration changes, which can keep the modem from registering for a
+// long time, and restores the configuration captured by snapshot()
+class BandGuard {
+
+public:
+
+    BandGuard();
+
+    int snapshot(void);
+
+    BandGuard& checkInterval(system_tick_t ms) {
+        checkInterval_ = ms;
+        return *this;
+    }
+
+    // True if a check is due or was requested
+    bool due(void) const;
+
+    // Requests a check with the next batch, e.g. after the registration was lost
+    void requestCheck(void) {
+        checkRequested_ = true;
+    }
+
+    // Adds the band query to a batch of periodic queries. verify() must be called after the batch was run
+    void addCheck(AtBatch& batch);
+    int verify(void);
+
+    uint32_t drifts(void) const {
+        return drifts_;
+    }
+
+private:
+
+    BandConfig snapshot_;
+    BandConfig current_;
+    bool valid_;
+    bool checkRequested_;
+    system_tick_t checkInterval_;
+    system_tick_t lastCheck_;
+    uint32_t drifts_;
+    UintDiagnosticSource driftsDiag_;
+
+    static int cbQCFGband(int type, const char* buf, int len, BandConfig* config);
+
+    int restore(void);
+};
+
+} // particle
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "budget_manager.h"
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.budget");
+
+#include "storage/record_storage.h"
+
+namespace particle {
+
+using namespace constrained;
+
+namespace {
+
+#define SATELLITE_BUDGET_FILE SATELLITE_STORAGE_DIR "/budget"
+#define SATELLITE_BUDGET_MAGIC (0x53424731) // "SBG1"
+
+#define SATELLITE_BUDGET_DEFAULT_PERIOD_SEC (30 * 24 * 60 * 60)
+#define SATELLITE_BUDGET_SAVE_INTERVAL_MS (5 * 60 * 1000)
+
+// Usage (in percent) at which traffic of a given priority class is deferred
+#define SATELLITE_BUDGET_BULK_MAX_USAGE (75)
+#define SATELLITE_BUDGET_TELEMETRY_MAX_USAGE (90)
+#define SATELLITE_BUDGET_RESPONSE_MAX_USAGE (100)
+
+} // namespace annonymous
+
+BudgetManager::BudgetManager() :
+        counters_(),
+        byteLimit_(0),
+        frameLimit_(0),
+        periodSec_(SATELLITE_BUDGET_DEFAULT_PERIOD_SEC),
+        lastSave_(0),
+        dirty_(false),
+        uplinkBytesDiag_(DIAG_ID_SATELLITE_UPLINK_BYTES, "sat:ulBytes", &counters_.uplinkBytes),
+        downlinkBytesDiag_(DIAG_ID_SATELLITE_DOWNLINK_BYTES, "sat:dlBytes", &counters_.downlinkBytes),
+        uplinkFramesDiag_(DIAG_ID_SATELLITE_UPLINK_FRAMES, "sat:ulFrames", &counters_.uplinkFrames),
+        downlinkFramesDiag_(DIAG_ID_SATELLITE_DOWNLINK_FRAMES, "sat:dlFrames", &counters_.downlinkFrames) {
+}
+
+int BudgetManager::begin() {
+    BudgetCounters c = {};
+    int r = loadRecord(SATELLITE_BUDGET_FILE, SATELLITE_BUDGET_MAGIC, &c, sizeof(c));
+    if (r == 0) {
+        counters_ = c;
+        Log.info("Budget: UL %lu bytes/%lu frames, DL %lu bytes/%lu frames", counters_.uplinkBytes,
+                counters_.uplinkFrames, counters_.downlinkBytes, counters_.downlinkFrames);
+    } else if (r != SYSTEM_ERROR_NOT_FOUND) {
+        Log.warn("Failed to load budget counters: %d", r);
+    }
+    lastSave_ = millis();
+    return 0;
+}
+
+void BudgetManager::process() {
+    if (Time.isValid()) {
+        auto now = (uint32_t)Time.now();
+        if (!counters_.periodStart) {
+            counters_.periodStart = now;
+            dirty_ = true;
+        } else if (now - counters_.periodStart >= periodSec_) {
+            Log.info("Budget period elapsed, resetting counters");
+            counters_ = {};
+            counters_.periodStart = now;
+            save();
+        }
+    }
+    if (dirty_ && millis() - lastSave_ >= SATELLITE_BUDGET_SAVE_INTERVAL_MS) {
+        save();
+    }
+}
+
+void BudgetManager::countUplink(size_t bytes) {
+    counters_.uplinkBytes += bytes;
+    counters_.uplinkFrames++;
+    dirty_ = true;
+}
+
+void BudgetManager::countDownlink(size_t bytes) {
+    counters_.downlinkBytes += bytes;
+    counters_.downlinkFrames++;
+    dirty_ = true;
+}
+
+unsigned BudgetManager::usage(size_t pendingBytes) const {
+    unsigned usage = 0;
+    if (byteLimit_) {
+        uint64_t bytes = (uint64_t)counters_.uplinkBytes + counters_.downlinkBytes + pendingBytes;
+        usage = std::max(usage, (unsigned)(bytes * 100 / byteLimit_));
+    }
+    if (frameLimit_) {
+        uint64_t frames = (uint64_t)counters_.uplinkFrames + counters_.downlinkFrames + (pendingBytes ? 1 : 0);
+        usage = std::max(usage, (unsigned)(frames * 100 / frameLimit_));
+    }
+    return usage;
+}
+
+bool BudgetManager::allow(MessagePriority priority, size_t size) const {
+    auto u = usage(size);
+    switch (priority) {
+    case MessagePriority::ALARM:
+        return true; // Alarms are never deferred
+    case MessagePriority::RESPONSE:
+        return u <= SATELLITE_BUDGET_RESPONSE_MAX_USAGE;
+    case MessagePriority::TELEMETRY:
+        return u <= SATELLITE_BUDGET_TELEMETRY_MAX_USAGE;
+    default:
+        return u <= SATELLITE_BUDGET_BULK_MAX_USAGE;
+    }
+}
+
+int BudgetManager::save() {
+    int r = saveRecord(SATELLITE_BUDGET_FILE, SATELLITE_BUDGET_MAGIC, &counters_, sizeof(counters_));
+    if (r < 0) {
+        Log.error("Failed to save budget counters: %d", r);
+        return r;
+    }
+    dirty_ = false;
+    lastSave_ = millis();
+    return 0;
+}
+
+} // namespace particle
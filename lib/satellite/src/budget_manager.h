@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+#include "message_channel.h"
+#include "diag_query/diag_query.h"
+
+namespace particle {
+
+struct BudgetCounters {
+    uint32_t periodStart; // Unix time
+    uint32_t uplinkBytes;
+    uint32_t downlinkBytes;
+    uint32_t uplinkFrames;
+    uint32_t downlinkFrames;
+};
+
+// Accounts for the traffic sent and received over NTN per billing period and defers low priority
+// traffic as the budget for the period runs out
+class BudgetManager {
+
+public:
+
+    BudgetManager();
+
+    int begin(void);
+    void process(void);
+
+    // 0 means unlimited
+    BudgetManager& limits(uint32_t bytes, uint32_t frames) {
+        byteLimit_ = bytes;
+        frameLimit_ = frames;
+        return *this;
+    }
+
+    BudgetManager& period(uint32_t seconds) {
+        periodSec_ = seconds;
+        return *this;
+    }
+
+    void countUplink(size_t bytes);
+    void countDownlink(size_t bytes);
+
+    bool allow(constrained::MessagePriority priority, size_t size) const;
+
+    // Percentage of the budget used in the current period
+    unsigned usage(size_t pendingBytes = 0) const;
+
+    const BudgetCounters& counters() const {
+        return counters_;
+    }
+
+private:
+
+    BudgetCounters counters_;
+    uint32_t byteLimit_;
+    uint32_t frameLimit_;
+    uint32_t periodSec_;
+    uint32_t lastSave_;
+    bool dirty_;
+
+    UintDiagnosticSource uplinkBytesDiag_;
+    UintDiagnosticSource downlinkBytesDiag_;
+    UintDiagnosticSource uplinkFramesDiag_;
+    UintDiagnosticSource downlinkFramesDiag_;
+
+    int save(void);
+};
+
+} // particle
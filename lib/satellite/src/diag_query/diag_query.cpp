@@ -10,8 +10,9 @@
 #include "Particle.h"
 #include "diag_query.h"
 #include <spark_wiring_logging.h>
+#include "satellite_log.h"
 
-int getDiagValueUint(uint8_t id, uint32_t* res) {
+int getDiagValueUint(uint16_t id, uint32_t* res) {
     // Retrieve the source for diag
 
     const diag_source* DiagSource = nullptr;
@@ -36,7 +37,7 @@ int getDiagValueUint(uint8_t id, uint32_t* res) {
     return Error::NONE;
 }
 
-int getDiagValueInt(uint8_t id, int32_t* res) {
+int getDiagValueInt(uint16_t id, int32_t* res) {
     // Retrieve the source for diag
     const diag_source* DiagSource = nullptr;
     int result = diag_get_source((diag_id)id, &DiagSource, nullptr);
@@ -95,14 +96,14 @@ int getDiagnosticValue(uint32_t id, std::vector<uint8_t>* res) {
         case DIAG_TYPE_INT: {
             int32_t val = 0;
             result = getDiagValueInt((diag_id)id, &val);
-            Log.printf(LOG_LEVEL_TRACE, "Diag: %lu --- type: %d --- Value: %ld\r\n", id, DiagSource->type, val);
+            SAT_LOG_PRINTF(TRACE, "Diag: %lu --- type: %d --- Value: %ld\r\n", id, DiagSource->type, val);
             intToBytes(val, res);
             break;
         }
         case DIAG_TYPE_UINT: {
             uint32_t val = 0;
             result = getDiagValueUint((diag_id)id, &val);
-            Log.printf(LOG_LEVEL_TRACE, "Diag: %lu --- type: %d --- Value: %lu\r\n", id, DiagSource->type, val);
+            SAT_LOG_PRINTF(TRACE, "Diag: %lu --- type: %d --- Value: %lu\r\n", id, DiagSource->type, val);
             uintToBytes(val, res);
             break;
         }
@@ -110,4 +111,48 @@ int getDiagnosticValue(uint32_t id, std::vector<uint8_t>* res) {
             break;
     }
     return result;
-}
\ No newline at end of file
+}
+
+namespace {
+
+// Sources hold a pointer to a 32-bit value owned by the caller
+int getValueCallback(const diag_source* src, int cmd, void* data) {
+    if (cmd != DIAG_SOURCE_CMD_GET) {
+        return Error::NOT_SUPPORTED;
+    }
+    auto cmdData = (diag_source_get_cmd_data*)data;
+    if (cmdData->data) {
+        if (cmdData->data_size < sizeof(uint32_t)) {
+            return Error::TOO_LARGE;
+        }
+        memcpy(cmdData->data, src->data, sizeof(uint32_t));
+    }
+    cmdData->data_size = sizeof(uint32_t);
+    return Error::NONE;
+}
+
+void registerSource(diag_source* src, uint16_t id, int type, const char* name, const void* value) {
+    src->size = sizeof(diag_source);
+    src->id = id;
+    src->type = type;
+    src->name = name;
+    src->data = (void*)value;
+    src->callback = getValueCallback;
+    // Sources can only be registered before the diagnostics service is started, i.e. by global constructors
+    int result = diag_register_source(src, nullptr);
+    if (result) {
+        Log.error("Failed to register diagnostic source %u: %d", (unsigned)id, result);
+    }
+}
+
+} // namespace
+
+UintDiagnosticSource::UintDiagnosticSource(uint16_t id, const char* name, const uint32_t* value) :
+        src_() {
+    registerSource(&src_, id, DIAG_TYPE_UINT, name, value);
+}
+
+IntDiagnosticSource::IntDiagnosticSource(uint16_t id, const char* name, const int32_t* value) :
+        src_() {
+    registerSource(&src_, id, DIAG_TYPE_INT, name, value);
+}
@@ -1,3 +1,68 @@
+#pragma once
+
 #include <vector>
+#include <cstdint>
+
+#include "diagnostics.h"
+
+// Diagnostic sources provided by this library. Their IDs are allocated from the range reserved for
+// application-specific sources
+enum SatelliteDiagnosticId: uint16_t {
+    DIAG_ID_SATELLITE_UPLINK_BYTES = 32768,
+    DIAG_ID_SATELLITE_DOWNLINK_BYTES = 32769,
+    DIAG_ID_SATELLITE_UPLINK_FRAMES = 32770,
+    DIAG_ID_SATELLITE_DOWNLINK_FRAMES = 32771,
+    DIAG_ID_SATELLITE_RSRP = 32772,
+    DIAG_ID_SATELLITE_RSRQ = 32773,
+    DIAG_ID_SATELLITE_SINR = 32774,
+    DIAG_ID_SATELLITE_CELL_ID = 32775,
+    DIAG_ID_SATELLITE_RECOVERY_NIPD_ATTEMPTS = 32776,
+    DIAG_ID_SATELLITE_RECOVERY_NIPD_SUCCESSES = 32777,
+    DIAG_ID_SATELLITE_RECOVERY_REATTACH_ATTEMPTS = 32778,
+    DIAG_ID_SATELLITE_RECOVERY_REATTACH_SUCCESSES = 32779,
+    DIAG_ID_SATELLITE_RECOVERY_CFUN_ATTEMPTS = 32780,
+    DIAG_ID_SATELLITE_RECOVERY_CFUN_SUCCESSES = 32781,
+    DIAG_ID_SATELLITE_RECOVERY_POWER_ATTEMPTS = 32782,
+    DIAG_ID_SATELLITE_RECOVERY_POWER_SUCCESSES = 32783,
+    DIAG_ID_SATELLITE_BAND_DRIFTS = 32784,
+    DIAG_ID_SATELLITE_RTT = 32785,
+    DIAG_ID_SATELLITE_MSG_FRAMES_SENT = 32786,
+    DIAG_ID_SATELLITE_MSG_BYTES_SENT = 32787,
+    DIAG_ID_SATELLITE_MSG_FRAMES_RECEIVED = 32788,
+    DIAG_ID_SATELLITE_MSG_BYTES_RECEIVED = 32789,
+    DIAG_ID_SATELLITE_MSG_TIMEOUTS = 32790,
+    DIAG_ID_SATELLITE_MSG_RETRIES = 32791,
+    DIAG_ID_SATELLITE_MSG_ALLOC_FAILURES = 32792,
+    DIAG_ID_SATELLITE_MSG_QUEUE_DEPTH = 32793,
+    DIAG_ID_SATELLITE_MSG_MAX_QUEUE_DEPTH = 32794,
+    DIAG_ID_SATELLITE_MSG_RTT_MEAN = 32795,
+    DIAG_ID_SATELLITE_MSG_RTT_MAX = 32796
+};
+
+int getDiagnosticValue(uint32_t id, std::vector<uint8_t>* res);
+
+// Exposes a 32-bit counter as a diagnostic source. Instances must be created by global constructors
+// and must outlive the diagnostics service
+class UintDiagnosticSource {
+public:
+    UintDiagnosticSource(uint16_t id, const char* name, const uint32_t* value);
+
+    UintDiagnosticSource(const UintDiagnosticSource&) = delete;
+    UintDiagnosticSource& operator=(const UintDiagnosticSource&) = delete;
+
+private:
+    diag_source src_;
+};
+
+// Exposes a signed 32-bit value as a diagnostic source, with the same lifetime requirements as
+// UintDiagnosticSource
+class IntDiagnosticSource {
+public:
+    IntDiagnosticSource(uint16_t id, const char* name, const int32_t* value);
+
+    IntDiagnosticSource(const IntDiagnosticSource&) = delete;
+    IntDiagnosticSource& operator=(const IntDiagnosticSource&) = delete;
 
-int getDiagnosticValue(uint32_t id, std::vector<uint8_t>* res);
\ No newline at end of file
+private:
+    diag_source src_;
+};
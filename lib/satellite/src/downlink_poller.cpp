@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "downlink_poller.h"
+#include "event_log.h"
+
+#include "satellite_log.h"
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.downlink");
+
+namespace particle {
+
+namespace {
+
+#define SATELLITE_DOWNLINK_POLL_INTERVAL_MS (1000)
+#define SATELLITE_DOWNLINK_POLL_DURATION_MS (30 * 1000)
+
+} // namespace annonymous
+
+DownlinkPoller::DownlinkPoller() :
+        interval_(SATELLITE_DOWNLINK_POLL_INTERVAL_MS),
+        duration_(SATELLITE_DOWNLINK_POLL_DURATION_MS),
+        lastUplink_(0),
+        lastPoll_(0),
+        rtt_(0),
+        srtt_(0),
+        minRtt_(0),
+        active_(false),
+        awaitingResponse_(false),
+        rttDiag_(DIAG_ID_SATELLITE_RTT, "sat:rtt", &rtt_) {
+}
+
+void DownlinkPoller::uplinkSent() {
+    lastUplink_ = millis();
+    lastPoll_ = lastUplink_;
+    active_ = true;
+    awaitingResponse_ = true;
+}
+
+void DownlinkPoller::polled(bool received) {
+    lastPoll_ = millis();
+    if (received && awaitingResponse_) {
+        // Only the first frame after an uplink is counted, the rest may be unrelated or fragments
+        awaitingResponse_ = false;
+        rtt_ = lastPoll_ - lastUplink_;
+        srtt_ = srtt_ ? (srtt_ * 7 + rtt_) / 8 : rtt_;
+        if (!minRtt_ || rtt_ < minRtt_) {
+            minRtt_ = rtt_;
+        }
+        EventLog::instance().record(EventId::RTT, rtt_);
+        SAT_LOG_TRACE("RTT: %lu ms (smoothed %lu ms)", rtt_, srtt_);
+    }
+    if (active_ && lastPoll_ - lastUplink_ >= duration_) {
+        active_ = false;
+        awaitingResponse_ = false;
+    }
+}
+
+bool DownlinkPoller::active() const {
+    return active_ && millis() - lastUplink_ < duration_;
+}
+
+bool DownlinkPoller::due() const {
+    return active() && millis() - lastPoll_ >= interval_;
+}
+
+system_tick_t DownlinkPoller::untilPoll() const {
+    if (!active()) {
+        return 0;
+    }
+    auto elapsed = millis() - lastPoll_;
+    return (elapsed >= interval_) ? 0 : interval_ - elapsed;
+}
+
+} // namespace particle
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+#include "diag_query/diag_query.h"
+
+namespace particle {
+
+// Polls for downlink data at short intervals for a while after each uplink so that acknowledgements
+// and responses from the Cloud are picked up without waiting for the regular receive timer. The time
+// from an uplink to the first downlink that follows it is kept as the round trip time
+class DownlinkPoller {
+
+public:
+
+    DownlinkPoller();
+
+    DownlinkPoller(const DownlinkPoller&) = delete;
+    DownlinkPoller& operator=(const DownlinkPoller&) = delete;
+
+    // Interval between polls after an uplink
+    DownlinkPoller& interval(system_tick_t ms) {
+        interval_ = ms;
+        return *this;
+    }
+
+    // How long to keep polling after the last uplink
+    DownlinkPoller& duration(system_tick_t ms) {
+        duration_ = ms;
+        return *this;
+    }
+
+    // Called when the modem accepted an uplink frame
+    void uplinkSent(void);
+
+    // Called after each poll, received is true if a frame was read
+    void polled(bool received);
+
+    // True while polling after an uplink
+    bool active(void) const;
+
+    // True if the next poll is due
+    bool due(void) const;
+
+    // Time until the next poll, 0 if it is due or polling is not active
+    system_tick_t untilPoll(void) const;
+
+    // Last measured round trip time in milliseconds, 0 if none was measured yet
+    uint32_t rtt(void) const {
+        return rtt_;
+    }
+
+    // Smoothed round trip time in milliseconds
+    uint32_t smoothedRtt(void) const {
+        return srtt_;
+    }
+
+    // Lowest round trip time seen since boot
+    uint32_t minRtt(void) const {
+        return minRtt_;
+    }
+
+private:
+
+    system_tick_t interval_;
+    system_tick_t duration_;
+    system_tick_t lastUplink_;
+    system_tick_t lastPoll_;
+    uint32_t rtt_;
+    uint32_t srtt_;
+    uint32_t minRtt_;
+    bool active_;
+    bool awaitingResponse_;
+
+    UintDiagnosticSource rttDiag_;
+};
+
+} // particle
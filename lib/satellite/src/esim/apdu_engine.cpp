@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "apdu_engine.h"
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.apdu");
+
+#include "check.h"
+#include "hex_to_bytes.h"
+
+namespace particle {
+
+namespace {
+
+#define ESIM_APDU_TIMEOUT_MS (10000)
+#define ESIM_APDU_MAX_ATTEMPTS (2)
+// Commands right after a SIM refresh are occasionally rejected, retry after a pause
+#define ESIM_APDU_RETRY_DELAY_MS (1000)
+
+int cbCSIM(int type, const char* buf, int len, AtBuffer* response)
+{
+    // +CSIM: <length>,"<response>"
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && response && resp.parse(buf, len, "+CSIM")) {
+        resp.getString(1, *response);
+    }
+    return WAIT;
+}
+
+} // namespace annonymous
+
+ApduEngine::ApduEngine() :
+        data_(),
+        hex_(),
+        dataSize_(0),
+        getResponse_(-1),
+        channel_(0),
+        retryTime_(0) {
+}
+
+int ApduEngine::openChannel(const char* aid, OnComplete onComplete) {
+    CHECK(enqueue(CommandType::OPEN, 0x00, "70000001", nullptr));
+    return enqueue(CommandType::SELECT, 0x00, aid, [onComplete](int error, const uint8_t*, size_t) {
+        if (onComplete) {
+            onComplete(error);
+        }
+    });
+}
+
+int ApduEngine::closeChannel(OnComplete onComplete) {
+    return enqueue(CommandType::CLOSE, 0x00, "", [onComplete](int error, const uint8_t*, size_t) {
+        if (onComplete) {
+            onComplete(error);
+        }
+    });
+}
+
+int ApduEngine::transmit(uint8_t cla, const char* body, OnResponse onResponse) {
+    return enqueue(CommandType::APDU, cla, body, std::move(onResponse));
+}
+
+int ApduEngine::enqueue(CommandType type, uint8_t cla, const char* body, OnResponse onResponse) {
+    Command cmd = {};
+    cmd.type = type;
+    cmd.cla = cla;
+    cmd.body = body;
+    cmd.onResponse = std::move(onResponse);
+    if (!queue_.append(std::move(cmd))) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    return 0;
+}
+
+void ApduEngine::cancel() {
+    while (!queue_.isEmpty()) {
+        complete(SYSTEM_ERROR_CANCELLED);
+    }
+}
+
+void ApduEngine::process() {
+    if (queue_.isEmpty() || (retryTime_ && millis() - retryTime_ < ESIM_APDU_RETRY_DELAY_MS)) {
+        return;
+    }
+    retryTime_ = 0;
+    auto& cmd = queue_.first();
+    if (cmd.type != CommandType::OPEN && !channel_) {
+        // The channel failed to open
+        complete(SYSTEM_ERROR_INVALID_STATE);
+        return;
+    }
+
+    char apdu[300] = {};
+    if (getResponse_ >= 0) {
+        snprintf(apdu, sizeof(apdu), "%02XC00000%02X", 0x80 | channel_, getResponse_);
+    } else if (cmd.type == CommandType::OPEN) {
+        snprintf(apdu, sizeof(apdu), "00%s", cmd.body.c_str());
+    } else if (cmd.type == CommandType::SELECT) {
+        snprintf(apdu, sizeof(apdu), "%02XA40404%02X%s00", channel_, (unsigned)cmd.body.length() / 2, cmd.body.c_str());
+    } else if (cmd.type == CommandType::CLOSE) {
+        snprintf(apdu, sizeof(apdu), "007080%02X00", channel_);
+    } else {
+        snprintf(apdu, sizeof(apdu), "%02X%s", cmd.cla | channel_, cmd.body.c_str());
+    }
+
+    hex_[0] = '\0';
+    AtBuffer resp = { hex_, sizeof(hex_) };
+    if (RESP_OK != Cellular.command(cbCSIM, &resp, ESIM_APDU_TIMEOUT_MS, "AT+CSIM=%u,\"%s\"\r\n", (unsigned)strlen(apdu), apdu)) {
+        if (++cmd.attempts < ESIM_APDU_MAX_ATTEMPTS) {
+            retryTime_ = millis();
+        } else {
+            complete(SYSTEM_ERROR_AT_NOT_OK);
+        }
+        return;
+    }
+    size_t len = strlen(hex_);
+    if (len < 4 || (len & 1)) {
+        complete(SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+        return;
+    }
+    size_t n = (len - 4) / 2;
+    if (dataSize_ + n > sizeof(data_)) {
+        complete(SYSTEM_ERROR_TOO_LARGE);
+        return;
+    }
+    hexToBytes(hex_, (char*)data_ + dataSize_, n);
+    dataSize_ += n;
+    uint8_t sw[2] = {};
+    hexToBytes(hex_ + len - 4, (char*)sw, sizeof(sw));
+
+    if (sw[0] == 0x61) {
+        // More data is available
+        getResponse_ = sw[1];
+        return;
+    }
+    getResponse_ = -1;
+    if (sw[0] != 0x90 && sw[0] != 0x91) {
+        Log.error("APDU %.8s... failed: %02X%02X", apdu, sw[0], sw[1]);
+        complete(SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+        return;
+    }
+    if (cmd.type == CommandType::OPEN) {
+        // MANAGE CHANNEL returns the number of the new channel
+        channel_ = (dataSize_ == 1 && data_[0] >= 1 && data_[0] <= 3) ? data_[0] : 0;
+        complete(channel_ ? 0 : SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+        return;
+    }
+    if (cmd.type == CommandType::CLOSE) {
+        channel_ = 0;
+    }
+    complete(0);
+}
+
+void ApduEngine::complete(int error) {
+    auto cmd = std::move(queue_.first());
+    queue_.removeAt(0);
+    size_t size = dataSize_;
+    dataSize_ = 0;
+    getResponse_ = -1;
+    retryTime_ = 0;
+    if (cmd.type == CommandType::SELECT && error < 0) {
+        // Don't leave a channel open for an application that couldn't be selected
+        if (channel_) {
+            Cellular.command(ESIM_APDU_TIMEOUT_MS, "AT+CSIM=10,\"007080%02X00\"\r\n", channel_);
+            channel_ = 0;
+        }
+    }
+    if (cmd.onResponse) {
+        cmd.onResponse(error, data_, size);
+    }
+}
+
+} // namespace particle
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+#include <spark_wiring_vector.h>
+#include <functional>
+
+#include "at_response.h"
+
+namespace particle {
+
+// Exchanges APDUs with the SIM over AT+CSIM without blocking the caller. Commands are queued and
+// process() sends at most one AT command per call. 61xx responses are followed with GET RESPONSE
+// automatically and the response data is reassembled
+class ApduEngine {
+
+public:
+
+    // data excludes the status word. error is non-zero if the command failed or the status word
+    // was not 9000 or 91xx
+    typedef std::function<void(int error, const uint8_t* data, size_t size)> OnResponse;
+    typedef std::function<void(int error)> OnComplete;
+
+    static const size_t MAX_RESPONSE_SIZE = 1024;
+
+    ApduEngine();
+
+    // Opens a logical channel and selects the application with the given AID (hex)
+    int openChannel(const char* aid, OnComplete onComplete = nullptr);
+    int closeChannel(OnComplete onComplete = nullptr);
+
+    // body is the hex encoded APDU without the class byte. cla is combined with the channel number
+    int transmit(uint8_t cla, const char* body, OnResponse onResponse = nullptr);
+
+    void process(void);
+
+    // Fails all queued commands with SYSTEM_ERROR_CANCELLED
+    void cancel(void);
+
+    bool busy(void) const {
+        return !queue_.isEmpty();
+    }
+
+    int channel(void) const {
+        return channel_;
+    }
+
+private:
+
+    enum class CommandType {
+        OPEN,
+        SELECT,
+        APDU,
+        CLOSE
+    };
+
+    struct Command {
+        CommandType type;
+        uint8_t cla;
+        String body;
+        OnResponse onResponse;
+        unsigned attempts;
+    };
+
+    Vector<Command> queue_;
+    uint8_t data_[MAX_RESPONSE_SIZE];
+    char hex_[2 * 256 + 8]; // One response of up to 256 bytes and the status word
+    size_t dataSize_;
+    int getResponse_; // Bytes to fetch with GET RESPONSE, -1 if none
+    int channel_;
+    system_tick_t retryTime_;
+
+    int enqueue(CommandType type, uint8_t cla, const char* body, OnResponse onResponse);
+    void complete(int error);
+};
+
+} // particle
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ber_tlv.h"
+
+#include "system_error.h"
+
+namespace particle {
+
+int readTlv(const uint8_t* data, size_t size, Tlv* tlv) {
+    size_t pos = 0;
+    if (size < 2) {
+        return SYSTEM_ERROR_NOT_ENOUGH_DATA;
+    }
+    // Tag, multi-byte if the low 5 bits of the first byte are all set
+    uint32_t tag = data[pos++];
+    if ((tag & 0x1f) == 0x1f) {
+        do {
+            if (pos >= size || pos > 3) {
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            tag = (tag << 8) | data[pos];
+        } while (data[pos++] & 0x80);
+    }
+    // Length, either short form or 0x81-0x83 followed by up to 3 bytes
+    if (pos >= size) {
+        return SYSTEM_ERROR_NOT_ENOUGH_DATA;
+    }
+    size_t len = data[pos++];
+    if (len & 0x80) {
+        size_t n = len & 0x7f;
+        if (n == 0 || n > 3 || pos + n > size) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        len = 0;
+        while (n--) {
+            len = (len << 8) | data[pos++];
+        }
+    }
+    if (len > size - pos) {
+        return SYSTEM_ERROR_NOT_ENOUGH_DATA;
+    }
+    tlv->tag = tag;
+    tlv->value = data + pos;
+    tlv->size = len;
+    return pos + len;
+}
+
+bool TlvReader::next(Tlv* tlv) {
+    if (!size_ || error_) {
+        return false;
+    }
+    int n = readTlv(data_, size_, tlv);
+    if (n < 0) {
+        error_ = n;
+        return false;
+    }
+    data_ += n;
+    size_ -= n;
+    return true;
+}
+
+bool TlvReader::find(uint32_t tag, Tlv* tlv) {
+    while (next(tlv)) {
+        if (tlv->tag == tag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace particle
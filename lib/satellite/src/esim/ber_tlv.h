@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+// A BER-TLV data object. value points into the parsed buffer
+struct Tlv {
+    uint32_t tag;
+    const uint8_t* value;
+    size_t size;
+};
+
+// Parses the data object at the start of data. Returns the number of bytes it occupies or a
+// negative error if it is truncated or malformed
+int readTlv(const uint8_t* data, size_t size, Tlv* tlv);
+
+// Iterates over the data objects in a constructed value
+class TlvReader {
+
+public:
+
+    TlvReader(const uint8_t* data, size_t size) :
+            data_(data),
+            size_(size),
+            error_(0) {
+    }
+
+    explicit TlvReader(const Tlv& parent) :
+            TlvReader(parent.value, parent.size) {
+    }
+
+    bool next(Tlv* tlv);
+
+    // Finds the next data object with the given tag, skipping the others
+    bool find(uint32_t tag, Tlv* tlv);
+
+    // Non-zero if the data was malformed
+    int error() const {
+        return error_;
+    }
+
+private:
+
+    const uint8_t* data_;
+    size_t size_;
+    int error_;
+};
+
+} // particle
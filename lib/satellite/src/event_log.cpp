@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "event_log.h"
+#include "storage/record_storage.h"
+
+#include "check.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.events");
+
+namespace particle {
+
+namespace {
+
+#define SATELLITE_EVENT_LOG_FILE SATELLITE_STORAGE_DIR "/events"
+#define SATELLITE_EVENT_LOG_MAGIC (0x45564c31) // "EVL1"
+#define SATELLITE_EVENT_LOG_SAVE_INTERVAL_MS (15 * 60 * 1000)
+#define SATELLITE_EVENT_LOG_CHUNK_VERSION (1)
+
+// Bytes that are freed at once when the buffer is full, so that records aren't moved for every write
+#define SATELLITE_EVENT_LOG_DROP_SIZE (256)
+
+// Header byte: argument count in the upper 3 bits, event ID in the lower 5 bits
+const unsigned ARG_COUNT_SHIFT = 5;
+const uint8_t EVENT_ID_MASK = 0x1f;
+
+const size_t MAX_VARINT_SIZE = 5;
+
+size_t encodeVarint(uint32_t value, uint8_t* buf) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        buf[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buf[n++] = value;
+    return n;
+}
+
+// Returns the number of bytes read, 0 if the data is truncated
+size_t decodeVarint(const uint8_t* buf, size_t size, uint32_t* value) {
+    uint32_t v = 0;
+    for (size_t i = 0; i < size && i < MAX_VARINT_SIZE; ++i) {
+        v |= (uint32_t)(buf[i] & 0x7f) << (i * 7);
+        if (!(buf[i] & 0x80)) {
+            *value = v;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Small negative values, e.g. error codes, are encoded as small positive ones
+inline uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+void writeUint32(uint8_t* buf, uint32_t value) {
+    buf[0] = value;
+    buf[1] = value >> 8;
+    buf[2] = value >> 16;
+    buf[3] = value >> 24;
+}
+
+} // namespace annonymous
+
+EventLog& EventLog::instance() {
+    static EventLog log;
+    return log;
+}
+
+EventLog::EventLog() :
+        record_(),
+        lastTime_(0),
+        lastSave_(0),
+        dropped_(0),
+        generation_(0),
+        readGeneration_(0),
+        readSize_(0),
+        dirty_(false) {
+}
+
+int EventLog::begin() {
+    Record saved = {};
+    int r = loadRecord(SATELLITE_EVENT_LOG_FILE, SATELLITE_EVENT_LOG_MAGIC, &saved, sizeof(saved));
+    if (r < 0 || saved.size > sizeof(saved.data)) {
+        if (r != SYSTEM_ERROR_NOT_FOUND) {
+            Log.warn("Discarding event log: %d", r);
+        }
+    } else {
+        record_ = saved;
+        Log.info("Loaded %u bytes of events", (unsigned)saved.size);
+    }
+    ++generation_;
+    // The BOOT record holds the time since boot instead of a delta
+    lastTime_ = 0;
+    record(EventId::BOOT, System.resetReason());
+    return 0;
+}
+
+void EventLog::process() {
+    if (dirty_ && millis() - lastSave_ >= SATELLITE_EVENT_LOG_SAVE_INTERVAL_MS) {
+        save();
+    }
+}
+
+int EventLog::save() {
+    lastSave_ = millis();
+    CHECK(saveRecord(SATELLITE_EVENT_LOG_FILE, SATELLITE_EVENT_LOG_MAGIC, &record_, sizeof(record_)));
+    dirty_ = false;
+    return 0;
+}
+
+void EventLog::write(EventId id, const int32_t* args, size_t count) {
+    uint8_t rec[1 + MAX_VARINT_SIZE * (1 + MAX_ARGS)];
+    size_t n = 0;
+    auto now = millis();
+    rec[n++] = (count << ARG_COUNT_SHIFT) | ((uint8_t)id & EVENT_ID_MASK);
+    n += encodeVarint(now - lastTime_, rec + n);
+    for (size_t i = 0; i < count; ++i) {
+        n += encodeVarint(zigzag(args[i]), rec + n);
+    }
+    if (record_.size + n > sizeof(record_.data)) {
+        dropped_ += removeFront(std::max<size_t>(n, SATELLITE_EVENT_LOG_DROP_SIZE));
+    }
+    std::memcpy(record_.data + record_.size, rec, n);
+    record_.size += n;
+    lastTime_ = now;
+    dirty_ = true;
+}
+
+size_t EventLog::removeFront(size_t size) {
+    size_t offs = 0;
+    size_t count = 0;
+    while (offs < size && offs < record_.size) {
+        uint32_t delta = 0;
+        size_t n = recordSize(offs, &delta);
+        if (!n) {
+            // Corrupted, start over
+            offs = record_.size;
+            break;
+        }
+        if ((record_.data[offs] & EVENT_ID_MASK) == (uint8_t)EventId::BOOT) {
+            record_.baseTime = delta;
+        } else {
+            record_.baseTime += delta;
+        }
+        offs += n;
+        ++count;
+    }
+    std::memmove(record_.data, record_.data + offs, record_.size - offs);
+    record_.size -= offs;
+    ++generation_;
+    dirty_ = true;
+    return count;
+}
+
+size_t EventLog::recordSize(size_t offset, uint32_t* delta) const {
+    auto d = record_.data + offset;
+    auto size = record_.size - offset;
+    if (!size) {
+        return 0;
+    }
+    size_t count = d[0] >> ARG_COUNT_SHIFT;
+    size_t n = 1;
+    uint32_t v = 0;
+    for (size_t i = 0; i <= count; ++i) {
+        size_t r = decodeVarint(d + n, size - n, &v);
+        if (!r) {
+            return 0;
+        }
+        if (i == 0 && delta) {
+            *delta = v;
+        }
+        n += r;
+    }
+    return n;
+}
+
+size_t EventLog::read(uint8_t* buf, size_t size) {
+    readSize_ = 0;
+    if (size <= CHUNK_HEADER_SIZE) {
+        return 0;
+    }
+    size_t n = 0;
+    while (n < record_.size) {
+        size_t r = recordSize(n);
+        if (!r || CHUNK_HEADER_SIZE + n + r > size) {
+            break;
+        }
+        n += r;
+    }
+    if (!n) {
+        return 0;
+    }
+    // The wall clock time at export lets the decoder timestamp the records logged since boot
+    buf[0] = SATELLITE_EVENT_LOG_CHUNK_VERSION;
+    writeUint32(buf + 1, record_.baseTime);
+    writeUint32(buf + 5, Time.isValid() ? (uint32_t)Time.now() : 0);
+    writeUint32(buf + 9, millis());
+    std::memcpy(buf + CHUNK_HEADER_SIZE, record_.data, n);
+    readSize_ = n;
+    readGeneration_ = generation_;
+    return CHUNK_HEADER_SIZE + n;
+}
+
+void EventLog::consume() {
+    if (!readSize_ || readGeneration_ != generation_) {
+        readSize_ = 0;
+        return;
+    }
+    removeFront(readSize_);
+    readSize_ = 0;
+}
+
+void EventLog::clear() {
+    record_.baseTime = lastTime_;
+    record_.size = 0;
+    readSize_ = 0;
+    ++generation_;
+    dirty_ = true;
+}
+
+} // namespace particle
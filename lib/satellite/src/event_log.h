@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+namespace particle {
+
+// Event IDs of the binary event log. The IDs are the tokens of the host-side format table in
+// tools/decode_event_log.py, existing values must not be changed. Arguments are listed in order
+enum class EventId: uint8_t {
+    BOOT = 1, // reset reason. Starts a new time base
+    TX = 2, // bytes
+    TX_FAILED = 3, // AT result, CME error, TxFailure
+    RX = 4, // bytes
+    REGISTRATION = 5, // registered (0/1)
+    RECOVERY = 6, // RecoveryStep
+    BAND_DRIFT = 7,
+    UPLINK_WINDOW = 8, // frames waiting to be sent (0/1)
+    RTT = 9, // round trip time in ms
+    GNSS_FIX = 10, // time to fix in ms, satellites in view
+    BEARER_SWITCH = 11, // Bearer
+    SLEEP = 12, // duration in ms
+    PUBLISH_DONE = 13, // error, latency in ms
+    MAX = 31
+};
+
+// Compact log of field events kept in RAM and saved to the flash filesystem. Each record is a
+// header byte with the event ID and argument count, the time since the previous record and the
+// arguments, all as variable length integers, which makes most records 3 to 6 bytes long instead of
+// a formatted line of text. The oldest records are dropped when the buffer is full.
+//
+// read() exports the oldest records as a self-contained chunk that can be sent to the Cloud and
+// decoded on a host with tools/decode_event_log.py
+class EventLog {
+
+public:
+
+    static const size_t MAX_ARGS = 7;
+    static const size_t CHUNK_HEADER_SIZE = 13;
+
+    static EventLog& instance();
+
+    // Loads the records saved before the last reset and logs a BOOT event. Must be called before
+    // anything else is logged
+    int begin(void);
+
+    // Saves the log to flash periodically if it changed
+    void process(void);
+
+    int save(void);
+
+    template<typename... ArgsT>
+    void record(EventId id, ArgsT... args) {
+        static_assert(sizeof...(ArgsT) <= MAX_ARGS, "Too many event arguments");
+        const int32_t argv[] = { (int32_t)args..., 0 };
+        write(id, argv, sizeof...(ArgsT));
+    }
+
+    // Writes a chunk with as many of the oldest records as fit in the buffer. Returns the size of the
+    // chunk, 0 if there are no records or the buffer can't hold one
+    size_t read(uint8_t* buf, size_t size);
+
+    // Removes the records returned by the last read() once they were delivered. Does nothing if older
+    // records were dropped in the meantime
+    void consume(void);
+
+    void clear(void);
+
+    // Bytes used by the records
+    size_t size(void) const {
+        return record_.size;
+    }
+
+    // Records dropped because the buffer was full
+    uint32_t dropped(void) const {
+        return dropped_;
+    }
+
+private:
+
+    struct Record {
+        uint32_t baseTime; // Time of the record before the first one, in ms
+        uint32_t size;
+        uint8_t data[2048];
+    };
+
+    Record record_;
+    system_tick_t lastTime_;
+    system_tick_t lastSave_;
+    uint32_t dropped_;
+    uint32_t generation_; // Changes when records are dropped
+    uint32_t readGeneration_;
+    size_t readSize_;
+    bool dirty_;
+
+    EventLog();
+
+    void write(EventId id, const int32_t* args, size_t count);
+    size_t removeFront(size_t size);
+    size_t recordSize(size_t offset, uint32_t* delta = nullptr) const;
+};
+
+} // particle
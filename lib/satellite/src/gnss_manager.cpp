@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gnss_manager.h"
+#include "event_log.h"
+
+#include "satellite_log.h"
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.gnss");
+
+namespace particle {
+
+namespace {
+
+#define SATELLITE_GNSS_DEFAULT_INTERVAL_MS (5 * 60 * 1000)
+#define SATELLITE_GNSS_DEFAULT_TIMEOUT_MS (120000)
+#define SATELLITE_GNSS_SEARCH_POLL_MS (2000)
+#define SATELLITE_GNSS_TRACKING_POLL_MS (10000)
+
+// +CME ERROR returned by AT+QGPS=1 when a session is already running
+#define SATELLITE_GNSS_SESSION_ONGOING (504)
+
+} // namespace annonymous
+
+GnssManager::GnssManager() :
+        state_(State::IDLE),
+        mode_(GnssMode::ON_DEMAND),
+        interval_(SATELLITE_GNSS_DEFAULT_INTERVAL_MS),
+        timeout_(SATELLITE_GNSS_DEFAULT_TIMEOUT_MS),
+        sessionStart_(0),
+        lastPoll_(0),
+        fixTime_(0),
+        fix_(),
+        lastError_(0),
+        requested_(false),
+        xtraInjected_(false) {
+}
+
+int GnssManager::cbQGPSLOC(int type, const char* buf, int len, GnssPositioningInfo* info)
+{
+    // +QGPSLOC: <hhmmss.sss>,<lat>,<lon>,<hdop>,<alt>,<fix>,<cog>,<spkm>,<spkn>,<ddmmyy>,<nsat>
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && info && resp.parse(buf, len, "+QGPSLOC") && resp.count() >= 11) {
+        char time[11] = "";
+        char date[7] = "";
+        double hdop = 0, alt = 0, cog = 0, spkm = 0, spkn = 0;
+        if (resp.getString(0, time, sizeof(time)) && strlen(time) >= 6 &&
+                resp.getString(9, date, sizeof(date)) && strlen(date) == 6 &&
+                resp.getDouble(1, &info->latitude) && resp.getDouble(2, &info->longitude) &&
+                resp.getDouble(3, &hdop) && resp.getDouble(4, &alt) && resp.getInt(5, &info->posMode) &&
+                resp.getDouble(6, &cog) && resp.getDouble(7, &spkm) && resp.getDouble(8, &spkn) &&
+                resp.getInt(10, &info->satsInView)) {
+            auto twoDigits = [](const char* s) {
+                return (s[0] - '0') * 10 + (s[1] - '0');
+            };
+            info->utcTime.tm_hour = twoDigits(time);
+            info->utcTime.tm_min = twoDigits(time + 2);
+            info->utcTime.tm_sec = twoDigits(time + 4);
+            info->utcTime.tm_mday = twoDigits(date);
+            info->utcTime.tm_mon = twoDigits(date + 2);
+            info->utcTime.tm_year = twoDigits(date + 4);
+            info->accuracy = hdop;
+            info->altitude = alt;
+            info->cog = cog;
+            info->speedKmph = spkm;
+            info->speedKnots = spkn;
+            info->valid = 1;
+        }
+    }
+    return WAIT;
+}
+
+int GnssManager::cbQGPSXTRA(int type, const char* buf, int len, int* enabled)
+{
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && enabled && resp.parse(buf, len, "+QGPSXTRA")) {
+        resp.getInt(0, enabled);
+    }
+    return WAIT;
+}
+
+int GnssManager::begin() {
+    // XTRA (assisted GNSS) keeps predicted orbits in the modem so that fixes take seconds instead
+    // of a full cold start. The setting is non-volatile, write it only if needed
+    int xtra = -1;
+    Cellular.command(cbQGPSXTRA, &xtra, 2000, "AT+QGPSXTRA?\r\n");
+    if (xtra != 1) {
+        if (RESP_OK != Cellular.command(2000, "AT+QGPSXTRA=1\r\n")) {
+            Log.warn("Failed to enable XTRA");
+        }
+        Cellular.command(2000, "AT+QGPSCFG=\"xtra_autodownload\",1\r\n");
+    }
+    xtraInjected_ = false;
+    return 0;
+}
+
+void GnssManager::injectXtraTime() {
+    // XTRA data is only used once the modem knows the current time
+    if (xtraInjected_ || !Time.isValid()) {
+        return;
+    }
+    auto now = Time.now();
+    auto r = Cellular.command(2000, "AT+QGPSXTRATIME=0,\"%s\",1,1,3500\r\n",
+            Time.format(now, "%Y/%m/%d,%H:%M:%S").c_str());
+    xtraInjected_ = (r == RESP_OK);
+}
+
+int GnssManager::requestFix(system_tick_t maxAge) {
+    if (active()) {
+        return 0;
+    }
+    if (maxAge && fixAge() <= maxAge) {
+        return 0;
+    }
+    requested_ = true;
+    return 0;
+}
+
+int GnssManager::stop() {
+    requested_ = false;
+    if (running()) {
+        endSession(SYSTEM_ERROR_CANCELLED);
+    }
+    return 0;
+}
+
+bool GnssManager::lastFix(GnssPositioningInfo* info, system_tick_t* age) const {
+    if (!fix_.valid) {
+        return false;
+    }
+    if (info) {
+        *info = fix_;
+    }
+    if (age) {
+        *age = fixAge();
+    }
+    return true;
+}
+
+system_tick_t GnssManager::fixAge() const {
+    return fix_.valid ? millis() - fixTime_ : UINT32_MAX;
+}
+
+int GnssManager::startSession() {
+    injectXtraTime();
+    auto r = Cellular.command(2000, "AT+QGPS=1\r\n");
+    if (r != RESP_OK) {
+        // The session may still be running, e.g. after a reset of the application processor
+        if (RESP_OK != Cellular.command(2000, "AT+QGPSEND\r\n") ||
+                RESP_OK != Cellular.command(2000, "AT+QGPS=1\r\n")) {
+            Log.error("Failed to start GNSS session");
+            lastError_ = SYSTEM_ERROR_AT_NOT_OK;
+            return lastError_;
+        }
+    }
+    Log.info("GNSS session started");
+    state_ = State::SEARCHING;
+    sessionStart_ = millis();
+    lastPoll_ = millis();
+    return 0;
+}
+
+void GnssManager::endSession(int error) {
+    Cellular.command(2000, "AT+QGPSEND\r\n");
+    state_ = State::IDLE;
+    lastError_ = error;
+    if (error == SYSTEM_ERROR_TIMEOUT) {
+        Log.warn("No GNSS fix after %lu ms", timeout_);
+    }
+}
+
+void GnssManager::process() {
+    if (state_ == State::IDLE) {
+        bool start = requested_ || (mode_ == GnssMode::TRACKING && lastError_ != SYSTEM_ERROR_CANCELLED &&
+                millis() - sessionStart_ >= SATELLITE_GNSS_TRACKING_POLL_MS) ||
+                (mode_ == GnssMode::PERIODIC && fixAge() >= interval_ &&
+                (!sessionStart_ || millis() - sessionStart_ >= interval_));
+        if (start && (!onCanStart_ || onCanStart_())) {
+            requested_ = false;
+            if (startSession() < 0) {
+                // Don't retry in a tight loop
+                sessionStart_ = millis();
+            }
+        }
+        return;
+    }
+
+    system_tick_t pollInterval = (state_ == State::SEARCHING) ? SATELLITE_GNSS_SEARCH_POLL_MS : SATELLITE_GNSS_TRACKING_POLL_MS;
+    if (millis() - lastPoll_ < pollInterval) {
+        return;
+    }
+    lastPoll_ = millis();
+
+    GnssPositioningInfo info = {};
+    Cellular.command(cbQGPSLOC, &info, 2000, "AT+QGPSLOC=2\r\n");
+    if (info.valid) {
+        if (state_ == State::SEARCHING) {
+            Log.info("GNSS fix after %lu ms", millis() - sessionStart_);
+            EventLog::instance().record(EventId::GNSS_FIX, millis() - sessionStart_, info.satsInView);
+        }
+        SAT_LOG_TRACE("LOCATION: %.5lf, %.5lf, ALT:%.1f SATS:%d", info.latitude, info.longitude,
+                info.altitude, info.satsInView);
+        fix_ = info;
+        fixTime_ = millis();
+        if (mode_ == GnssMode::TRACKING) {
+            state_ = State::TRACKING;
+        } else {
+            endSession(0);
+        }
+    } else if (state_ == State::SEARCHING && millis() - sessionStart_ >= timeout_) {
+        endSession(SYSTEM_ERROR_TIMEOUT);
+    }
+}
+
+} // namespace particle
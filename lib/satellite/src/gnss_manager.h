@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+#include "at_response.h"
+
+#include <functional>
+
+namespace particle {
+
+struct GnssPositioningInfo {
+    uint16_t version;
+    uint16_t size;
+    double latitude;
+    double longitude;
+    float accuracy;
+    float altitude;
+    float cog;
+    float speedKmph;
+    float speedKnots;
+    struct tm utcTime;
+    int satsInView;
+    bool locked;
+    int posMode;
+    int valid;
+};
+
+enum class GnssMode {
+    ON_DEMAND, // A session is started by requestFix() and ended once a fix is obtained
+    PERIODIC, // A new fix is acquired when the cached one is older than the interval
+    TRACKING // The session is kept running and the fix is refreshed continuously
+};
+
+// Runs the GNSS receiver as a non-blocking session and caches the most recent fix
+class GnssManager {
+
+public:
+
+    // Returns false if the radio is not available for GNSS, the session is then deferred
+    typedef std::function<bool()> OnCanStart;
+
+    GnssManager();
+
+    int begin(void);
+    void process(void);
+
+    GnssManager& mode(GnssMode mode) {
+        mode_ = mode;
+        return *this;
+    }
+
+    GnssManager& interval(system_tick_t ms) {
+        interval_ = ms;
+        return *this;
+    }
+
+    GnssManager& onCanStart(OnCanStart fn) {
+        onCanStart_ = std::move(fn);
+        return *this;
+    }
+
+    // Maximum duration of a session without a fix
+    GnssManager& timeout(system_tick_t ms) {
+        timeout_ = ms;
+        return *this;
+    }
+
+    // Requests a session unless a fix newer than maxAge is already cached
+    int requestFix(system_tick_t maxAge = 0);
+    int stop(void);
+
+    // True while a session is running or requested
+    bool active(void) const {
+        return state_ != State::IDLE || requested_;
+    }
+
+    bool running(void) const {
+        return state_ != State::IDLE;
+    }
+
+    bool hasFix(void) const {
+        return fix_.valid;
+    }
+
+    // Returns false if there is no fix yet. age is the time since the fix was acquired
+    bool lastFix(GnssPositioningInfo* info, system_tick_t* age = nullptr) const;
+
+    // Milliseconds since the last fix, or UINT32_MAX if there is none
+    system_tick_t fixAge(void) const;
+
+    // Result of the last session: 0, SYSTEM_ERROR_TIMEOUT or SYSTEM_ERROR_AT_NOT_OK
+    int lastError(void) const {
+        return lastError_;
+    }
+
+    static int cbQGPSLOC(int type, const char* buf, int len, GnssPositioningInfo* info);
+
+private:
+
+    enum class State {
+        IDLE,
+        SEARCHING,
+        TRACKING
+    };
+
+    OnCanStart onCanStart_;
+    State state_;
+    GnssMode mode_;
+    system_tick_t interval_;
+    system_tick_t timeout_;
+    system_tick_t sessionStart_;
+    system_tick_t lastPoll_;
+    system_tick_t fixTime_;
+    GnssPositioningInfo fix_;
+    int lastError_;
+    bool requested_;
+    bool xtraInjected_;
+
+    int startSession(void);
+    void endSession(int error);
+    void injectXtraTime(void);
+
+    static int cbQGPSXTRA(int type, const char* buf, int len, int* enabled);
+};
+
+} // particle
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "link_quality.h"
+#include "at_response.h"
+
+#include <algorithm>
+#include <climits>
+
+#include "satellite_log.h"
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.link");
+
+namespace particle {
+
+namespace {
+
+// Marks a sample that wasn't filled in by the callback
+#define SATELLITE_LINK_RSRP_INVALID (INT_MIN)
+
+} // namespace annonymous
+
+LinkQualityMonitor::LinkQualityMonitor() :
+        samples_(),
+        next_(0),
+        count_(0),
+        rsrp_(0),
+        rsrq_(0),
+        sinr_(0),
+        cellId_(0),
+        rsrpDiag_(DIAG_ID_SATELLITE_RSRP, "sat:rsrp", &rsrp_),
+        rsrqDiag_(DIAG_ID_SATELLITE_RSRQ, "sat:rsrq", &rsrq_),
+        sinrDiag_(DIAG_ID_SATELLITE_SINR, "sat:sinr", &sinr_),
+        cellIdDiag_(DIAG_ID_SATELLITE_CELL_ID, "sat:cellId", &cellId_) {
+}
+
+int LinkQualityMonitor::cbQENG(int type, const char* buf, int len, LinkQualitySample* sample)
+{
+    // +QENG: "servingcell",<state>,"eMTC",<is_tdd>,<MCC>,<MNC>,<cellID>,<PCID>,<earfcn>,<freq_band_ind>,
+    //        <UL_bandwidth>,<DL_bandwidth>,<TAC>,<RSRP>,<RSRQ>,<RSSI>,<SINR>,<srxlev>
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && sample && resp.parse(buf, len, "+QENG") && resp.count() >= 17 &&
+            resp.equals(0, "servingcell")) {
+        int cellId = 0;
+        int sinr = 0;
+        if (resp.getInt(6, &cellId, 16) && resp.getInt(9, &sample->band) && resp.getInt(13, &sample->rsrp) &&
+                resp.getInt(14, &sample->rsrq) && resp.getInt(16, &sinr)) {
+            sample->cellId = cellId;
+            // Reported in 1/5 dB from 0 (-20 dB) to 250 (30 dB)
+            sample->sinr = sinr / 5 - 20;
+        } else {
+            sample->rsrp = SATELLITE_LINK_RSRP_INVALID;
+        }
+    }
+    return WAIT;
+}
+
+int LinkQualityMonitor::sample() {
+    LinkQualitySample sample = {};
+    sample.rsrp = SATELLITE_LINK_RSRP_INVALID;
+    if (RESP_OK != Cellular.command(cbQENG, &sample, 2000, "AT+QENG=\"servingcell\"\r\n")) {
+        return SYSTEM_ERROR_AT_NOT_OK;
+    }
+    if (sample.rsrp == SATELLITE_LINK_RSRP_INVALID) {
+        // SEARCH or LIMSRV state without measurements
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    sample.time = millis();
+    samples_[next_] = sample;
+    next_ = (next_ + 1) % MAX_SAMPLES;
+    if (count_ < MAX_SAMPLES) {
+        count_++;
+    }
+    rsrp_ = sample.rsrp;
+    rsrq_ = sample.rsrq;
+    sinr_ = sample.sinr;
+    cellId_ = sample.cellId;
+    SAT_LOG_TRACE("RSRP: %d dBm, RSRQ: %d dB, SINR: %d dB, band: %d, cell: %lx", sample.rsrp, sample.rsrq, sample.sinr,
+            sample.band, sample.cellId);
+    return 0;
+}
+
+void LinkQualityMonitor::clear() {
+    next_ = 0;
+    count_ = 0;
+}
+
+bool LinkQualityMonitor::latest(LinkQualitySample* sample) const {
+    if (!count_) {
+        return false;
+    }
+    *sample = samples_[(next_ + MAX_SAMPLES - 1) % MAX_SAMPLES];
+    return true;
+}
+
+system_tick_t LinkQualityMonitor::age() const {
+    LinkQualitySample sample = {};
+    if (!latest(&sample)) {
+        return UINT32_MAX;
+    }
+    return millis() - sample.time;
+}
+
+LinkQualityStats LinkQualityMonitor::rsrp() const {
+    return stats(&LinkQualitySample::rsrp);
+}
+
+LinkQualityStats LinkQualityMonitor::rsrq() const {
+    return stats(&LinkQualitySample::rsrq);
+}
+
+LinkQualityStats LinkQualityMonitor::sinr() const {
+    return stats(&LinkQualitySample::sinr);
+}
+
+LinkQualityStats LinkQualityMonitor::stats(int LinkQualitySample::*field) const {
+    LinkQualityStats stats = {};
+    if (!count_) {
+        return stats;
+    }
+    stats.min = INT_MAX;
+    stats.max = INT_MIN;
+    int sum = 0;
+    for (size_t i = 0; i < count_; i++) {
+        int value = samples_[i].*field;
+        stats.min = std::min(stats.min, value);
+        stats.max = std::max(stats.max, value);
+        sum += value;
+    }
+    stats.avg = sum / (int)count_;
+    return stats;
+}
+
+} // namespace particle
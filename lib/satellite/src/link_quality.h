@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+#include "diag_query/diag_query.h"
+
+namespace particle {
+
+// Serving cell measurements from AT+QENG="servingcell"
+struct LinkQualitySample {
+    int rsrp; // dBm
+    int rsrq; // dB
+    int sinr; // dB
+    int band;
+    uint32_t cellId;
+    system_tick_t time;
+};
+
+struct LinkQualityStats {
+    int min;
+    int avg;
+    int max;
+};
+
+// Keeps the most recent serving cell samples in a ring buffer so that transmissions can be gated on
+// the current link quality
+class LinkQualityMonitor {
+
+public:
+
+    static const size_t MAX_SAMPLES = 16;
+
+    LinkQualityMonitor();
+
+    // Queries the serving cell and adds a sample. Returns SYSTEM_ERROR_NOT_FOUND if the modem is not
+    // camped on a cell
+    int sample(void);
+
+    void clear(void);
+
+    size_t count(void) const {
+        return count_;
+    }
+
+    // Returns false if there are no samples
+    bool latest(LinkQualitySample* sample) const;
+
+    // Age of the latest sample, UINT32_MAX if there are none
+    system_tick_t age(void) const;
+
+    LinkQualityStats rsrp(void) const;
+    LinkQualityStats rsrq(void) const;
+    LinkQualityStats sinr(void) const;
+
+private:
+
+    LinkQualitySample samples_[MAX_SAMPLES];
+    size_t next_;
+    size_t count_;
+
+    // Latest values exposed as diagnostic sources
+    int32_t rsrp_;
+    int32_t rsrq_;
+    int32_t sinr_;
+    uint32_t cellId_;
+    IntDiagnosticSource rsrpDiag_;
+    IntDiagnosticSource rsrqDiag_;
+    IntDiagnosticSource sinrDiag_;
+    UintDiagnosticSource cellIdDiag_;
+
+    static int cbQENG(int type, const char* buf, int len, LinkQualitySample* sample);
+
+    LinkQualityStats stats(int LinkQualitySample::*field) const;
+};
+
+} // particle
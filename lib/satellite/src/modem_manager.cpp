@@ -16,10 +16,13 @@
  */
 
 #include "modem_manager.h"
+#include "storage/record_storage.h"
 
 #include "logging.h"
 LOG_SOURCE_CATEGORY("ncp.esim");
 
+#include "esim/ber_tlv.h"
+
 #include "check.h"
 #include "scope_guard.h"
 #include "stream_util.h"
@@ -77,20 +80,42 @@ namespace {
 #define ICCID_TWILIO_PREFIX     "8988"
 #define ICCID_SKYLO_PREFIX      "8990"
 #define ICCID_PREFIX_LEN        (4)
-#define ICCID_RESULTS_MAX       (8)
-#define ICCID_MARKER            "5A0A"
-#define ICCID_MARKER_LEN        (4)
+#define ICCID_RESULTS_MAX       ESIM_PROFILES_MAX
 #define ICCID_DISABLE           (0)
 #define ICCID_ENABLE            (1)
 
-const int PROFILES_SIZE_MAX = 4096;
-char profiles[PROFILES_SIZE_MAX] = {0};
-const int CSIM_RESPONSE_SIZE_MAX = 4096;
-char csimResponse[CSIM_RESPONSE_SIZE_MAX] = {0};
+#define ESIM_PROFILE_CACHE_FILE SATELLITE_STORAGE_DIR "/esim_profiles"
+#define ESIM_PROFILE_CACHE_MAGIC (0x53455031) // "SEP1"
+
+// The cellular probe gives up rather than hold the radio for the full 3GPP scan time, a scan that
+// doesn't complete is retried later
+#define PROBE_CFUN_TIMEOUT_MS   (15000)
+#define PROBE_SCAN_TIMEOUT_MS   (60000)
+
+// ISD-R, the eUICC application that manages the profiles, and its SGP.22 commands sent with
+// STORE DATA (CLA 0x80)
+#define ISDR_AID                "A0000005591010FFFFFFFF8900000100"
+#define ISDR_CLA                (0x80)
+#define ISDR_GET_EID            "E2910006BF3E035C015A"
+#define ISDR_GET_PROFILES       "E2910009BF2D065C045A9F7092"
+
+// BER-TLV tags
+#define TAG_EUICC_DATA          (0xBF3E)
+#define TAG_PROFILE_INFO_LIST   (0xBF2D)
+#define TAG_PROFILE_INFO_OK     (0xA0)
+#define TAG_PROFILE_INFO        (0xE3)
+#define TAG_ICCID               (0x5A)
+#define TAG_EID                 (0x5A)
+#define TAG_PROFILE_STATE       (0x9F70)
 
 } // namespace annonymous
 
-ModemManager::ModemManager() : begun_(false)
+ModemManager::ModemManager() :
+        begun_(false),
+        cachedRadioType_(RADIO_UNKNOWN),
+        profileCache_(),
+        op_(),
+        opState_(OperationState::IDLE)
 {
 
 }
@@ -103,45 +128,43 @@ ModemManager::~ModemManager() {
 
 int ModemManager::cbCFUN(int type, const char* buf, int len, int* cfun)
 {
-    if ((type == TYPE_PLUS) && cfun) {
-        if (sscanf(buf, "\r\n+CFUN: %d", cfun) == 1)
-            /*nothing*/;
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && cfun && resp.parse(buf, len, "+CFUN")) {
+        resp.getInt(0, cfun);
     }
     return WAIT;
 }
 
 int ModemManager::cbIOTOPMODE(int type, const char* buf, int len, int* mode)
 {
-    if ((type == TYPE_PLUS) && mode) {
-        if (sscanf(buf, "\r\n+QCFG=\"iotopmode\",%d", mode) == 1)
-            /*nothing*/;
+    // +QCFG: "iotopmode",3
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && mode && resp.parse(buf, len, "+QCFG") && resp.equals(0, "iotopmode")) {
+        resp.getInt(1, mode);
     }
     return WAIT;
 }
 
-int ModemManager::cbCSIMint(int type, const char* buf, int len, int* csimInt)
+int ModemManager::cbICCID(int type, const char* buf, int len, AtBuffer* iccid)
 {
-    if ((type == TYPE_PLUS) && csimInt) {
-        if (sscanf(buf, "\r\n+CSIM: 4,\"61%2x", csimInt) == 1)
-            /*nothing*/;
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && iccid && resp.parse(buf, len, "+QCCID")) {
+        resp.getString(0, *iccid);
     }
     return WAIT;
 }
 
-int ModemManager::cbCSIMstring(int type, const char* buf, int len, char* csimString)
+int ModemManager::cbCOPS(int type, const char* buf, int len, int* networks)
 {
-    if ((type == TYPE_PLUS) && csimString) {
-        if (sscanf(buf, "\r\n+CSIM: %*d,\"%[^\"]\r\n", csimString) == 1)
-            /*nothing*/;
-    }
-    return WAIT;
-}
-
-int ModemManager::cbICCID(int type, const char* buf, int len, char* iccid)
-{
-    if ((type == TYPE_PLUS) && iccid) {
-        if (sscanf(buf, "\r\n+QCCID: %[^\r]\r\n", iccid) == 1)
-            /*nothing*/;
+    // +COPS: (2,"AT&T","AT&T","310410",8),(1,"T-Mobile","T-Mobile","310260",8),,(0,1,2,3,4),(0,1,2)
+    if (type == TYPE_PLUS && networks) {
+        const char* end = buf + len;
+        for (const char* p = buf; p < end; p++) {
+            // Operator entries are the only ones with a quoted name after the status
+            if (*p == '(' && p + 3 < end && p[1] >= '0' && p[1] <= '3' && p[2] == ',' && p[3] == '"') {
+                (*networks)++;
+            }
+        }
     }
     return WAIT;
 }
@@ -154,15 +177,6 @@ void ModemManager::swapNibbles(const char* input, char* output) {
     output[ICCID_LEN] = 0;
 }
 
-int ModemManager::isValidHexString(const char *str, int length) {
-    for (int i = 0; i < length; i++) {
-        if (!isxdigit(str[i])) {
-            return -1;
-        }
-    }
-    return 0;
-}
-
 void ModemManager::stripTrailingF(char* iccid) {
     // Strip trailing F on 19 digit ICCID's
     if (strlen(iccid) == ICCID_LEN && (iccid[strlen(iccid) - 1] == 'f' || iccid[strlen(iccid) - 1] == 'F')) {
@@ -170,38 +184,11 @@ void ModemManager::stripTrailingF(char* iccid) {
     }
 }
 
-int ModemManager::findIccids(const char *input, char results[][ICCID_LEN + 1], bool includeTestProfile) {
-    int count = 0;
-    const char *pos = input;
-
-    while ((pos = strstr(pos, ICCID_MARKER)) != NULL) {
-        pos += ICCID_MARKER_LEN;
-
-        if (strlen(pos) >= ICCID_LEN && isValidHexString(pos, ICCID_LEN) == 0) {
-            swapNibbles(pos, results[count]); // swap into results
-            stripTrailingF(results[count]);
-            if (!includeTestProfile && strncmp(results[count], ICCID_KIGEN_TEST, ICCID_LEN) == 0) {
-                results[count][0] = 0; // remove
-            } else {
-                results[count][ICCID_LEN] = 0;
-                count++;
-            }
-
-            if (count >= ICCID_RESULTS_MAX) {
-                break;
-            }
-        }
-
-        pos += ICCID_LEN;
-    }
-
-    return count;
-}
-
 int ModemManager::getICCID(char* i, bool log) {
     char iccid[30] = {0};
 
-    int ret = Cellular.command(cbICCID, iccid, 10000, "AT+QCCID\r\n");
+    AtBuffer iccidBuf = { iccid, sizeof(iccid) };
+    int ret = Cellular.command(cbICCID, &iccidBuf, 10000, "AT+QCCID\r\n");
     if ((ret == RESP_OK) && (strcmp(iccid, "") != 0)) {
         // Log.info("SIM ICCID = %s", iccid);
     } else {
@@ -237,285 +224,364 @@ int ModemManager::getICCID(char* i, bool log) {
     return 0;
 }
 
-void ModemManager::enableDisableICCID(int type, char* specifiedIccid, int radioType) {
-    if (strlen(specifiedIccid) < (ICCID_LEN-1)) {
-        return;
-    }
-
-    // Add F to the end of 19 digit ICCIDs for CSIM commands
-    if (strlen(specifiedIccid) == (ICCID_LEN-1)) {
-        specifiedIccid[ICCID_LEN-1] = 'F';
-        specifiedIccid[ICCID_LEN] = 0;
-    }
-
-    char iccidNibbleSwapped[ICCID_LEN + 1] = {0};
-    swapNibbles(specifiedIccid, iccidNibbleSwapped);
-    if (RESP_OK != Cellular.command(10000, "AT+CSIM=10,\"0070000000\"\r\n")) {
-        delay(1000);
-        Cellular.command(10000, "AT+CSIM=10,\"0070000000\"");
-    }
-    if (RESP_OK != Cellular.command(10000, "AT+CSIM=42,\"01A4040410A0000005591010FFFFFFFF8900000100\"\r\n")) {
-        delay(1000);
-        Cellular.command(10000, "AT+CSIM=42,\"01A4040410A0000005591010FFFFFFFF8900000100\"\r\n");
-    }
-    // Insert the desired nibble swapped profile here
-    // AT+CSIM=50,"81E2910014BF3211A00F5A0Axxxxxxxxxxxxxxxxxxxx810101"
-    char requestData[70] = {0};
-    if (type == 0) {
-        // Disable
-        sprintf(requestData, "AT+CSIM=50,\"81E2910014BF3211A00F5A0A%s810101\"\r\n", iccidNibbleSwapped);
-    } else {
-        // Enable
-        sprintf(requestData, "AT+CSIM=50,\"81E2910014BF3111A00F5A0A%s810101\"\r\n", iccidNibbleSwapped);
-    }
-    if (RESP_OK != Cellular.command(10000, requestData)) {
-        delay(1000);
-        Cellular.command(10000, requestData);
+int ModemManager::parseProfiles(const uint8_t* data, size_t size, char iccids[][ICCID_LEN + 1], int* enabled) {
+    // ProfileInfoListResponse: BF2D { A0 { E3 { 5A <ICCID>, 9F70 <state>, 92 <name> } ... } }
+    Tlv list = {};
+    Tlv infos = {};
+    if (!TlvReader(data, size).find(TAG_PROFILE_INFO_LIST, &list) ||
+            !TlvReader(list).find(TAG_PROFILE_INFO_OK, &infos)) {
+        return SYSTEM_ERROR_BAD_DATA;
     }
-    delay(1000); // wait a bit before closing the channel
-    if (RESP_OK != Cellular.command(10000, "AT+CSIM=10,\"81C0000006\"\r\n")) {
-        delay(1000);
-        Cellular.command(10000, "AT+CSIM=10,\"81C0000006\"\r\n");
+    int count = 0;
+    if (enabled) {
+        *enabled = -1;
+    }
+    TlvReader reader(infos);
+    Tlv info = {};
+    while (count < ICCID_RESULTS_MAX && reader.find(TAG_PROFILE_INFO, &info)) {
+        Tlv iccid = {};
+        if (!TlvReader(info).find(TAG_ICCID, &iccid) || iccid.size != ICCID_LEN / 2) {
+            continue;
+        }
+        // ICCIDs are BCD encoded with swapped nibbles
+        char hex[ICCID_LEN + 1] = {};
+        toHex(iccid.value, iccid.size, hex, sizeof(hex));
+        swapNibbles(hex, iccids[count]);
+        stripTrailingF(iccids[count]);
+        Tlv state = {};
+        if (enabled && TlvReader(info).find(TAG_PROFILE_STATE, &state) && state.size == 1 && state.value[0] == 1) {
+            *enabled = count;
+        }
+        count++;
     }
-    if (RESP_OK != Cellular.command(10000, "AT+CSIM=10,\"0070800100\"\r\n")) {
-        delay(1000);
-        Cellular.command(10000, "AT+CSIM=10,\"0070800100\"\r\n");
+    if (reader.error()) {
+        return reader.error();
     }
+    return count;
+}
 
-    // Toggle CFUN to refresh SIM data
-    Log.info("Toggling modem power to refresh SIM info...");
-    Cellular.command(180000, "AT+CFUN=0\r\n");
-    waitAtResponse(10);
-    // If RADIO_UNKNOWN specified, nothing will be set.
-    if (radioType != RADIO_UNKNOWN) {
-        Cellular.command(2000, "AT+QCFG=\"iotopmode\",%d,1\r\n", radioType == RADIO_CELLULAR ? 0 : 3);
+const char* ModemManager::cachedIccidByType(int radioType) const {
+    for (int i = 0; i < profileCache_.count; i++) {
+        const char* iccid = profileCache_.iccids[i];
+        if ((radioType == RADIO_CELLULAR && strncmp(iccid, ICCID_TWILIO_PREFIX, ICCID_PREFIX_LEN) == 0) ||
+                (radioType == RADIO_SATELLITE && strncmp(iccid, ICCID_SKYLO_PREFIX, ICCID_PREFIX_LEN) == 0)) {
+            return iccid;
+        }
     }
-    Cellular.command(180000, "AT+CFUN=1\r\n");
-    waitAtResponse(10);
+    return nullptr;
 }
 
-int ModemManager::enableDisableProfile(int type, char* specifiedIccid, int radioType) {
-    char iccid[30] = {0};
-
-    stripTrailingF(specifiedIccid);
-
-    if (strcmp(specifiedIccid, ICCID_KIGEN_DEFAULT) == 0) {
-        Log.error("This is the Kigen Default ICCID. Invalid argument.");
-        return ENABLE_DISABLE_ICCID_IS_DEFAULT;
+bool ModemManager::cachedIccidExists(const char* iccid) const {
+    for (int i = 0; i < profileCache_.count; i++) {
+        if (strcmp(profileCache_.iccids[i], iccid) == 0) {
+            return true;
+        }
     }
+    return false;
+}
 
+void ModemManager::ensureModemOn() {
     int cfunVal = -1;
     Cellular.command(cbCFUN, &cfunVal, 10000, "AT+CFUN?\r\n");
     if (cfunVal != 1) {
-        Cellular.command(10000, "AT+CFUN=1");
-        delay(5000);
+        Cellular.command(10000, "AT+CFUN=1\r\n");
+        waitAtResponse(10);
     }
+}
 
-    int iotopmodeVal = -1;
-    Cellular.command(cbIOTOPMODE, &iotopmodeVal, 10000, "AT+QCFG=\"iotopmode\"\r\n");
-    if ((radioType == RADIO_CELLULAR && iotopmodeVal == 0) ||
-            (radioType == RADIO_SATELLITE && iotopmodeVal == 3)) {
-        // If already set correctly, prevent IOTOPMODE from being set later on
-        radioType = RADIO_UNKNOWN;
+int ModemManager::startOperation(ProfileOperation op) {
+    if (busy()) {
+        return SYSTEM_ERROR_BUSY;
     }
+    op_ = std::move(op);
+    op_.result = ENABLE_DISABLE_SUCCESS;
+    op_.iotopmode = -1;
 
-    // QUERY ALL PROFILES
-    Cellular.command(10000, "AT+CSIM=42,\"01A4040410A0000005591010FFFFFFFF8900000100\"\r\n");  // returns +CSIM: 4,"6121"
-    int profileSize = 0;
-    Cellular.command(cbCSIMint, &profileSize, 10000, "AT+CSIM=28,\"81E2910009BF2D065C045A9F7092\"\r\n"); // returns +CSIM: 4,"614E"
-    int iccidsFound = 0;
-    char iccidList[ICCID_RESULTS_MAX][ICCID_LEN + 1];
-    if (profileSize > 0) {
-        char requestData[32] = {0};
-        memset(&csimResponse, 0, sizeof(csimResponse));
-        sprintf(requestData, "AT+CSIM=10,\"81C00000%02X\"", profileSize);
-        Cellular.command(cbCSIMstring, csimResponse, requestData); // returns +CSIM: 160,"BF2D4BA049E32D5A0A980010325476981032149F700100921B47534D412054532E343820584F5220546573742050726F66696C65E3185A0A988803070000156406669F70010192065477696C696F9000"
-
-        if (strlen(csimResponse) > 0) {
-            // Test with 3 profiles (TEST, SKYLO, TWILIO) !!!! DO NOT TRY TO SET THIS DATA !!!!
-            // iccidsFound = findIccids("+CSIM: 238,\"BF2D72A070E32D5A0A980010325476981032149F700100921B47534D412054532E343820584F5220546573742050726F66696C65E3255A0A980991080120002004309F7001009213536B796C6F202D204F7065726174696F6E616CE3185A0A988803070000155488619F70010192065477696C696F9000\"", iccidList, false /*includeTestProfile*/);
-            iccidsFound = findIccids(csimResponse, iccidList, true /*includeTestProfile*/);
-            if (iccidsFound == 0) {
-                Log.error("No ICCID's found");
-                return ENABLE_DISABLE_ICCID_DOES_NOT_EXIST;
-            }
-            // for (int i = 0; i < iccidsFound; i++) {
-            //     Log.info("ICCID%d: %s\n", i+1, iccidList[i]);
-            // }
-            int iccidMatched = 0;
-            for (int i = 0; i < iccidsFound; i++) {
-                // Log.info("ICCID%d: %s\n", i+1, iccidList[i]);
-                if (strcmp(iccidList[i], specifiedIccid) == 0) {
-                    iccidMatched = 1;
-                    break;
-                }
-            }
-            if (!iccidMatched) {
-                Log.error("Invalid ICCID!");
-                return ENABLE_DISABLE_ICCID_DOES_NOT_EXIST;
+    char iccid[30] = {0};
+    getICCID(iccid, /* log results */ false);
+    snprintf(op_.active, sizeof(op_.active), "%s", iccid);
+    if (op_.byRadio && cachedRadioType_ == op_.radio) {
+        // The profile is already active, only the operating mode may need to change
+        startRefresh();
+        return 0;
+    }
+
+    ensureModemOn();
+    opState_ = OperationState::SESSION;
+    apdu_.openChannel(ISDR_AID, [this](int error) {
+        if (error < 0) {
+            Log.error("Failed to open ISD-R channel: %d", error);
+            op_.result = error;
+            startRefresh();
+            return;
+        }
+        requestEid();
+    });
+    return 0;
+}
+
+void ModemManager::requestEid() {
+    apdu_.transmit(ISDR_CLA, ISDR_GET_EID, [this](int error, const uint8_t* data, size_t size) {
+        // EUICCInfo: BF3E { 5A <EID> }
+        char eid[EID_LEN + 1] = {};
+        Tlv euiccData = {};
+        Tlv eidTlv = {};
+        if (error == 0 && TlvReader(data, size).find(TAG_EUICC_DATA, &euiccData) &&
+                TlvReader(euiccData).find(TAG_EID, &eidTlv) && eidTlv.size == EID_LEN / 2) {
+            toHex(eidTlv.value, eidTlv.size, eid, sizeof(eid));
+        } else {
+            Log.warn("Could not read EID");
+        }
+        if (eid[0] && strcmp(eid, profileCache_.eid) == 0 && profileCache_.count > 0) {
+            resolveProfile();
+        } else {
+            memcpy(profileCache_.eid, eid, sizeof(profileCache_.eid));
+            requestProfiles();
+        }
+    });
+}
+
+void ModemManager::requestProfiles() {
+    op_.refreshed = true;
+    apdu_.transmit(ISDR_CLA, ISDR_GET_PROFILES, [this](int error, const uint8_t* data, size_t size) {
+        int count = (error < 0) ? error : parseProfiles(data, size, profileCache_.iccids, nullptr);
+        if (count < 0) {
+            Log.error("Failed to read profiles: %d", count);
+            profileCache_.count = 0;
+            closeSession(count);
+            return;
+        }
+        profileCache_.count = count;
+        Log.info("Found %d profiles on eUICC %s", count, profileCache_.eid);
+        if (profileCache_.eid[0]) {
+            saveRecord(ESIM_PROFILE_CACHE_FILE, ESIM_PROFILE_CACHE_MAGIC, &profileCache_, sizeof(profileCache_));
+        }
+        resolveProfile();
+    });
+}
+
+void ModemManager::resolveProfile() {
+    if (op_.byRadio) {
+        auto iccid = cachedIccidByType(op_.radio);
+        if (!iccid) {
+            if (!op_.refreshed) {
+                // Profiles may have been changed by another tool, the cache is stale
+                requestProfiles();
+                return;
             }
+            Log.error("Could not find requested radio_type!");
+            closeSession(-1);
+            return;
+        }
+        snprintf(op_.target, sizeof(op_.target), "%s", iccid);
+    } else if (!cachedIccidExists(op_.target)) {
+        if (!op_.refreshed) {
+            requestProfiles();
+            return;
         }
+        Log.error("Invalid ICCID!");
+        closeSession(ENABLE_DISABLE_ICCID_DOES_NOT_EXIST);
+        return;
     }
 
-    getICCID(iccid, /* log results */ false);
-
-    int ret = ENABLE_DISABLE_SUCCESS;
-    Log.info("ICCID currently active: %s", iccid);
-    if (type == ICCID_DISABLE && strncmp(iccid, specifiedIccid, 20) != 0) {
+    Log.info("ICCID currently active: %s", op_.active);
+    bool active = strcmp(op_.active, op_.target) == 0;
+    if (op_.type == ICCID_DISABLE && !active) {
         Log.info("Profile not active!");
-        ret = ENABLE_DISABLE_ICCID_NOT_ACTIVE;
-    } else if (type == ICCID_ENABLE) {
-        if (strncmp(iccid, specifiedIccid, 20) == 0) {
-            Log.info("Profile already active!");
-            ret = ENABLE_DISABLE_ICCID_IS_ACTIVE;
-        } else if (strncmp(iccid, ICCID_KIGEN_DEFAULT, 20) != 0) {
-            // disable currently active ICCID that is not the Kigen Default
-            Log.info("Disabling currently active: %s", iccid);
-            enableDisableICCID(ICCID_DISABLE, iccid, RADIO_UNKNOWN);
-        }
+        closeSession(ENABLE_DISABLE_ICCID_NOT_ACTIVE);
+    } else if (op_.type == ICCID_ENABLE && active) {
+        Log.info("Profile already active!");
+        closeSession(op_.byRadio ? ENABLE_DISABLE_SUCCESS : ENABLE_DISABLE_ICCID_IS_ACTIVE);
+    } else {
+        applyProfile();
     }
+}
 
-    if (ret != ENABLE_DISABLE_SUCCESS) {
-        // we have an error, but need to set iotopmode before exiting
-        if (radioType != RADIO_UNKNOWN) {
-            Cellular.command(180000, "AT+CFUN=0\r\n");
-            waitAtResponse(10);
-            Cellular.command(2000, "AT+QCFG=\"iotopmode\",%d,1\r\n", radioType == RADIO_CELLULAR ? 0 : 3);
-            Cellular.command(180000, "AT+CFUN=1\r\n");
-            waitAtResponse(10);
+void ModemManager::applyProfile() {
+    auto profileCommand = [this](int type, const char* iccid, ApduEngine::OnResponse onResponse) {
+        // 19 digit ICCIDs are padded with F
+        char padded[ICCID_LEN + 1] = {};
+        snprintf(padded, sizeof(padded), "%sFFFF", iccid);
+        char swapped[ICCID_LEN + 1] = {};
+        swapNibbles(padded, swapped);
+        // EnableProfile (BF31) or DisableProfile (BF32) with refreshFlag set
+        char body[64] = {};
+        snprintf(body, sizeof(body), "E2910014BF%s11A00F5A0A%s810101", (type == ICCID_ENABLE) ? "31" : "32", swapped);
+        apdu_.transmit(ISDR_CLA, body, std::move(onResponse));
+    };
+
+    if (op_.type == ICCID_ENABLE && strlen(op_.active) > 0 && strcmp(op_.active, ICCID_KIGEN_DEFAULT) != 0) {
+        Log.info("Disabling currently active: %s", op_.active);
+        profileCommand(ICCID_DISABLE, op_.active, nullptr);
+    }
+    Log.info("%sabling profile %s", op_.type ? "En" : "Dis", op_.target);
+    profileCommand(op_.type, op_.target, [this](int error, const uint8_t* data, size_t size) {
+        if (error < 0) {
+            Log.error("Failed to %sable profile: %d", op_.type ? "en" : "dis", error);
+            closeSession(op_.byRadio ? -1 : error);
+            return;
         }
+        op_.profileChanged = true;
+        closeSession(ENABLE_DISABLE_SUCCESS);
+    });
+}
 
-        return ret;
+void ModemManager::closeSession(int result) {
+    op_.result = result;
+    apdu_.closeChannel([this](int error) {
+        startRefresh();
+    });
+}
+
+void ModemManager::startRefresh() {
+    // A single CFUN cycle applies both the profile change and the operating mode
+    if (op_.radio != RADIO_UNKNOWN) {
+        int iotopmode = -1;
+        Cellular.command(cbIOTOPMODE, &iotopmode, 10000, "AT+QCFG=\"iotopmode\"\r\n");
+        int desired = (op_.radio == RADIO_CELLULAR) ? 0 : 3;
+        op_.iotopmode = (iotopmode != desired) ? desired : -1;
     }
+    opState_ = (op_.profileChanged || op_.iotopmode >= 0) ? OperationState::CFUN_OFF : OperationState::DONE;
+}
 
-    Log.info("%sabling profile %s\n", type ? "En" : "Dis", specifiedIccid);
-    enableDisableICCID(type, specifiedIccid, radioType);
+void ModemManager::finishOperation() {
+    if (op_.profileChanged) {
+        char iccid[30] = {0};
+        getICCID(iccid, /* log results */ true);
+        if (op_.byRadio && cachedRadioType_ != op_.radio) {
+            Log.error("Profile switch failed, invalidating the profile cache");
+            profileCache_ = {};
+            removeRecord(ESIM_PROFILE_CACHE_FILE);
+            op_.result = -1;
+        }
+    } else if (op_.byRadio && op_.result == ENABLE_DISABLE_SUCCESS && cachedRadioType_ != op_.radio) {
+        op_.result = -1;
+    }
+    opState_ = OperationState::IDLE;
+    auto onComplete = std::move(op_.onComplete);
+    op_.onComplete = nullptr;
+    if (onComplete) {
+        onComplete(op_.result);
+    }
+}
 
-    getICCID(iccid, /* log results */ true);
+void ModemManager::process() {
+    apdu_.process();
+    switch (opState_) {
+    case OperationState::CFUN_OFF: {
+        Log.info("Toggling modem power to refresh SIM info...");
+        Cellular.command(180000, "AT+CFUN=0\r\n");
+        waitAtResponse(10);
+        if (op_.iotopmode >= 0) {
+            Cellular.command(2000, "AT+QCFG=\"iotopmode\",%d,1\r\n", op_.iotopmode);
+        }
+        opState_ = OperationState::CFUN_ON;
+        break;
+    }
+    case OperationState::CFUN_ON: {
+        Cellular.command(180000, "AT+CFUN=1\r\n");
+        waitAtResponse(10);
+        opState_ = OperationState::DONE;
+        break;
+    }
+    case OperationState::DONE: {
+        finishOperation();
+        break;
+    }
+    default:
+        break;
+    }
+}
 
-    return ENABLE_DISABLE_SUCCESS;
+int ModemManager::runOperation() {
+    while (busy()) {
+        process();
+        delay(10);
+    }
+    return op_.result;
 }
 
 int ModemManager::esimProfiles(char* specifiedIccid, char* profilesBuffer, int profilesBufferLen) {
-    char iccid[30] = {0};
     int matched = 0;
     int silent = 0;
     if (specifiedIccid && strlen(specifiedIccid) > 0) {
         silent = 1;
         stripTrailingF(specifiedIccid);
     }
-
-    int cfunVal = -1;
-    Cellular.command(cbCFUN, &cfunVal, 10000, "AT+CFUN?\r\n");
-    if (cfunVal != 1) {
-        Cellular.command(10000, "AT+CFUN=1");
-        delay(5000);
+    if (busy()) {
+        return SYSTEM_ERROR_BUSY;
     }
 
-    // Query SIM card Currently Active ICCID
-    getICCID(iccid, /* log results */ false);
+    ensureModemOn();
 
-    // QUERY ALL PROFILES
-    Cellular.command(10000, "AT+CSIM=42,\"01A4040410A0000005591010FFFFFFFF8900000100\"\r\n");  // returns +CSIM: 4,"6121"
-    int profileSize = 0;
-    Cellular.command(cbCSIMint, &profileSize, 10000, "AT+CSIM=28,\"81E2910009BF2D065C045A9F7092\"\r\n"); // returns +CSIM: 4,"614E"
+    char iccidList[ICCID_RESULTS_MAX][ICCID_LEN + 1] = {};
     int iccidsFound = 0;
-    char iccidList[ICCID_RESULTS_MAX][ICCID_LEN + 1];
-    if (profileSize > 0) {
-        char requestData[32] = {0};
-        memset(&csimResponse, 0, sizeof(csimResponse));
-        sprintf(requestData, "AT+CSIM=10,\"81C00000%02X\"", profileSize);
-        Cellular.command(cbCSIMstring, csimResponse, requestData); // returns +CSIM: 160,"BF2D4BA049E32D5A0A980010325476981032149F700100921B47534D412054532E343820584F5220546573742050726F66696C65E3185A0A988803070000156406669F70010192065477696C696F9000"
-        LOG_PRINTF_C(TRACE, "app", "%010lu [%s] D[%d]: ", millis(), "app", strlen(csimResponse));
-        LOG_WRITE_C(TRACE, "app", csimResponse, strlen(csimResponse));
-        LOG_PRINTF(TRACE, "\r\n");
-
-        if (strlen(csimResponse) > 0) {
-            // Test with 3 profiles (TEST, SKYLO, TWILIO) !!!! DO NOT TRY TO SET THIS DATA !!!!
-            // iccidsFound = findIccids("+CSIM: 238,\"BF2D72A070E32D5A0A980010325476981032149F700100921B47534D412054532E343820584F5220546573742050726F66696C65E3255A0A980991080120002004309F7001009213536B796C6F202D204F7065726174696F6E616CE3185A0A988803070000155488619F70010192065477696C696F9000\"", iccidList, true /*includeTestProfile*/);
-            iccidsFound = findIccids(csimResponse, iccidList, true /*includeTestProfile*/);
-            // Log.info("iccidsFound: %d", iccidsFound);
-            char temp_profiles[512] = {0};
-            // if (!silent) {
-            //     Log.info("\n");
-            // }
-            for (int i = 0; i < iccidsFound; i++) {
-                char temp[40] = {0};
-                sprintf(temp, "[%s, %s]", iccidList[i], strcmp(iccid, iccidList[i])==0 ? "enabled" : "disabled");
-                if (!silent) {
-                    // printf("%s", temp);
-                    strcat(temp_profiles, temp);
-                }
-                // if (strcmp(iccidList[i], ICCID_KIGEN_TEST) == 0) {
-                //     printf(" (Kigen Test Profile)");
-                // }
-                if (i+1 != iccidsFound) {
-                    if (!silent) {
-                        // printf("\n");
-                        strcat(temp_profiles, "\n");
-                    }
-                }
-                if (silent) {
-                    if (strcmp(specifiedIccid, iccidList[i]) == 0) {
-                        matched = 1; // found
-                        if (strcmp(iccid, iccidList[i])==0) {
-                            matched = 2; // enabled
-                        }
-                    }
-                }
-            }
-            if (!silent) {
-                Log.info("\n%s", temp_profiles);
-                if (profilesBuffer && ((int)strlen(temp_profiles) < profilesBufferLen)) {
-                    strncpy(profilesBuffer, temp_profiles, profilesBufferLen);
-                }
-            }
-        } else {
-            Log.info("[]");
+    int enabled = -1;
+    apdu_.openChannel(ISDR_AID);
+    apdu_.transmit(ISDR_CLA, ISDR_GET_PROFILES, [&](int error, const uint8_t* data, size_t size) {
+        if (error == 0) {
+            iccidsFound = parseProfiles(data, size, iccidList, &enabled);
         }
-    } else {
+    });
+    apdu_.closeChannel();
+    while (apdu_.busy()) {
+        apdu_.process();
+        delay(10);
+    }
+
+    if (iccidsFound <= 0) {
         Log.info("[]");
+        return 0;
+    }
+    char temp_profiles[512] = {0};
+    for (int i = 0; i < iccidsFound; i++) {
+        char temp[40] = {0};
+        sprintf(temp, "[%s, %s]", iccidList[i], (i == enabled) ? "enabled" : "disabled");
+        if (!silent) {
+            strcat(temp_profiles, temp);
+            if (i + 1 != iccidsFound) {
+                strcat(temp_profiles, "\n");
+            }
+        } else if (strcmp(specifiedIccid, iccidList[i]) == 0) {
+            matched = (i == enabled) ? 2 /* enabled */ : 1 /* found */;
+        }
+    }
+    if (!silent) {
+        Log.info("\n%s", temp_profiles);
+        if (profilesBuffer && ((int)strlen(temp_profiles) < profilesBufferLen)) {
+            strncpy(profilesBuffer, temp_profiles, profilesBufferLen);
+        }
     }
 
     return matched;
 }
 
 int ModemManager::esimEnable(char* specifiedIccid) {
-    return enableDisableProfile(ICCID_ENABLE, specifiedIccid, RADIO_UNKNOWN);
+    stripTrailingF(specifiedIccid);
+    if (strcmp(specifiedIccid, ICCID_KIGEN_DEFAULT) == 0) {
+        Log.error("This is the Kigen Default ICCID. Invalid argument.");
+        return ENABLE_DISABLE_ICCID_IS_DEFAULT;
+    }
+    ProfileOperation op = {};
+    op.type = ICCID_ENABLE;
+    op.radio = RADIO_UNKNOWN;
+    snprintf(op.target, sizeof(op.target), "%s", specifiedIccid);
+    CHECK(startOperation(std::move(op)));
+    return runOperation();
 }
 
 int ModemManager::esimDisable(char* specifiedIccid) {
-    return enableDisableProfile(ICCID_DISABLE, specifiedIccid, RADIO_UNKNOWN);
-}
-
-int ModemManager::findIccidByType(const char* inputBuffer, int inputBufferLen, char* matchedIccid, int radioType) {
-    const char* p = inputBuffer;
-
-    while ((p = strchr(p, '[')) != NULL) {
-        p++;
-        const char* end = strchr(p, ',');
-        if (!end || (end - p) < ICCID_PREFIX_LEN) {
-            p++;
-            continue;
-        }
-
-        if ((radioType == RADIO_CELLULAR && strncmp(p, ICCID_TWILIO_PREFIX, ICCID_PREFIX_LEN) == 0) ||
-                (radioType == RADIO_SATELLITE && strncmp(p, ICCID_SKYLO_PREFIX, ICCID_PREFIX_LEN) == 0))
-        {
-            int len = end - p;
-            if (len >= inputBufferLen) {
-                len = inputBufferLen - 1;
-            }
-            strncpy(matchedIccid, p, len);
-            matchedIccid[len] = 0;
-
-            return 0;
-        }
-
-        p = end;
+    stripTrailingF(specifiedIccid);
+    if (strcmp(specifiedIccid, ICCID_KIGEN_DEFAULT) == 0) {
+        Log.error("This is the Kigen Default ICCID. Invalid argument.");
+        return ENABLE_DISABLE_ICCID_IS_DEFAULT;
     }
-
-    return -1;
+    ProfileOperation op = {};
+    op.type = ICCID_DISABLE;
+    op.radio = RADIO_UNKNOWN;
+    snprintf(op.target, sizeof(op.target), "%s", specifiedIccid);
+    CHECK(startOperation(std::move(op)));
+    return runOperation();
 }
 
 void ModemManager::updateCachedRadioType(char* iccid) {
@@ -544,21 +610,53 @@ radio_type_t ModemManager::radioEnabled() {
     return cachedRadioType_;
 }
 
-int ModemManager::radioEnable(radio_type_t radioType) {
-    // Find the ICCID by radio type
-    esimProfiles(NULL, profiles, PROFILES_SIZE_MAX);
-
-    char specifiedIccid[ICCID_LEN + 1] = {0};
-    if (findIccidByType(profiles, strlen(profiles), specifiedIccid, radioType) != 0) {
-        Log.error("Could not find requested radio_type!");
-        return -1;
-    }
+int ModemManager::radioEnable(radio_type_t radioType, OnComplete onComplete) {
+    ProfileOperation op = {};
+    op.type = ICCID_ENABLE;
+    op.radio = radioType;
+    op.byRadio = true;
+    op.onComplete = std::move(onComplete);
+    return startOperation(std::move(op));
+}
 
-    if (enableDisableProfile(ICCID_ENABLE, specifiedIccid, radioType) == ENABLE_DISABLE_SUCCESS) {
-        cachedRadioType_ = radioType;
-    }
+int ModemManager::radioEnable(radio_type_t radioType) {
+    CHECK(radioEnable(radioType, nullptr));
+    return runOperation();
+}
 
-    return 0;
+int ModemManager::probeCellular() {
+    if (busy()) {
+        return SYSTEM_ERROR_BUSY;
+    }
+    int iotopmode = -1;
+    Cellular.command(cbIOTOPMODE, &iotopmode, 10000, "AT+QCFG=\"iotopmode\"\r\n");
+    bool switchMode = (iotopmode != 0);
+    if (switchMode) {
+        // LTE-M only, the scan skips the NB-IoT bands
+        Cellular.command(PROBE_CFUN_TIMEOUT_MS, "AT+CFUN=0\r\n");
+        waitAtResponse(10);
+        Cellular.command(2000, "AT+QCFG=\"iotopmode\",0,1\r\n");
+        Cellular.command(PROBE_CFUN_TIMEOUT_MS, "AT+CFUN=1\r\n");
+        waitAtResponse(10);
+    }
+
+    // Networks are listed regardless of whether the active profile may register on them
+    int networks = 0;
+    int r = Cellular.command(cbCOPS, &networks, PROBE_SCAN_TIMEOUT_MS, "AT+COPS=?\r\n");
+
+    if (switchMode) {
+        Cellular.command(PROBE_CFUN_TIMEOUT_MS, "AT+CFUN=0\r\n");
+        waitAtResponse(10);
+        Cellular.command(2000, "AT+QCFG=\"iotopmode\",%d,1\r\n", (iotopmode < 0) ? 3 : iotopmode);
+        Cellular.command(PROBE_CFUN_TIMEOUT_MS, "AT+CFUN=1\r\n");
+        waitAtResponse(10);
+    }
+    if (r != RESP_OK) {
+        Log.warn("Cellular scan failed: %d", r);
+        return (r == SYSTEM_ERROR_TIMEOUT) ? SYSTEM_ERROR_TIMEOUT : SYSTEM_ERROR_AT_NOT_OK;
+    }
+    Log.info("Cellular networks found: %d", networks);
+    return networks;
 }
 
 int ModemManager::waitAtResponse(unsigned int tries, unsigned int timeout) {
@@ -581,6 +679,10 @@ int ModemManager::waitAtResponse(unsigned int tries, unsigned int timeout) {
 int ModemManager::begin() {
     begun_ = true;
 
+    if (loadRecord(ESIM_PROFILE_CACHE_FILE, ESIM_PROFILE_CACHE_MAGIC, &profileCache_, sizeof(profileCache_)) != 0) {
+        profileCache_ = {};
+    }
+
     if (!Cellular.isOn() || Cellular.isOff()) {
         // Turn on the modem
         Cellular.on();
@@ -20,6 +20,10 @@
 #include "Particle.h"
 
 #include "system_error.h"
+#include "at_response.h"
+#include "esim/apdu_engine.h"
+
+#include <functional>
 
 namespace particle {
 
@@ -30,6 +34,8 @@ typedef enum {
 } radio_type_t;
 
 #define ICCID_LEN               (20)
+#define EID_LEN                 (32)
+#define ESIM_PROFILES_MAX       (8)
 
 typedef enum {
     ENABLE_DISABLE_SUCCESS                         = 0,
@@ -43,39 +49,101 @@ class ModemManager {
 
 public:
 
+    typedef std::function<void(int result)> OnComplete;
+
     ModemManager();
     ~ModemManager();
 
     int begin(void);
+    void process(void);
+
+    // Blocking, return an enable_disable_error_t value
     int esimEnable(char* specifiedIccid);
     int esimDisable(char* specifiedIccid);
     int esimProfiles(char* specifiedIccid, char* profilesBuffer, int profilesBufferLen);
+
     radio_type_t radioEnabled();
+
+    // Blocks until the radio is switched
     int radioEnable(radio_type_t radio_type);
 
+    // Switches the radio from process(), onComplete is called with 0 or a negative error
+    int radioEnable(radio_type_t radio_type, OnComplete onComplete);
+
+    // Scans for LTE networks without switching the eSIM profile, only the operating mode is changed
+    // for the duration of the scan. Blocks for up to about two minutes, returns the number of networks
+    // found or a negative error if the scan didn't complete
+    int probeCellular(void);
+
+    // True while a profile or radio switch is in progress
+    bool busy(void) const {
+        return opState_ != OperationState::IDLE;
+    }
+
 private:
 
+    // Profiles installed on the eUICC identified by the EID. Persisted so that a radio switch
+    // doesn't have to list the profiles again
+    struct EsimProfileCache {
+        char eid[EID_LEN + 1];
+        uint8_t count;
+        char iccids[ESIM_PROFILES_MAX][ICCID_LEN + 1];
+    };
+
+    enum class OperationState {
+        IDLE,
+        SESSION, // APDUs are being exchanged with the ISD-R
+        CFUN_OFF,
+        CFUN_ON,
+        DONE
+    };
+
+    struct ProfileOperation {
+        int type; // ICCID_ENABLE or ICCID_DISABLE
+        radio_type_t radio; // RADIO_UNKNOWN leaves iotopmode unchanged
+        bool byRadio; // The target profile is looked up by radio type
+        char target[ICCID_LEN + 1];
+        char active[ICCID_LEN + 1];
+        bool refreshed; // The profile list was read in this session
+        bool profileChanged;
+        int iotopmode;
+        int result;
+        OnComplete onComplete;
+    };
+
     bool begun_; // true if begin() previously called
     radio_type_t cachedRadioType_;
+    EsimProfileCache profileCache_;
+    ApduEngine apdu_;
+    ProfileOperation op_;
+    OperationState opState_;
 
     static int cbCFUN(int type, const char* buf, int len, int* cfun);
     static int cbIOTOPMODE(int type, const char* buf, int len, int* mode);
-    static int cbCSIMint(int type, const char* buf, int len, int* csimInt);
-    static int cbCSIMstring(int type, const char* buf, int len, char* csimString);
-    static int cbICCID(int type, const char* buf, int len, char* iccid);
+    static int cbICCID(int type, const char* buf, int len, AtBuffer* iccid);
+    static int cbCOPS(int type, const char* buf, int len, int* networks);
 
     int waitAtResponse(unsigned int tries, unsigned int timeout = 3000);
 
-    void swapNibbles(const char* input, char* output);
-    int isValidHexString(const char *str, int length);
-    void stripTrailingF(char* iccid);
-    int findIccids(const char *input, char results[][ICCID_LEN + 1], bool includeTestProfile);
+    static void swapNibbles(const char* input, char* output);
+    static void stripTrailingF(char* iccid);
     int getICCID(char* i, bool log);
-    void enableDisableICCID(int type, char* specifiedIccid, int radioType);
-    int enableDisableProfile(int type, char* specifiedIccid, int radioType);
-    int findIccidByType(const char* inputBuffer, int inputBufferLen, char* matchedIccid, int radioType);
     void updateCachedRadioType(char* iccid);
-
+    void ensureModemOn(void);
+
+    static int parseProfiles(const uint8_t* data, size_t size, char iccids[][ICCID_LEN + 1], int* enabled);
+    const char* cachedIccidByType(int radioType) const;
+    bool cachedIccidExists(const char* iccid) const;
+
+    int startOperation(ProfileOperation op);
+    void requestEid(void);
+    void requestProfiles(void);
+    void resolveProfile(void);
+    void applyProfile(void);
+    void closeSession(int result);
+    void startRefresh(void);
+    void finishOperation(void);
+    int runOperation(void);
 };
 
 } // particle
\ No newline at end of file
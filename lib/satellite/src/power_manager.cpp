@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "power_manager.h"
+#include "at_batch.h"
+
+#include <algorithm>
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.power");
+
+namespace particle {
+
+namespace {
+
+#define SATELLITE_POWER_PERIODIC_TAU_S (4 * 60 * 60)
+#define SATELLITE_POWER_ACTIVE_TIME_S (60)
+#define SATELLITE_POWER_EDRX_CYCLE_MS (81920)
+// eDRX for E-UTRAN (NB-S1 mode)
+#define SATELLITE_POWER_EDRX_ACT_TYPE (5)
+
+// Polling intervals while always on
+#define SATELLITE_POWER_RECEIVE_UPDATE_MS (10000)
+#define SATELLITE_POWER_LINK_QUALITY_UPDATE_MS (60000)
+
+// Polling intervals in low power mode, the receive interval follows the eDRX cycle
+#define SATELLITE_POWER_LOW_POWER_CEREG_UPDATE_MS (5 * 60 * 1000)
+#define SATELLITE_POWER_LOW_POWER_LINK_QUALITY_UPDATE_MS (30 * 60 * 1000)
+
+struct TimerUnit {
+    uint8_t bits;
+    uint32_t seconds;
+};
+
+// GPRS timer 3 (T3412 extended) units, 3GPP TS 24.008 10.5.7.4a, from the finest
+const TimerUnit T3412_UNITS[] = {
+    { 0x3, 2 },
+    { 0x4, 30 },
+    { 0x5, 60 },
+    { 0x0, 600 },
+    { 0x1, 3600 },
+    { 0x2, 36000 },
+    { 0x6, 1152000 }
+};
+
+// GPRS timer 2 (T3324) units, 3GPP TS 24.008 10.5.7.3
+const TimerUnit T3324_UNITS[] = {
+    { 0x0, 2 },
+    { 0x1, 60 },
+    { 0x2, 360 }
+};
+
+// eDRX cycle values for NB-S1 mode in ms, indexed by their 4-bit code, 3GPP TS 24.008 10.5.5.32
+const uint32_t EDRX_CYCLES_MS[] = {
+    0, 0, 20480, 40960, 0, 81920, 0, 0, 0, 163840, 327680, 655360, 1310720, 2621440, 5242880, 10485760
+};
+
+void formatBits(unsigned value, unsigned bits, char* str) {
+    for (unsigned i = 0; i < bits; i++) {
+        str[i] = (value & (1 << (bits - i - 1))) ? '1' : '0';
+    }
+    str[bits] = '\0';
+}
+
+// Encodes a timer with the finest unit that can represent it in 5 bits, str must hold 9 characters
+void encodeTimer(uint32_t seconds, const TimerUnit* units, size_t count, char* str) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t value = (seconds + units[i].seconds - 1) / units[i].seconds;
+        if (value <= 31 || i == count - 1) {
+            formatBits((units[i].bits << 5) | std::min<uint32_t>(value, 31), 8, str);
+            return;
+        }
+    }
+}
+
+// Encodes the shortest supported eDRX cycle not below the requested one, str must hold 5 characters
+uint32_t encodeEdrx(system_tick_t ms, char* str) {
+    unsigned code = 0xf;
+    for (unsigned i = 0; i < sizeof(EDRX_CYCLES_MS) / sizeof(EDRX_CYCLES_MS[0]); i++) {
+        if (EDRX_CYCLES_MS[i] && EDRX_CYCLES_MS[i] >= ms) {
+            code = i;
+            break;
+        }
+    }
+    formatBits(code, 4, str);
+    return EDRX_CYCLES_MS[code];
+}
+
+} // namespace annonymous
+
+PowerManager::PowerManager() :
+        mode_(PowerMode::ALWAYS_ON),
+        periodicTau_(SATELLITE_POWER_PERIODIC_TAU_S),
+        activeTime_(SATELLITE_POWER_ACTIVE_TIME_S),
+        edrxCycle_(SATELLITE_POWER_EDRX_CYCLE_MS) {
+}
+
+int PowerManager::apply() {
+    AtBatch batch;
+    if (mode_ == PowerMode::LOW_POWER) {
+        char tau[9] = {};
+        char active[9] = {};
+        char edrx[5] = {};
+        encodeTimer(periodicTau_, T3412_UNITS, sizeof(T3412_UNITS) / sizeof(T3412_UNITS[0]), tau);
+        encodeTimer(activeTime_, T3324_UNITS, sizeof(T3324_UNITS) / sizeof(T3324_UNITS[0]), active);
+        // Poll at the cycle the network will actually page with
+        edrxCycle_ = encodeEdrx(edrxCycle_, edrx);
+        batch.add(String::format("AT+CPSMS=1,,,\"%s\",\"%s\"", tau, active).c_str())
+            .add(String::format("AT+CEDRXS=1,%d,\"%s\"", SATELLITE_POWER_EDRX_ACT_TYPE, edrx).c_str());
+        Log.info("Low power mode, TAU %s, active time %s, eDRX %s (%lu ms)", tau, active, edrx, edrxCycle_);
+    } else {
+        batch.add("AT+CPSMS=0")
+            .add(String::format("AT+CEDRXS=0,%d", SATELLITE_POWER_EDRX_ACT_TYPE).c_str());
+    }
+    if (batch.run() < 0) {
+        Log.error("Failed to configure power saving");
+        return SYSTEM_ERROR_AT_NOT_OK;
+    }
+    return 0;
+}
+
+system_tick_t PowerManager::registrationInterval(system_tick_t interval) const {
+    return lowPower() ? SATELLITE_POWER_LOW_POWER_CEREG_UPDATE_MS : interval;
+}
+
+system_tick_t PowerManager::receiveInterval(bool downlinkExpected) const {
+    return (lowPower() && !downlinkExpected) ? edrxCycle_ : SATELLITE_POWER_RECEIVE_UPDATE_MS;
+}
+
+system_tick_t PowerManager::linkQualityInterval() const {
+    return lowPower() ? SATELLITE_POWER_LOW_POWER_LINK_QUALITY_UPDATE_MS : SATELLITE_POWER_LINK_QUALITY_UPDATE_MS;
+}
+
+} // namespace particle
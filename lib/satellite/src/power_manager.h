@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+namespace particle {
+
+enum class PowerMode {
+    ALWAYS_ON, // The modem is kept reachable and polled frequently
+    LOW_POWER // PSM and eDRX are enabled and polling follows the paging cycle
+};
+
+// Configures the modem's power saving timers and decides how often Satellite::process() needs to poll
+// the modem, so that the application can sleep in between
+class PowerManager {
+
+public:
+
+    PowerManager();
+
+    // Applies the PSM and eDRX configuration for the current mode
+    int apply(void);
+
+    PowerManager& mode(PowerMode mode) {
+        mode_ = mode;
+        return *this;
+    }
+
+    PowerMode mode(void) const {
+        return mode_;
+    }
+
+    bool lowPower(void) const {
+        return mode_ == PowerMode::LOW_POWER;
+    }
+
+    // Requested periodic TAU (T3412), the network may assign a different value
+    PowerManager& periodicTau(uint32_t seconds) {
+        periodicTau_ = seconds;
+        return *this;
+    }
+
+    // Requested active time (T3324) after which the modem enters PSM
+    PowerManager& activeTime(uint32_t seconds) {
+        activeTime_ = seconds;
+        return *this;
+    }
+
+    // Requested eDRX cycle, rounded up to the next value supported by the network
+    PowerManager& edrxCycle(system_tick_t ms) {
+        edrxCycle_ = ms;
+        return *this;
+    }
+
+    system_tick_t edrxCycle(void) const {
+        return edrxCycle_;
+    }
+
+    // Registration polling interval, the given always-on interval is replaced in low power mode
+    system_tick_t registrationInterval(system_tick_t interval) const;
+
+    // Polling intervals for the current mode
+    // The always-on interval is used while a downlink is expected after an uplink
+    system_tick_t receiveInterval(bool downlinkExpected = false) const;
+    system_tick_t linkQualityInterval(void) const;
+
+private:
+
+    PowerMode mode_;
+    uint32_t periodicTau_;
+    uint32_t activeTime_;
+    system_tick_t edrxCycle_;
+};
+
+} // particle
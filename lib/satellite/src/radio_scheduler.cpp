@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "radio_scheduler.h"
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.radio");
+
+namespace particle {
+
+namespace {
+
+#define SATELLITE_RADIO_DOWNLINK_WINDOW_MS (30000)
+#define SATELLITE_RADIO_MAX_GNSS_WINDOW_MS (120000)
+// Time the radio stays with NTN after a GNSS window was cut short, so that GNSS can't starve it
+#define SATELLITE_RADIO_MIN_NTN_WINDOW_MS (60000)
+
+} // namespace annonymous
+
+RadioScheduler::RadioScheduler() :
+        priority_(RadioUser::NTN),
+        downlinkWindow_(SATELLITE_RADIO_DOWNLINK_WINDOW_MS),
+        maxGnssWindow_(SATELLITE_RADIO_MAX_GNSS_WINDOW_MS),
+        lastNtnActivity_(0),
+        gnssWindowStart_(0),
+        lastGnssWindowEnd_(0),
+        ntnPending_(false),
+        ntnResumed_(false) {
+}
+
+int RadioScheduler::begin() {
+    // The modem may have been left with GNSS priority by a previous run
+    priority_ = RadioUser::NTN;
+    if (RESP_OK != Cellular.command(2000, "AT+QGPSCFG=\"priority\",1,0\r\n")) {
+        return SYSTEM_ERROR_AT_NOT_OK;
+    }
+    return 0;
+}
+
+bool RadioScheduler::gnssAllowed() const {
+    if (priority_ == RadioUser::GNSS) {
+        return true;
+    }
+    if (ntnPending_ || (lastNtnActivity_ && millis() - lastNtnActivity_ < downlinkWindow_)) {
+        return false;
+    }
+    return !lastGnssWindowEnd_ || millis() - lastGnssWindowEnd_ >= SATELLITE_RADIO_MIN_NTN_WINDOW_MS;
+}
+
+void RadioScheduler::process(bool gnssActive, bool ntnPending) {
+    ntnPending_ = ntnPending;
+    if (priority_ == RadioUser::GNSS) {
+        bool ntnNeeded = ntnPending || (lastNtnActivity_ && millis() - lastNtnActivity_ < downlinkWindow_);
+        if (!gnssActive || ntnNeeded || millis() - gnssWindowStart_ >= maxGnssWindow_) {
+            Log.info("GNSS window ended after %lu ms%s", millis() - gnssWindowStart_, ntnNeeded ? ", NTN traffic pending" : "");
+            setPriority(RadioUser::NTN);
+        }
+    } else if (gnssActive && gnssAllowed()) {
+        setPriority(RadioUser::GNSS);
+    }
+}
+
+int RadioScheduler::setPriority(RadioUser user) {
+    if (user == priority_) {
+        return 0;
+    }
+    // 0: GNSS has priority, 1: WWAN has priority. Not saved to NVM
+    if (RESP_OK != Cellular.command(2000, "AT+QGPSCFG=\"priority\",%d,0\r\n", (user == RadioUser::GNSS) ? 0 : 1)) {
+        Log.error("Failed to change radio priority");
+        return SYSTEM_ERROR_AT_NOT_OK;
+    }
+    if (user == RadioUser::GNSS) {
+        gnssWindowStart_ = millis();
+    } else {
+        lastGnssWindowEnd_ = millis();
+        ntnResumed_ = true;
+    }
+    priority_ = user;
+    return 0;
+}
+
+} // namespace particle
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+namespace particle {
+
+enum class RadioUser {
+    NTN,
+    GNSS
+};
+
+// GNSS and the NTN link share the modem's RF front end. The scheduler gives GNSS priority only while
+// the NTN link is idle and hands the radio back as soon as there is traffic to send or a downlink is
+// expected, so that the NTN registration is suspended rather than lost
+class RadioScheduler {
+
+public:
+
+    RadioScheduler();
+
+    int begin(void);
+
+    // ntnPending is true if there is uplink traffic waiting for the radio
+    void process(bool gnssActive, bool ntnPending);
+
+    // Time after an uplink or downlink during which a response is expected and GNSS is held off
+    RadioScheduler& downlinkWindow(system_tick_t ms) {
+        downlinkWindow_ = ms;
+        return *this;
+    }
+
+    // Maximum time GNSS may keep priority in one window
+    RadioScheduler& maxGnssWindow(system_tick_t ms) {
+        maxGnssWindow_ = ms;
+        return *this;
+    }
+
+    void ntnActivity(void) {
+        lastNtnActivity_ = millis();
+    }
+
+    bool gnssAllowed(void) const;
+
+    // True during the downlink window after NTN activity
+    bool downlinkExpected(void) const {
+        return lastNtnActivity_ && millis() - lastNtnActivity_ < downlinkWindow_;
+    }
+
+    RadioUser priority(void) const {
+        return priority_;
+    }
+
+    // Returns true once after the radio was handed back to NTN
+    bool ntnResumed(void) {
+        bool resumed = ntnResumed_;
+        ntnResumed_ = false;
+        return resumed;
+    }
+
+private:
+
+    RadioUser priority_;
+    system_tick_t downlinkWindow_;
+    system_tick_t maxGnssWindow_;
+    system_tick_t lastNtnActivity_;
+    system_tick_t gnssWindowStart_;
+    system_tick_t lastGnssWindowEnd_;
+    bool ntnPending_;
+    bool ntnResumed_;
+
+    int setPriority(RadioUser user);
+};
+
+} // particle
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "recovery_ladder.h"
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.recovery");
+
+namespace particle {
+
+namespace {
+
+// Time the link gets to come back after each step
+#define SATELLITE_RECOVERY_NIPD_COOLDOWN_MS (60000)
+#define SATELLITE_RECOVERY_REATTACH_COOLDOWN_MS (3 * 60 * 1000)
+#define SATELLITE_RECOVERY_CFUN_COOLDOWN_MS (5 * 60 * 1000)
+#define SATELLITE_RECOVERY_POWER_COOLDOWN_MS (10 * 60 * 1000)
+
+} // namespace annonymous
+
+RecoveryLadder::RecoveryLadder() :
+        config_{
+            { true, SATELLITE_RECOVERY_NIPD_COOLDOWN_MS },
+            { true, SATELLITE_RECOVERY_REATTACH_COOLDOWN_MS },
+            { true, SATELLITE_RECOVERY_CFUN_COOLDOWN_MS },
+            { true, SATELLITE_RECOVERY_POWER_COOLDOWN_MS }
+        },
+        stats_(),
+        active_(RecoveryStep::NONE),
+        activeSince_(0),
+        nipdAttemptsDiag_(DIAG_ID_SATELLITE_RECOVERY_NIPD_ATTEMPTS, "sat:recNipd", &stats_[0].attempts),
+        nipdSuccessesDiag_(DIAG_ID_SATELLITE_RECOVERY_NIPD_SUCCESSES, "sat:recNipdOk", &stats_[0].successes),
+        reattachAttemptsDiag_(DIAG_ID_SATELLITE_RECOVERY_REATTACH_ATTEMPTS, "sat:recAttach", &stats_[1].attempts),
+        reattachSuccessesDiag_(DIAG_ID_SATELLITE_RECOVERY_REATTACH_SUCCESSES, "sat:recAttachOk", &stats_[1].successes),
+        cfunAttemptsDiag_(DIAG_ID_SATELLITE_RECOVERY_CFUN_ATTEMPTS, "sat:recCfun", &stats_[2].attempts),
+        cfunSuccessesDiag_(DIAG_ID_SATELLITE_RECOVERY_CFUN_SUCCESSES, "sat:recCfunOk", &stats_[2].successes),
+        powerAttemptsDiag_(DIAG_ID_SATELLITE_RECOVERY_POWER_ATTEMPTS, "sat:recPower", &stats_[3].attempts),
+        powerSuccessesDiag_(DIAG_ID_SATELLITE_RECOVERY_POWER_SUCCESSES, "sat:recPowerOk", &stats_[3].successes) {
+}
+
+RecoveryLadder& RecoveryLadder::enable(RecoveryStep step, bool enabled) {
+    if (step < RecoveryStep::COUNT) {
+        config_[(unsigned)step].enabled = enabled;
+    }
+    return *this;
+}
+
+RecoveryLadder& RecoveryLadder::cooldown(RecoveryStep step, system_tick_t ms) {
+    if (step < RecoveryStep::COUNT) {
+        config_[(unsigned)step].cooldown = ms;
+    }
+    return *this;
+}
+
+RecoveryStep RecoveryLadder::next(RecoveryFault fault) {
+    auto step = enabledFrom(firstStep(fault));
+    if (active_ != RecoveryStep::NONE) {
+        if (millis() - activeSince_ < config_[(unsigned)active_].cooldown) {
+            return RecoveryStep::NONE;
+        }
+        // The previous step didn't help, go one up unless the fault calls for a more disruptive step.
+        // The last step is repeated
+        auto up = enabledFrom((RecoveryStep)((unsigned)active_ + 1));
+        if (up == RecoveryStep::NONE) {
+            up = active_;
+        }
+        if (step == RecoveryStep::NONE || up > step) {
+            step = up;
+        }
+    }
+    if (step == RecoveryStep::NONE) {
+        return step;
+    }
+    active_ = step;
+    activeSince_ = millis();
+    stats_[(unsigned)step].attempts++;
+    Log.warn("Recovery step: %s (attempt %lu)", stepName(step), stats_[(unsigned)step].attempts);
+    return step;
+}
+
+void RecoveryLadder::recovered() {
+    if (active_ == RecoveryStep::NONE) {
+        return;
+    }
+    auto elapsed = millis() - activeSince_;
+    if (elapsed <= config_[(unsigned)active_].cooldown) {
+        stats_[(unsigned)active_].successes++;
+        Log.info("Recovered after %s in %lu ms, success rate %d%%", stepName(active_), elapsed, successRate(active_));
+    } else {
+        // The link came back on its own long after the step, the step failed
+        Log.info("Recovered %lu ms after %s, outside of its cooldown", elapsed, stepName(active_));
+    }
+    active_ = RecoveryStep::NONE;
+}
+
+int RecoveryLadder::successRate(RecoveryStep step) const {
+    if (step >= RecoveryStep::COUNT || !stats_[(unsigned)step].attempts) {
+        return -1;
+    }
+    return stats_[(unsigned)step].successes * 100 / stats_[(unsigned)step].attempts;
+}
+
+const char* RecoveryLadder::stepName(RecoveryStep step) {
+    switch (step) {
+    case RecoveryStep::REOPEN_NIPD: return "reopen nipd";
+    case RecoveryStep::REATTACH: return "re-attach";
+    case RecoveryStep::CFUN_CYCLE: return "CFUN cycle";
+    case RecoveryStep::POWER_CYCLE: return "power cycle";
+    default: return "none";
+    }
+}
+
+RecoveryStep RecoveryLadder::firstStep(RecoveryFault fault) const {
+    switch (fault) {
+    case RecoveryFault::DATA_SESSION: return RecoveryStep::REOPEN_NIPD;
+    case RecoveryFault::NO_REGISTRATION: return RecoveryStep::REATTACH;
+    default: return RecoveryStep::CFUN_CYCLE;
+    }
+}
+
+RecoveryStep RecoveryLadder::enabledFrom(RecoveryStep step) const {
+    for (unsigned i = (unsigned)step; i < (unsigned)RecoveryStep::COUNT; i++) {
+        if (config_[i].enabled) {
+            return (RecoveryStep)i;
+        }
+    }
+    return RecoveryStep::NONE;
+}
+
+} // namespace particle
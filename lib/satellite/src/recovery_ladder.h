@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+#include "diag_query/diag_query.h"
+
+namespace particle {
+
+// Recovery steps from the cheapest to the most disruptive
+enum class RecoveryStep {
+    REOPEN_NIPD, // Close and reopen the non-IP data session
+    REATTACH, // Deregister and register with the network again
+    CFUN_CYCLE,
+    POWER_CYCLE,
+    COUNT,
+    NONE = COUNT
+};
+
+// Fault classes. A fault starts the ladder at the cheapest step that can fix it
+enum class RecoveryFault {
+    DATA_SESSION, // Registered but the data session couldn't be opened
+    NO_REGISTRATION,
+    MODEM // Persistent modem-level errors
+};
+
+// Escalates through the recovery steps. Each step gets a cooldown during which the link may come back
+// before the next step is tried. Attempts and successes are counted per step and exported as
+// diagnostic sources
+class RecoveryLadder {
+
+public:
+
+    RecoveryLadder();
+
+    RecoveryLadder& enable(RecoveryStep step, bool enabled);
+    RecoveryLadder& cooldown(RecoveryStep step, system_tick_t ms);
+
+    // Returns the step to perform now for the fault, or NONE while the previous step is cooling down
+    RecoveryStep next(RecoveryFault fault);
+
+    // Call when the link is up again, resets the ladder. The last step is credited only if the link
+    // came back within its cooldown, otherwise it counts as a failed attempt
+    void recovered(void);
+
+    bool recovering(void) const {
+        return active_ != RecoveryStep::NONE;
+    }
+
+    uint32_t attempts(RecoveryStep step) const {
+        return stats_[(unsigned)step].attempts;
+    }
+
+    uint32_t successes(RecoveryStep step) const {
+        return stats_[(unsigned)step].successes;
+    }
+
+    // Percentage of attempts after which the link recovered within the cooldown, -1 if the step was
+    // never tried
+    int successRate(RecoveryStep step) const;
+
+    static const char* stepName(RecoveryStep step);
+
+private:
+
+    struct StepStats {
+        uint32_t attempts;
+        uint32_t successes;
+    };
+
+    struct StepConfig {
+        bool enabled;
+        system_tick_t cooldown;
+    };
+
+    StepConfig config_[(unsigned)RecoveryStep::COUNT];
+    StepStats stats_[(unsigned)RecoveryStep::COUNT];
+    RecoveryStep active_;
+    system_tick_t activeSince_;
+    UintDiagnosticSource nipdAttemptsDiag_;
+    UintDiagnosticSource nipdSuccessesDiag_;
+    UintDiagnosticSource reattachAttemptsDiag_;
+    UintDiagnosticSource reattachSuccessesDiag_;
+    UintDiagnosticSource cfunAttemptsDiag_;
+    UintDiagnosticSource cfunSuccessesDiag_;
+    UintDiagnosticSource powerAttemptsDiag_;
+    UintDiagnosticSource powerSuccessesDiag_;
+
+    RecoveryStep firstStep(RecoveryFault fault) const;
+    RecoveryStep enabledFrom(RecoveryStep step) const;
+};
+
+} // particle
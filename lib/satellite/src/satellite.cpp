@@ -16,7 +16,12 @@
  */
 
 #include "satellite.h"
+#include "storage/record_storage.h"
+#include "at_batch.h"
+#include "at_response.h"
+#include "event_log.h"
 
+#include "satellite_log.h"
 #include "logging.h"
 LOG_SOURCE_CATEGORY("ncp.client");
 
@@ -75,15 +80,52 @@ using namespace constrained;
 namespace {
 
 #define SATELLITE_NCP_RX_DATA_READ_TIMEOUT_MS (3000)
-#define SATELLITE_NCP_REGISTRATION_UPDATE_SLOW_MS (60000)
-#define SATELLITE_NCP_REGISTRATION_UPDATE_FAST_MS (15000)
-#define SATELLITE_NCP_RECEIVE_UPDATE_MS (10000)
 
 #define SATELLITE_NCP_NO_REGISTRATION_MS (540000)
 
+// Registration state is tracked with AT+CEREG?, which is answered locally by the modem. The Device OS
+// NCP client consumes the unsolicited +CEREG reports itself, so they can't be used directly. The
+// slow poll replaces the old AT+COPS? poll, changes are caught by polling fast for a while whenever
+// one is suspected. PowerManager sets the slow interval in low power mode
+#define SATELLITE_NCP_CEREG_UPDATE_MS (60000)
+#define SATELLITE_NCP_CEREG_FAST_UPDATE_MS (1000)
+#define SATELLITE_NCP_CEREG_FAST_DURATION_MS (30000)
+
 #define SATELLITE_NCP_COMM_ERRORS_MAX (3)
 
-#define SATELLITE_NCP_COPS_TIMEOUT_MS (180000)
+// Re-attach timeouts. The registration itself completes in the background and is picked up by the
+// CEREG polls, there's no need to block process() until it's done
+#define SATELLITE_NCP_COPS_DETACH_TIMEOUT_MS (15000)
+#define SATELLITE_NCP_COPS_ATTACH_TIMEOUT_MS (30000)
+
+// Shortest sleep reported by nextWake() that is worth taking
+#define SATELLITE_NCP_MIN_SLEEP_MS (1000)
+
+#define SATELLITE_MODEM_CONFIG_FILE SATELLITE_STORAGE_DIR "/modem_config"
+#define SATELLITE_MODEM_CONFIG_MAGIC (0x534d4331) // "SMC1"
+
+// Settings applied by configureModem(). Any change here invalidates the persisted fingerprint
+#define SATELLITE_MODEM_PDP_CONTEXT "1,\"Non-IP\",\"particle.io\""
+#define SATELLITE_MODEM_NWSCANMODE (3) // LTE (includes NTN)
+#define SATELLITE_MODEM_IOTOPMODE (3) // NTN only
+
+// Identifies a modem, SIM and set of settings that were already verified
+struct ModemConfigFingerprint {
+    char firmware[40];
+    char iccid[32];
+    uint32_t configHash;
+};
+
+uint32_t modemConfigHash() {
+    char config[64] = {};
+    snprintf(config, sizeof(config), "%s;%d;%d", SATELLITE_MODEM_PDP_CONTEXT, SATELLITE_MODEM_NWSCANMODE,
+            SATELLITE_MODEM_IOTOPMODE);
+    uint32_t h = 2166136261u; // FNV-1a
+    for (const char* p = config; *p; ++p) {
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    }
+    return h;
+}
 
 bool celullarNotReady() {
     return !Cellular.ready();
@@ -95,7 +137,7 @@ bool wifiNotReady() {
 
 } // namespace annonymous
 
-Satellite::Satellite() : begun_(false), registrationUpdateMs_(SATELLITE_NCP_REGISTRATION_UPDATE_FAST_MS)
+Satellite::Satellite() : begun_(false)
 {
     nwConnectionDesired = NW_STATE_IDLE;
 }
@@ -108,68 +150,117 @@ Satellite::~Satellite() {
 
 int Satellite::cbCFUN(int type, const char* buf, int len, int* cfun)
 {
-    if ((type == TYPE_PLUS) && cfun) {
-        if (sscanf(buf, "\r\n+CFUN: %d", cfun) == 1)
-            /*nothing*/;
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && cfun && resp.parse(buf, len, "+CFUN")) {
+        resp.getInt(0, cfun);
     }
     return WAIT;
 }
 
-int Satellite::cbICCID(int type, const char* buf, int len, char* iccid)
+int Satellite::cbICCID(int type, const char* buf, int len, AtBuffer* iccid)
 {
-    if ((type == TYPE_PLUS) && iccid) {
-        if (sscanf(buf, "\r\n+QCCID: %[^\r]\r\n", iccid) == 1)
-            /*nothing*/;
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && iccid && resp.parse(buf, len, "+QCCID")) {
+        resp.getString(0, *iccid);
     }
     return WAIT;
 }
 
-int Satellite::cbCOPS(int type, const char* buf, int len, char* network)
+int Satellite::cbCOPS(int type, const char* buf, int len, AtBuffer* network)
 {
-    if ((type == TYPE_PLUS) && network) {
-        if (sscanf(buf, "\r\n+COPS: 0,0,\"%[^\"]\r\n", network) == 1)
-            /*nothing*/;
+    // +COPS: 0,0,"Skylo"
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && network && resp.parse(buf, len, "+COPS") && resp.equals(1, "0")) {
+        resp.getString(2, *network);
     }
     return WAIT;
 }
 
-int Satellite::cbQCFGEXTquery(int type, const char* buf, int len, int* rxlen)
+int Satellite::cbCEREG(int type, const char* buf, int len, NetworkRegistrationInfo* info)
+{
+    // Response to AT+CEREG? with <n> = 2: +CEREG: 2,1,"1A2B","01234567",9
+    AtResponse resp;
+    NetworkRegistrationInfo i = {};
+    if ((type == TYPE_PLUS) && info && resp.parse(buf, len, "+CEREG") &&
+            resp.getInt(0, &i.mode) && resp.getInt(1, &i.stat)) {
+        resp.getString(2, i.tac, sizeof(i.tac));
+        resp.getString(3, i.cellId, sizeof(i.cellId));
+        resp.getInt(4, &i.act);
+        *info = i;
+    }
+    return WAIT;
+}
+
+int Satellite::cbQGMR(int type, const char* buf, int len, AtBuffer* version)
 {
-    if ((type == TYPE_PLUS) && rxlen) {
-        if (sscanf(buf, "\r\n+QCFGEXT: \"nipdr\",%*d,%*d,%d\r\n", rxlen) == 1)
-            /*nothing*/;
+    AtResponse resp;
+    if ((type == TYPE_UNKNOWN) && version && resp.parseLine(buf, len)) {
+        resp.getString(0, *version);
     }
     return WAIT;
 }
 
-int Satellite::cbQCFGEXTread(int type, const char* buf, int len, char* rxdata)
+int Satellite::cbCGDCONT(int type, const char* buf, int len, AtBuffer* context)
 {
-    if ((type == TYPE_PLUS) && rxdata) {
-        if (sscanf(buf, "\r\n+QCFGEXT: \"nipdr\",%*d,%s\r\n", rxdata) == 1)
-            /*nothing*/;
+    // Only the first context is used: +CGDCONT: 1,"Non-IP","particle.io",...
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && context && resp.parse(buf, len, "+CGDCONT") && resp.equals(0, "1")) {
+        char pdpType[16] = "";
+        char apn[64] = "";
+        resp.getString(1, pdpType, sizeof(pdpType));
+        resp.getString(2, apn, sizeof(apn));
+        snprintf(context->data, context->size, "1,\"%s\",\"%s\"", pdpType, apn);
     }
     return WAIT;
 }
 
-int Satellite::cbQGPSLOC(int type, const char* buf, int len, GnssPositioningInfo* info)
+int Satellite::cbQCFGint(int type, const char* buf, int len, int* value)
 {
-    if ((type == TYPE_PLUS) && info) {
-        if (sscanf(buf, "\r\n+QGPSLOC: %02d%02d%02d.%*03d,%lf,%lf,%f,%f,%d,%f,%f,%f,%02d%02d%02d,%d\r\n",
-                        &info->utcTime.tm_hour, &info->utcTime.tm_min, &info->utcTime.tm_sec,
-                        &info->latitude, &info->longitude, &info->accuracy, &info->altitude,
-                        &info->posMode, &info->cog, &info->speedKmph, &info->speedKnots,
-                        &info->utcTime.tm_mday, &info->utcTime.tm_mon, &info->utcTime.tm_year,
-                        &info->satsInView) == 15) {
-            info->valid = 1;
+    // +QCFG: "nwscanmode",3
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && value && resp.parse(buf, len, "+QCFG")) {
+        resp.getInt(1, value);
+    }
+    return WAIT;
+}
+
+int Satellite::cbQCFGEXTquery(int type, const char* buf, int len, int* rxlen)
+{
+    // +QCFGEXT: "nipdr",<total>,<read>,<unread>
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && rxlen && resp.parse(buf, len, "+QCFGEXT") && resp.equals(0, "nipdr")) {
+        resp.getInt(3, rxlen);
+    }
+    return WAIT;
+}
+
+int Satellite::cbQCFGEXTread(int type, const char* buf, int len, AtBuffer* rxdata)
+{
+    // +QCFGEXT: "nipdr",<len>,<hex data>
+    AtResponse resp;
+    if ((type == TYPE_PLUS) && rxdata && resp.parse(buf, len, "+QCFGEXT") && resp.equals(0, "nipdr")) {
+        if (!resp.getString(2, *rxdata)) {
+            rxdata->data[0] = '\0'; // Don't pass on truncated data
         }
     }
     return WAIT;
 }
 
+int Satellite::cbCMEERROR(int type, const char* buf, int len, int* error)
+{
+    // +CME ERROR: <err>, reported as the final result of a failed command
+    AtResponse resp;
+    if ((type == TYPE_ERROR || type == TYPE_PLUS) && error && resp.parse(buf, len, "+CME ERROR")) {
+        resp.getInt(0, error);
+    }
+    return WAIT;
+}
+
 int Satellite::getICCID(char* i, bool log) {
     char iccid[30] = {0};
 
-    int ret = Cellular.command(cbICCID, iccid, 10000, "AT+QCCID\r\n");
+    AtBuffer iccidBuf = { iccid, sizeof(iccid) };
+    int ret = Cellular.command(cbICCID, &iccidBuf, 10000, "AT+QCCID\r\n");
     if ((ret == RESP_OK) && (strcmp(iccid, "") != 0)) {
         // Log.info("SIM ICCID = %s", iccid);
     } else {
@@ -184,8 +275,14 @@ int Satellite::getICCID(char* i, bool log) {
 int Satellite::isRegistered() {
     int reg = 0;
     char network[32] = "";
-    if ((RESP_OK == Cellular.command(cbCOPS, network, 10000, "AT+COPS?\r\n"))
-            && (strcmp(network,"") != 0))
+    AtBuffer networkBuf = { network, sizeof(network) };
+    int r = Cellular.command(cbCOPS, &networkBuf, 10000, "AT+COPS?\r\n");
+    if (r != RESP_OK) {
+        // The state is unknown, it's not the same as not being registered
+        Log.warn("COPS query failed: %d", r);
+        return -1;
+    }
+    if (strcmp(network,"") != 0)
     {
         Log.info("SATELLITE NETWORK REGISTERED = %s\r\n", network);
         reg = 1;
@@ -217,6 +314,72 @@ int Satellite::waitAtResponse(unsigned int tries, unsigned int timeout) {
     return SYSTEM_ERROR_TIMEOUT;
 }
 
+int Satellite::configureModem(const char* iccid) {
+    ModemConfigFingerprint fp = {};
+    NetworkRegistrationInfo reg = {};
+    AtBuffer firmwareBuf = { fp.firmware, sizeof(fp.firmware) };
+    // Read the current settings once, another profile's session may have changed them since the
+    // last time. Only the settings that differ are written
+    char context[64] = "";
+    int nwscanmode = -1;
+    int iotopmode = -1;
+    AtBuffer contextBuf = { context, sizeof(context) };
+    AtBatch batch;
+    batch.add("AT+QGMR", cbQGMR, &firmwareBuf, nullptr)
+        .add("AT+CEREG?", cbCEREG, &reg, "+CEREG:")
+        .add("AT+COPS=3,0") // Long alphanumeric operator name, expected by cbCOPS
+        .add("AT+CGDCONT?", cbCGDCONT, &contextBuf, "+CGDCONT:")
+        .add("AT+QCFG=\"nwscanmode\"", cbQCFGint, &nwscanmode, "+QCFG: \"nwscanmode\"")
+        .add("AT+QCFG=\"iotopmode\"", cbQCFGint, &iotopmode, "+QCFG: \"iotopmode\"")
+        .run();
+    snprintf(fp.iccid, sizeof(fp.iccid), "%s", iccid);
+    fp.configHash = modemConfigHash();
+
+    // Volatile setting, reapplied only if it differs
+    if (reg.mode != 2) {
+        Cellular.command(2000, "AT+CEREG=2\r\n");
+    }
+
+    // A setting that couldn't be read is assumed to be correct only if this configuration was
+    // already applied with the same firmware and profile
+    ModemConfigFingerprint savedFp = {};
+    bool applied = strlen(fp.firmware) > 0 && strlen(fp.iccid) > 0 &&
+            loadRecord(SATELLITE_MODEM_CONFIG_FILE, SATELLITE_MODEM_CONFIG_MAGIC, &savedFp, sizeof(savedFp)) == 0 &&
+            memcmp(&fp, &savedFp, sizeof(fp)) == 0;
+    bool contextOk = (applied && batch.result(3) != RESP_OK) ||
+            strncmp(context, SATELLITE_MODEM_PDP_CONTEXT, strlen(SATELLITE_MODEM_PDP_CONTEXT)) == 0;
+    bool nwscanmodeOk = (applied && batch.result(4) != RESP_OK) || nwscanmode == SATELLITE_MODEM_NWSCANMODE;
+    bool iotopmodeOk = (applied && batch.result(5) != RESP_OK) || iotopmode == SATELLITE_MODEM_IOTOPMODE;
+
+    int r = 0;
+    if (!contextOk || !nwscanmodeOk || !iotopmodeOk) {
+        Log.info("Updating modem configuration, context: %d, nwscanmode: %d, iotopmode: %d", contextOk, nwscanmodeOk, iotopmodeOk);
+        Cellular.command(180000, "AT+CFUN=0\r\n");
+        batch.clear();
+        if (!contextOk) {
+            batch.add("AT+CGDCONT=" SATELLITE_MODEM_PDP_CONTEXT);
+        }
+        if (!nwscanmodeOk) {
+            batch.add(String::format("AT+QCFG=\"nwscanmode\",%d,1", SATELLITE_MODEM_NWSCANMODE).c_str());
+        }
+        if (!iotopmodeOk) {
+            batch.add(String::format("AT+QCFG=\"iotopmode\",%d,1", SATELLITE_MODEM_IOTOPMODE).c_str());
+        }
+        r = batch.run();
+        Cellular.command(180000, "AT+CFUN=1\r\n");
+    } else {
+        Log.info("Modem configuration up to date, skipping CFUN cycle");
+    }
+
+    if (r != 0 || strlen(fp.firmware) == 0 || strlen(fp.iccid) == 0) {
+        removeRecord(SATELLITE_MODEM_CONFIG_FILE);
+    } else if (!applied) {
+        saveRecord(SATELLITE_MODEM_CONFIG_FILE, SATELLITE_MODEM_CONFIG_MAGIC, &fp, sizeof(fp));
+    }
+    registered_ = (isRegistered() == 1);
+    return r;
+}
+
 int Satellite::begin() { // (const SatelliteConfig& conf) {
     begun_ = true;
     errorCount_ = 0;
@@ -246,36 +409,39 @@ int Satellite::begin() { // (const SatelliteConfig& conf) {
 
     waitAtResponse(10); // Check if the module is alive
 
-    Cellular.command(2000, "AT+QGMR\r\n");
-
     char iccid[32] = "";
     getICCID(iccid, /* log results */ true);
 
-    Cellular.command(2000, "AT+QCFG=\"band\"\r\n");
-    Cellular.command(2000, "AT+CEREG=2\r\n");
-    Cellular.command(2000, "AT+CEREG?\r\n");
-    Cellular.command(2000, "AT+COPS=3,0\r\n");
-    if (isRegistered()) {
-        registered_ = 1;
-        Log.info("SKIPPING THE FOLLOWING COMMANDS:\n"
-            "\"AT+CFUN=0\"\n"
-            "\"AT+CGDCONT=1,\"Non-IP\",\"particle.io\"\n"
-            "\"AT+QCFG=\"nwscanmode\",3,1\n"
-            "\"AT+QCFG=\"iotopmode\",3,1\n"
-            "\"AT+CFUN=1\n");
-    } else {
-        Cellular.command(180000, "AT+CFUN=0\r\n");
-        Cellular.command(2000, "AT+CGDCONT=1,\"Non-IP\",\"particle.io\"");
-        Cellular.command(2000, "AT+QCFG=\"nwscanmode\",3,1\r\n"); // LTE (includes NTN)
-        Cellular.command(2000, "AT+QCFG=\"iotopmode\",3,1\r\n");  // NTN only
-        Cellular.command(180000, "AT+CFUN=1\r\n");
+    configureModem(iccid);
+    if (bands_.snapshot() < 0) {
+        Log.warn("Failed to read the band configuration");
     }
+    power_.apply();
+
+    budget_.begin();
+    gnss_.begin();
+    radio_.begin();
+    gnss_.onCanStart([this]() {
+        return radio_.gnssAllowed();
+    });
 
-    Log.trace("Initializing protocol handler");
+    SAT_LOG_TRACE("Initializing protocol handler");
     CloudProtocolConfig protoConf;
-    protoConf.onSend([this](auto data, auto port, auto /* onAck */) {
-        return tx((const uint8_t*)data.data(), data.size(), port);
+    protoConf.onSend([this](auto data, auto port, auto onAck) {
+        if (!registered_ || !connected()) {
+            return (int)SYSTEM_ERROR_WOULD_BLOCK; // Keep the frame queued until the link is up
+        }
+        return tx((const uint8_t*)data.data(), data.size(), port, std::move(onAck));
+    });
+    protoConf.onCanSend([this](auto priority, auto size) {
+        return budget_.allow(priority, size) && uplink_.allowed(priority);
     });
+    protoConf.iccid(iccid);
+    // Frames held for the uplink window don't count against request timeouts, but the queue has to
+    // hold everything collected over a period
+    if (uplink_.enabled()) {
+        protoConf.maxQueuedFrames(uplink_.maxFrames());
+    }
     int r = proto_.init(protoConf);
     if (r < 0) {
         Log.error("CloudProtocol::init() failed: %d", r);
@@ -302,32 +468,29 @@ int Satellite::connectImpl() {
 
     if (millis() - lastConnectAttempt > 5000) {
         if (!ntnConnected) {
-            if (isRegistered()) {
-                Cellular.command(2000, "AT+CEREG?\r\n");
-                int r = 0;
-                r = Cellular.command(2000, "AT+QCFGEXT=\"nipdcfg\",0,\"particle.io\"\r\n");
-                if (r == RESP_OK) {
-                    r = Cellular.command(2000, "AT+QCFGEXT=\"nipdcfg\"\r\n");
-                }
-                if (r == RESP_OK) {
-                    r = Cellular.command(2000, "AT+QCFGEXT=\"nipd\",1,30\r\n");
+            if (isRegistered() == 1) {
+                AtBatch batch;
+                batch.add("AT+QCFGEXT=\"nipdcfg\",0,\"particle.io\"")
+                    .add("AT+QCFGEXT=\"nipdcfg\"")
+                    .add("AT+QCFGEXT=\"nipd\",1,30")
+                    .stopOnError(true)
+                    .run();
+                if (batch.result(1) == RESP_OK) {
                     ntnConnected = 1;
                 } else {
                     ntnConnected = 0;
                     nwConnected = NW_CONNECTED_FAILED;
+                    runRecovery(recovery_.next(RecoveryFault::DATA_SESSION));
                 }
             } else {
                 nwConnected = NW_CONNECTED_INIT;
                 ntnConnected = 0;
-                // Toggle CFUN if no registration for a long time
+                // Climb the recovery ladder if no registration for a long time
                 if (millis() - noRegistrationTimer_ > SATELLITE_NCP_NO_REGISTRATION_MS) {
-                    Log.info("No registration for %d minutes, toggling CFUN.", SATELLITE_NCP_NO_REGISTRATION_MS/60000);
-                    Cellular.command(20000, "AT+CFUN=0\r\n");
-                    Cellular.command(20000, "AT+CFUN=1\r\n");
-                    noRegistrationTimer_ = millis();
+                    runRecovery(recovery_.next(RecoveryFault::NO_REGISTRATION));
                 }
             }
-            Cellular.command(2000, "AT+QENG=\"servingcell\"");
+            link_.sample();
         }
 
         if (ntnConnected) {
@@ -339,6 +502,7 @@ int Satellite::connectImpl() {
             }
             Log.info("Connected to the Cloud");
             nwConnected = NW_CONNECTED_SUCCESS;
+            recovery_.recovered();
         }
 
         lastConnectAttempt = millis();
@@ -359,61 +523,124 @@ bool Satellite::connected(void) {
     return (nwConnected == NW_CONNECTED_SUCCESS) && (nwConnectionDesired == NW_STATE_CONNECT);
 }
 
-void Satellite::updateRegistration(bool force) {
-    // periodically check for registration
-    if (force || millis() - lastRegistrationCheck_ >= registrationUpdateMs_) {
-        // Log.info("registered_:%d, connected():%d, nwConnected:%d, nwConnectionDesired:%d", registered_, connected(), nwConnected, nwConnectionDesired);
-        int r = isRegistered();
-        if (r == 1 && registered_ == 0) {
-            // we just reattached, reconnect to NTN
-            nwConnected = NW_CONNECTED_INIT;
-            ntnConnected = 0;
-            registered_ = r;
-            connect();
-        } else if (r == 0) {
-            // detached, reset NTN connection
-            nwConnected = NW_CONNECTED_INIT;
-            ntnConnected = 0;
+int Satellite::queryRegistration() {
+    NetworkRegistrationInfo info = {};
+    if (bands_.due()) {
+        // The band configuration is verified along with the registration poll
+        AtBatch batch;
+        batch.add("AT+CEREG?", cbCEREG, &info, "+CEREG:");
+        bands_.addCheck(batch);
+        batch.run();
+        bands_.verify();
+        if (batch.result(0) != RESP_OK) {
+            return -1;
         }
+    } else if (RESP_OK != Cellular.command(cbCEREG, &info, 2000, "AT+CEREG?\r\n")) {
+        return -1;
+    }
+    if ((regInfo_.stat == 1 || regInfo_.stat == 5) && info.stat != 1 && info.stat != 5) {
+        // A silent band change is one way to lose the registration
+        bands_.requestCheck();
+    }
+    if (info.stat != regInfo_.stat || strcmp(info.cellId, regInfo_.cellId) != 0) {
+        Log.info("CEREG: stat %d, TAC %s, CI %s, AcT %d", info.stat, info.tac, info.cellId, info.act);
+    }
+    regInfo_ = info;
+    return (info.stat == 1 || info.stat == 5) ? 1 : 0;
+}
+
+void Satellite::setRegistered(int r) {
+    if (r != registered_) {
+        EventLog::instance().record(EventId::REGISTRATION, r);
+    }
+    if (r == 1) {
+        noRegistrationTimer_ = 0;
+    } else if (!noRegistrationTimer_) {
+        noRegistrationTimer_ = millis();
+    }
+    if (r == 1 && registered_ == 0) {
+        // we just reattached, reconnect to NTN
+        nwConnected = NW_CONNECTED_INIT;
+        ntnConnected = 0;
         registered_ = r;
-        lastRegistrationCheck_ = millis();
-        registrationUpdateMs_ = connected() ? SATELLITE_NCP_REGISTRATION_UPDATE_SLOW_MS : SATELLITE_NCP_REGISTRATION_UPDATE_FAST_MS;
+        connect();
+    } else if (r == 0 && registered_ == 1) {
+        // detached, reset NTN connection
+        nwConnected = NW_CONNECTED_INIT;
+        ntnConnected = 0;
     }
+    registered_ = r;
+}
+
+void Satellite::updateRegistration(bool force) {
+    // Log.info("registered_:%d, connected():%d, nwConnected:%d, nwConnectionDesired:%d", registered_, connected(), nwConnected, nwConnectionDesired);
+    if (!force && radio_.priority() == RadioUser::GNSS) {
+        // The registration is suspended while GNSS has the radio, keep the last known state
+        return;
+    }
+    if (force || millis() - lastCeregCheck_ >= registrationInterval()) {
+        int r = queryRegistration();
+        if (r >= 0) {
+            setRegistered(r);
+        }
+        lastCeregCheck_ = millis();
+    }
+}
+
+void Satellite::registrationChangeSuspected() {
+    fastCeregSince_ = millis();
+    fastCereg_ = true;
+}
+
+system_tick_t Satellite::registrationInterval() const {
+    if (fastCereg_ && millis() - fastCeregSince_ < SATELLITE_NCP_CEREG_FAST_DURATION_MS) {
+        return SATELLITE_NCP_CEREG_FAST_UPDATE_MS;
+    }
+    return power_.registrationInterval(SATELLITE_NCP_CEREG_UPDATE_MS);
 }
 
 void Satellite::receiveData(void) {
     // check for incoming data and update cloud protocol
-    if (registered_ && connected() && millis() - lastReceivedCheck_ >= SATELLITE_NCP_RECEIVE_UPDATE_MS) {
+    if (registered_ && connected() && (millis() - lastReceivedCheck_ >= receiveInterval() || downlink_.due())) {
         lastReceivedCheck_ = millis();
+        bool received = false;
         int recv = 0;
         if ((RESP_OK == Cellular.command(cbQCFGEXTquery, &recv, 10000, "AT+QCFGEXT=\"nipdr\",0\r\n"))
                 && (recv > 0))
         {
             // Receive hex data
             char rxData[320] = "";
-            if ((RESP_OK == Cellular.command(cbQCFGEXTread, rxData, 10000, "AT+QCFGEXT=\"nipdr\",%d,1\r\n", recv))
+            AtBuffer rxDataBuf = { rxData, sizeof(rxData) };
+            if ((RESP_OK == Cellular.command(cbQCFGEXTread, &rxDataBuf, 10000, "AT+QCFGEXT=\"nipdr\",%d,1\r\n", recv))
                 && (strcmp(rxData,"") != 0))
             {
 
-                Log.info("%d BYTES RECEIVED!", recv);
+                SAT_LOG_TRACE("%d BYTES RECEIVED!", recv);
+                EventLog::instance().record(EventId::RX, recv);
+                budget_.countDownlink(recv);
+                radio_.ntnActivity();
                 // General counter response - 806006
                 // Diagnostics request - 830000120306071A
                 auto dataBuf = util::Buffer(recv);
                 hexToBytes(rxData, dataBuf.data(), recv);
-                LOG_DUMP(TRACE, dataBuf.data(), recv);
-                LOG_PRINTF(TRACE, "\r\n");
+                SAT_LOG_DUMP(TRACE, dataBuf.data(), recv);
                 proto_.receive(dataBuf, 223);
+                received = true;
             } else {
                 Log.error("ERROR READING DATA!");
             }
         }
+        downlink_.polled(received);
     }
 }
 
-int Satellite::tx(const uint8_t* buf, size_t len, int port) {
+int Satellite::tx(const uint8_t* buf, size_t len, int port, constrained::MessageChannel::OnAck onAck) {
     if (!registered_ || !connected()) {
         return SYSTEM_ERROR_INVALID_STATE;
     }
+    if (!txGate_.allowed(link_)) {
+        return SYSTEM_ERROR_WOULD_BLOCK;
+    }
 
     auto hexBufSize = len * 2 + 1; // Includes term. null
     std::unique_ptr<char[]> hexBuf(new(std::nothrow) char[hexBufSize]);
@@ -422,46 +649,67 @@ int Satellite::tx(const uint8_t* buf, size_t len, int port) {
     }
     toHex(buf, len, hexBuf.get(), hexBufSize);
     // Send hex data
-    if (RESP_OK == Cellular.command(2000, "AT+QCFGEXT=\"nipds\",1,\"%s\",%d\r\n", hexBuf.get(), len)) {
-        Log.info("%d BYTES SENT!\r\n", len);
+    int cmeError = -1;
+    int r = Cellular.command(cbCMEERROR, &cmeError, 2000, "AT+QCFGEXT=\"nipds\",1,\"%s\",%d\r\n", hexBuf.get(), len);
+    if (RESP_OK == r) {
+        SAT_LOG_TRACE("%d BYTES SENT!", (int)len);
+        EventLog::instance().record(EventId::TX, len);
+        txGate_.success();
+        errorCount_ = 0;
+        budget_.countUplink(len);
+        radio_.ntnActivity();
+        // Poll for the response right away rather than on the next receive interval
+        downlink_.uplinkSent();
+        // The modem accepted the frame for transmission
+        if (onAck) {
+            onAck(0 /* error */);
+        }
     } else {
-        Log.error("ERROR SENDING DATA!");
-        errorCount_++;
-        return -1;
+        Log.error("ERROR SENDING DATA! (%d, CME %d)", r, cmeError);
+        auto failure = TransmitGate::classify(r, cmeError, queryRegistration() == 1);
+        EventLog::instance().record(EventId::TX_FAILED, r, cmeError, failure);
+        registrationChangeSuspected();
+        txGate_.failure(failure);
+        if (failure == TxFailure::REJECTED) {
+            return SYSTEM_ERROR_AT_NOT_OK; // Drops the frame
+        }
+        if (failure == TxFailure::MODEM) {
+            // Only persistent modem faults lead to a reset in processErrors()
+            errorCount_ = txGate_.modemFaults();
+        }
+        return SYSTEM_ERROR_WOULD_BLOCK; // Keep the frame queued until the backoff expires
     }
 
     return 0;
 }
 
 int Satellite::getGNSSLocation(unsigned int maxFixWaitTimeMs) {
-    GnssPositioningInfo info = {};
     auto s = millis();
-    Cellular.command(2000, "AT+QGPS=1\r\n");
-    delay(5000);
-
-    do {
-        Cellular.command(cbQGPSLOC, &info, 2000, "AT+QGPSLOC=2\r\n");
-
-        if (info.valid) {
-            Log.info("GPS TIME: %02d/%02d/%02d %02d:%02d:%02d", info.utcTime.tm_year, info.utcTime.tm_mon,
-                    info.utcTime.tm_mday, info.utcTime.tm_hour, info.utcTime.tm_min, info.utcTime.tm_sec);
-            Log.info("LOCATION: %.5lf, %.5lf, ALT:%.1f SATS:%d\r\n", info.latitude, info.longitude,
-                    info.altitude, info.satsInView);
+    CHECK(gnss_.requestFix());
+    while (gnss_.active() && millis() - s < maxFixWaitTimeMs) {
+        if (begun_) {
+            process();
         } else {
-            delay(5000);
+            gnss_.process();
         }
-    } while (!info.valid && millis() - s < maxFixWaitTimeMs);
-
-    Cellular.command(2000, "AT+QGPSEND\r\n");
+        delay(100);
+    }
+    gnss_.stop();
 
-    if (info.valid) {
-        lastPositionInfo_ = info;
+    GnssPositioningInfo info = {};
+    if (!gnss_.lastFix(&info) || gnss_.fixAge() > millis() - s) {
+        return -1;
     }
-    return info.valid == 1 ? 0 : -1;
+    Log.info("GPS TIME: %02d/%02d/%02d %02d:%02d:%02d", info.utcTime.tm_year, info.utcTime.tm_mon,
+            info.utcTime.tm_mday, info.utcTime.tm_hour, info.utcTime.tm_min, info.utcTime.tm_sec);
+    Log.info("LOCATION: %.5lf, %.5lf, ALT:%.1f SATS:%d\r\n", info.latitude, info.longitude,
+            info.altitude, info.satsInView);
+    return 0;
 }
 
 int Satellite::publishLocation() {
-    if (!lastPositionInfo_.valid) {
+    GnssPositioningInfo info = {};
+    if (!gnss_.lastFix(&info)) {
         return -1;
     }
 
@@ -474,9 +722,9 @@ int Satellite::publishLocation() {
         writer.name("loc").beginObject();
             writer.name("lck").value(1);
             writer.name("time").value(now);
-            writer.name("lat").value(lastPositionInfo_.latitude);
-            writer.name("lon").value(lastPositionInfo_.longitude);
-            writer.name("alt").value(lastPositionInfo_.altitude);
+            writer.name("lat").value(info.latitude);
+            writer.name("lon").value(info.longitude);
+            writer.name("alt").value(info.altitude);
         writer.endObject();
     writer.endObject();
 
@@ -500,35 +748,145 @@ int Satellite::publishLocation() {
     return 0;
 }
 
-int Satellite::processErrors() {
-    if (errorCount_ >= SATELLITE_NCP_COMM_ERRORS_MAX) {
-        Log.error("%d errors, resetting modem!", SATELLITE_NCP_COMM_ERRORS_MAX);
-        // reset modem and re-init
+int Satellite::runRecovery(RecoveryStep step) {
+    if (step == RecoveryStep::NONE) {
+        // The ladder is cooling down, nothing to do or to log
+        return 0;
+    }
+    EventLog::instance().record(EventId::RECOVERY, step);
+    switch (step) {
+    case RecoveryStep::REOPEN_NIPD: {
+        Cellular.command(10000, "AT+QCFGEXT=\"nipd\",0\r\n");
+        break;
+    }
+    case RecoveryStep::REATTACH: {
+        Cellular.command(SATELLITE_NCP_COPS_DETACH_TIMEOUT_MS, "AT+COPS=2\r\n");
+        Cellular.command(SATELLITE_NCP_COPS_ATTACH_TIMEOUT_MS, "AT+COPS=0\r\n");
+        break;
+    }
+    case RecoveryStep::CFUN_CYCLE: {
         Cellular.command(20000, "AT+CFUN=0\r\n");
         Cellular.command(20000, "AT+CFUN=1\r\n");
-        errorCount_ = 0;
-        registrationUpdateMs_ = SATELLITE_NCP_REGISTRATION_UPDATE_FAST_MS;
-        registered_ = 1;
-        nwConnected = NW_CONNECTED_INIT;
-        ntnConnected = 0;
+        break;
     }
-    // TODO: Check for uncommanded band change
-    // 0000001817 [ncp.at] TRACE: > AT+QCFG="band"
-    // 0000001831 [ncp.at] TRACE: < +QCFG: "band",0xf,0x100002000000000f0e189f,0x10004200000000090e189f,0x7
-    // 0000001859 [ncp.at] TRACE: < OK
+    case RecoveryStep::POWER_CYCLE: {
+        Cellular.off();
+        waitFor(Cellular.isOff, 60000);
+        Cellular.on();
+        if (!waitFor(Cellular.isOn, 60000)) {
+            return SYSTEM_ERROR_TIMEOUT;
+        }
+        waitAtResponse(10);
+        // The modem may come back with the settings lost
+        char iccid[32] = {};
+        getICCID(iccid, /* log results */ false);
+        configureModem(iccid);
+        break;
+    }
+    default:
+        return 0;
+    }
+    // connectImpl() opens the data session again once registered
+    ntnConnected = 0;
+    nwConnected = NW_CONNECTED_INIT;
+    registrationChangeSuspected();
+    lastCeregCheck_ = 0;
+    return 0;
+}
+
+int Satellite::processErrors() {
+    if (errorCount_ >= SATELLITE_NCP_COMM_ERRORS_MAX) {
+        auto step = recovery_.next(RecoveryFault::MODEM);
+        if (step != RecoveryStep::NONE) {
+            Log.error("%d errors, recovering modem!", SATELLITE_NCP_COMM_ERRORS_MAX);
+            runRecovery(step);
+            errorCount_ = 0;
+            registered_ = 1;
+        }
+    }
+    // Uncommanded band changes are checked by queryRegistration()
     return 0;
 }
 
 int Satellite::process(bool force) {
-    updateRegistration(force);
+    if (uplink_.process(proto_.hasPendingMessages() || radio_.downlinkExpected())) {
+        // Registration checks, the downlink drain and link measurements piggyback on the uplink window
+        EventLog::instance().record(EventId::UPLINK_WINDOW, proto_.hasPendingMessages());
+        lastCeregCheck_ = 0;
+        lastReceivedCheck_ = 0;
+        lastLinkQualityCheck_ = 0;
+        bands_.requestCheck();
+    }
+    bool idle = quietPeriod();
+    if (!idle) {
+        updateRegistration(force);
+    }
     connectImpl();
-    receiveData();
+    if (!idle) {
+        receiveData();
+    }
     processErrors();
+    budget_.process();
+    if (!idle && registered_ && radio_.priority() == RadioUser::NTN &&
+            millis() - lastLinkQualityCheck_ >= power_.linkQualityInterval()) {
+        link_.sample();
+        lastLinkQualityCheck_ = millis();
+    }
+    gnss_.process();
+    // Frames held for the next uplink window don't need the radio yet
+    radio_.process(gnss_.running(), uplink_.windowOpen() && proto_.hasPendingMessages());
+    if (radio_.ntnResumed()) {
+        // The registration may have changed while GNSS had the radio
+        registrationChangeSuspected();
+        lastCeregCheck_ = 0;
+    }
     proto_.run();
+    updateNextWake();
 
     return 0;
 }
 
+system_tick_t Satellite::receiveInterval() const {
+    // A response to an uplink may arrive before the next paging occasion
+    return power_.receiveInterval(radio_.downlinkExpected());
+}
+
+bool Satellite::quietPeriod() {
+    // Between uplink windows the modem is left alone unless a connection is being established or a
+    // response to an uplink is expected
+    return !uplink_.windowOpen() && !downlink_.active() && !(nwConnectionDesired == NW_STATE_CONNECT && !connected());
+}
+
+void Satellite::updateNextWake() {
+    // Anything in progress needs process() to keep running
+    if (!begun_ || (nwConnectionDesired == NW_STATE_CONNECT && !connected()) ||
+            (uplink_.windowOpen() && proto_.hasPendingMessages()) ||
+            gnss_.active() || radio_.priority() == RadioUser::GNSS) {
+        nextWake_ = 0;
+        return;
+    }
+    if (quietPeriod()) {
+        nextWake_ = uplink_.untilWindow();
+        return;
+    }
+    auto now = millis();
+    auto remaining = [now](uint32_t last, system_tick_t interval) -> system_tick_t {
+        auto elapsed = now - last;
+        return (elapsed >= interval) ? 0 : interval - elapsed;
+    };
+    system_tick_t wake = remaining(lastCeregCheck_, registrationInterval());
+    if (registered_ && connected()) {
+        wake = std::min(wake, remaining(lastReceivedCheck_, receiveInterval()));
+        if (downlink_.active()) {
+            wake = std::min(wake, downlink_.untilPoll());
+        }
+    }
+    if (registered_) {
+        wake = std::min(wake, remaining(lastLinkQualityCheck_, power_.linkQualityInterval()));
+    }
+    nextWake_ = (wake >= SATELLITE_NCP_MIN_SLEEP_MS) ? wake : 0;
+}
+
 } // namespace particle
 
 
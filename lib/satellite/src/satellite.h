@@ -21,6 +21,17 @@
 
 #include "system_error.h"
 #include "cloud_protocol.h"
+#include "budget_manager.h"
+#include "at_response.h"
+#include "gnss_manager.h"
+#include "radio_scheduler.h"
+#include "link_quality.h"
+#include "transmit_gate.h"
+#include "recovery_ladder.h"
+#include "band_guard.h"
+#include "power_manager.h"
+#include "uplink_scheduler.h"
+#include "downlink_poller.h"
 
 #include <optional>
 
@@ -34,21 +45,14 @@ const uint8_t NW_STATE_DISCONNECT = 2;
 
 namespace particle {
 
-struct GnssPositioningInfo {
-    uint16_t version;
-    uint16_t size;
-    double latitude;
-    double longitude;
-    float accuracy;
-    float altitude;
-    float cog;
-    float speedKmph;
-    float speedKnots;
-    struct tm utcTime;
-    int satsInView;
-    bool locked;
-    int posMode;
-    int valid;
+using constrained::PublishOptions;
+
+struct NetworkRegistrationInfo {
+    int mode;        // <n> of +CEREG, unsolicited result code presentation mode
+    int stat;        // <stat> of +CEREG, 1 (home) and 5 (roaming) mean registered
+    char tac[5];     // Tracking area code, hex
+    char cellId[9];  // E-UTRAN cell ID, hex
+    int act;         // Access technology
 };
 
 class SpecialJSONWriter : public spark::JSONBufferWriter {
@@ -71,29 +75,94 @@ public:
     int connect(void);
     int disconnect(void);
     bool connected(void);
-    int tx(const uint8_t* buf, size_t len, int port);
+    int tx(const uint8_t* buf, size_t len, int port, constrained::MessageChannel::OnAck onAck = nullptr);
 
-    int publish(int code) {
-        return proto_.publish(code);
+    int publish(int code, PublishOptions opts = PublishOptions()) {
+        return proto_.publish(code, std::move(opts));
     }
 
-    int publish(int code, const Variant& data) {
-        return proto_.publish(code, data);
+    int publish(int code, const Variant& data, PublishOptions opts = PublishOptions()) {
+        return proto_.publish(code, data, std::move(opts));
     }
 
     int subscribe(int code, constrained::CloudProtocol::OnEvent onEvent) {
         return proto_.subscribe(code, std::move(onEvent));
     }
 
+    // Blocks until a fix is acquired, prefer gnss().requestFix() and polling gnss().lastFix()
     int getGNSSLocation(unsigned int maxFixWaitTimeMs = 120000);
     int publishLocation();
 
     int process(bool force = false);
 
+    // Time in ms until process() has scheduled work again, as of the last call to process(). 0 if
+    // process() should be called again right away. The application may sleep for this long
+    system_tick_t nextWake(void) const {
+        return nextWake_;
+    }
+
+    // Windowed uplinks, disabled unless a period is set
+    UplinkScheduler& uplink(void) {
+        return uplink_;
+    }
+
+    // Call power().mode() before begin() or call power().apply() after changing the mode
+    PowerManager& power(void) {
+        return power_;
+    }
+
     GnssPositioningInfo lastPositionInfo(void) {
-        return lastPositionInfo_;
+        GnssPositioningInfo info = {};
+        gnss_.lastFix(&info);
+        return info;
     };
 
+    GnssManager& gnss(void) {
+        return gnss_;
+    }
+
+    RadioScheduler& radio(void) {
+        return radio_;
+    }
+
+    NetworkRegistrationInfo registrationInfo(void) {
+        return regInfo_;
+    }
+
+    BudgetManager& budget(void) {
+        return budget_;
+    }
+
+    RecoveryLadder& recovery(void) {
+        return recovery_;
+    }
+
+    const BandGuard& bands(void) const {
+        return bands_;
+    }
+
+    // Frame, request and round trip time counters of the Cloud message channel
+    const constrained::MessageChannelStats& messageStats(void) const {
+        return proto_.stats();
+    }
+
+    // True if nothing is waiting to be sent or received and no planned uplink window is open, the
+    // radio can then be borrowed for a while, e.g. for a cellular scan
+    bool idle(void) {
+        return !proto_.hasPendingMessages() && !uplink_.inWindow() && !downlink_.active() &&
+                !gnss_.active() && radio_.priority() != RadioUser::GNSS;
+    }
+
+    // Downlink polling after uplinks and the measured round trip time
+    const DownlinkPoller& downlink(void) const {
+        return downlink_;
+    }
+
+    // Serving cell RSRP, RSRQ and SINR history
+    const LinkQualityMonitor& linkQuality(void) const {
+        return link_;
+    }
+
 private:
 
     bool begun_; // true if begin() previously called
@@ -103,31 +172,60 @@ private:
     volatile uint8_t nwConnected = NW_CONNECTED_INIT;
     volatile uint8_t nwConnectionDesired = NW_STATE_IDLE;
     uint32_t lastReceivedCheck_ = 0;
-    uint32_t lastRegistrationCheck_ = 0;
-    uint32_t registrationUpdateMs_ = 0;
+    uint32_t lastCeregCheck_ = 0;
+    uint32_t fastCeregSince_ = 0;
+    bool fastCereg_ = false;
     uint32_t noRegistrationTimer_ = 0;
+    uint32_t lastLinkQualityCheck_ = 0;
+    NetworkRegistrationInfo regInfo_ = {};
     int errorCount_ = 0;
-    GnssPositioningInfo lastPositionInfo_;
+    GnssManager gnss_;
+    RadioScheduler radio_;
+    BudgetManager budget_;
+    LinkQualityMonitor link_;
+    TransmitGate txGate_;
+    RecoveryLadder recovery_;
+    BandGuard bands_;
+    PowerManager power_;
+    UplinkScheduler uplink_;
+    DownlinkPoller downlink_;
+    system_tick_t nextWake_ = 0;
     constrained::CloudProtocol proto_;
 
     char publishBuffer[1024] = {};
 
     static int cbCFUN(int type, const char* buf, int len, int* cfun);
-    static int cbICCID(int type, const char* buf, int len, char* iccid);
-    static int cbCOPS(int type, const char* buf, int len, char* network);
+    static int cbICCID(int type, const char* buf, int len, AtBuffer* iccid);
+    static int cbCOPS(int type, const char* buf, int len, AtBuffer* network);
+    static int cbCEREG(int type, const char* buf, int len, NetworkRegistrationInfo* info);
+    static int cbQGMR(int type, const char* buf, int len, AtBuffer* version);
+    static int cbCGDCONT(int type, const char* buf, int len, AtBuffer* context);
+    static int cbQCFGint(int type, const char* buf, int len, int* value);
     static int cbQCFGEXTquery(int type, const char* buf, int len, int* rxlen);
-    static int cbQCFGEXTread(int type, const char* buf, int len, char* rxdata);
-    static int cbQGPSLOC(int type, const char* buf, int len, GnssPositioningInfo* info);
+    static int cbQCFGEXTread(int type, const char* buf, int len, AtBuffer* rxdata);
+    static int cbCMEERROR(int type, const char* buf, int len, int* error);
 
+    // 1 if registered according to COPS, 0 if not, negative if the query failed
     int isRegistered(void);
     int waitAtResponse(unsigned int tries, unsigned int timeout = 1000);
     int publishImpl(int code, const std::optional<Variant>& data = std::nullopt);
     void updateRegistration(bool force = false);
+    int queryRegistration(void);
+    void setRegistered(int reg);
+    // Polls the registration quickly for a while, e.g. after a failed transmission or when the radio
+    // is handed back from GNSS
+    void registrationChangeSuspected(void);
+    system_tick_t registrationInterval(void) const;
 
     void receiveData(void);
     int processErrors(void);
+    int runRecovery(RecoveryStep step);
+    system_tick_t receiveInterval(void) const;
+    void updateNextWake(void);
+    bool quietPeriod(void);
     int connectImpl(void);
     int getICCID(char* i, bool log);
+    int configureModem(const char* iccid);
 };
 
 } // particle
\ No newline at end of file
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "spark_wiring_logging.h"
+
+// Logging macros for the hot paths of the satellite and protocol libraries. Messages below
+// SATELLITE_LOG_LEVEL are removed at compile time and, unlike Log.trace() or LOG_DUMP(), none of
+// the arguments are evaluated unless the level is also enabled at runtime. Release builds default
+// to LOG_LEVEL_INFO so that trace output costs nothing
+#ifndef SATELLITE_LOG_LEVEL
+#ifdef DEBUG_BUILD
+#define SATELLITE_LOG_LEVEL LOG_LEVEL_ALL
+#else
+#define SATELLITE_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+#define SAT_LOG_ENABLED(_level) \
+        (LOG_LEVEL_##_level >= SATELLITE_LOG_LEVEL && Log.isLevelEnabled(LOG_LEVEL_##_level))
+
+#define SAT_LOG(_level, _fmt, ...) \
+        do { \
+            if (SAT_LOG_ENABLED(_level)) { \
+                Log.log(LOG_LEVEL_##_level, _fmt, ##__VA_ARGS__); \
+            } \
+        } while (false)
+
+// Appends to the current log line without a header
+#define SAT_LOG_PRINTF(_level, _fmt, ...) \
+        do { \
+            if (SAT_LOG_ENABLED(_level)) { \
+                Log.printf(LOG_LEVEL_##_level, _fmt, ##__VA_ARGS__); \
+            } \
+        } while (false)
+
+// Writes the data as hex followed by a line break
+#define SAT_LOG_DUMP(_level, _data, _size) \
+        do { \
+            if (SAT_LOG_ENABLED(_level)) { \
+                Log.dump(LOG_LEVEL_##_level, _data, _size); \
+                Log.print(LOG_LEVEL_##_level, "\r\n"); \
+            } \
+        } while (false)
+
+#define SAT_LOG_TRACE(_fmt, ...) SAT_LOG(TRACE, _fmt, ##__VA_ARGS__)
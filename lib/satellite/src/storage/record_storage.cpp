@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "record_storage.h"
+
+#include "Particle.h"
+#include "check.h"
+#include "scope_guard.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+
+namespace particle {
+
+namespace {
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t crc;
+};
+
+uint32_t crc32(const void* data, size_t size) {
+    auto d = (const uint8_t*)data;
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= d[i];
+        for (int j = 0; j < 8; ++j) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+} // namespace annonymous
+
+int loadRecord(const char* path, uint32_t magic, void* data, size_t size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return (errno == ENOENT) ? SYSTEM_ERROR_NOT_FOUND : SYSTEM_ERROR_FILE;
+    }
+    SCOPE_GUARD({
+        close(fd);
+    });
+    RecordHeader h = {};
+    if (read(fd, &h, sizeof(h)) != sizeof(h) || h.magic != magic || h.size != size) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    if (read(fd, data, size) != (ssize_t)size || crc32(data, size) != h.crc) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    return 0;
+}
+
+int saveRecord(const char* path, uint32_t magic, const void* data, size_t size) {
+    mkdir(SATELLITE_STORAGE_DIR, 0777);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC);
+    if (fd < 0) {
+        return SYSTEM_ERROR_FILE;
+    }
+    SCOPE_GUARD({
+        close(fd);
+    });
+    RecordHeader h = {};
+    h.magic = magic;
+    h.size = size;
+    h.crc = crc32(data, size);
+    if (write(fd, &h, sizeof(h)) != sizeof(h) || write(fd, data, size) != (ssize_t)size) {
+        return SYSTEM_ERROR_FILE;
+    }
+    return 0;
+}
+
+int removeRecord(const char* path) {
+    if (unlink(path) < 0 && errno != ENOENT) {
+        return SYSTEM_ERROR_FILE;
+    }
+    return 0;
+}
+
+} // namespace particle
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+// Directory on the flash filesystem that holds the library's persistent data
+#define SATELLITE_STORAGE_DIR "/usr/satellite"
+
+// Loads a fixed-size record from a file. Returns SYSTEM_ERROR_NOT_FOUND if the file doesn't exist
+// and SYSTEM_ERROR_BAD_DATA if it was written with a different magic number or size, or is corrupted
+int loadRecord(const char* path, uint32_t magic, void* data, size_t size);
+int saveRecord(const char* path, uint32_t magic, const void* data, size_t size);
+int removeRecord(const char* path);
+
+} // particle
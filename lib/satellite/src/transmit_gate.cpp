@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "transmit_gate.h"
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.tx");
+
+namespace particle {
+
+namespace {
+
+#define SATELLITE_TX_MIN_RSRP (-130)
+#define SATELLITE_TX_MIN_SINR (-10)
+// Link quality samples older than this are not used to hold frames
+#define SATELLITE_TX_LINK_SAMPLE_MAX_AGE_MS (5 * 60 * 1000)
+
+// +CME ERROR codes returned by AT+QCFGEXT="nipds"
+#define SATELLITE_CME_OPERATION_NOT_ALLOWED (3)
+#define SATELLITE_CME_OPERATION_NOT_SUPPORTED (4)
+#define SATELLITE_CME_NO_NETWORK_SERVICE (30)
+#define SATELLITE_CME_NETWORK_TIMEOUT (31)
+#define SATELLITE_CME_NETWORK_NOT_ALLOWED (32)
+#define SATELLITE_CME_INCORRECT_PARAMETERS (50)
+
+struct BackoffConfig {
+    system_tick_t base;
+    system_tick_t max;
+};
+
+// Indexed by TxFailure
+const BackoffConfig BACKOFF_CONFIG[] = {
+    { 2000, 30000 }, // BUSY
+    { 30000, 10 * 60 * 1000 }, // NO_COVERAGE
+    { 5000, 60000 }, // MODEM
+    { 0, 0 } // REJECTED, the frame is dropped
+};
+
+const char* failureName(TxFailure failure) {
+    switch (failure) {
+    case TxFailure::BUSY: return "busy";
+    case TxFailure::NO_COVERAGE: return "no coverage";
+    case TxFailure::MODEM: return "modem error";
+    case TxFailure::REJECTED: return "rejected";
+    default: return "unknown";
+    }
+}
+
+} // namespace annonymous
+
+TransmitGate::TransmitGate() :
+        backoff_(),
+        minRsrp_(SATELLITE_TX_MIN_RSRP),
+        minSinr_(SATELLITE_TX_MIN_SINR) {
+}
+
+bool TransmitGate::allowed(const LinkQualityMonitor& link) const {
+    auto now = millis();
+    for (auto& backoff: backoff_) {
+        // Signed difference so that the deadline survives millis() wrapping
+        if (backoff.failures && (int32_t)(backoff.until - now) > 0) {
+            return false;
+        }
+    }
+    LinkQualitySample sample = {};
+    if (link.latest(&sample) && link.age() < SATELLITE_TX_LINK_SAMPLE_MAX_AGE_MS &&
+            (sample.rsrp < minRsrp_ || sample.sinr < minSinr_)) {
+        return false;
+    }
+    return true;
+}
+
+void TransmitGate::success() {
+    for (auto& backoff: backoff_) {
+        backoff = {};
+    }
+}
+
+void TransmitGate::failure(TxFailure failure) {
+    auto& backoff = backoff_[(unsigned)failure];
+    auto& config = BACKOFF_CONFIG[(unsigned)failure];
+    backoff.failures++;
+    system_tick_t delay = config.base;
+    for (unsigned i = 1; i < backoff.failures && delay < config.max; i++) {
+        delay *= 2;
+    }
+    delay = std::min(delay, config.max);
+    backoff.until = millis() + delay;
+    Log.warn("Transmission failed (%s), backing off for %lu ms", failureName(failure), delay);
+}
+
+TxFailure TransmitGate::classify(int atResult, int cmeError, bool registered) {
+    if (!registered) {
+        return TxFailure::NO_COVERAGE;
+    }
+    if (atResult != RESP_ERROR) {
+        // Timed out or aborted
+        return TxFailure::MODEM;
+    }
+    switch (cmeError) {
+    case SATELLITE_CME_OPERATION_NOT_ALLOWED:
+        return TxFailure::BUSY;
+    case SATELLITE_CME_NO_NETWORK_SERVICE:
+    case SATELLITE_CME_NETWORK_TIMEOUT:
+    case SATELLITE_CME_NETWORK_NOT_ALLOWED:
+        return TxFailure::NO_COVERAGE;
+    case SATELLITE_CME_OPERATION_NOT_SUPPORTED:
+    case SATELLITE_CME_INCORRECT_PARAMETERS:
+        return TxFailure::REJECTED;
+    default:
+        return TxFailure::MODEM;
+    }
+}
+
+} // namespace particle
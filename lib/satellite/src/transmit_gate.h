@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+#include "link_quality.h"
+
+namespace particle {
+
+enum class TxFailure {
+    BUSY, // The modem is still sending a previous frame
+    NO_COVERAGE, // Not registered or no network service
+    MODEM, // No response or an unexpected error from the modem
+    REJECTED, // The frame itself was rejected, retrying it won't help
+    COUNT
+};
+
+// Decides when Satellite::tx may hand a frame to the modem. Each failure class backs off
+// exponentially on its own, frames are held while the link is poor, and only consecutive
+// modem-level faults count towards a modem reset. Held frames stay in the message channel queue,
+// where request timeouts don't run, so a backoff of any length doesn't fail the request
+class TransmitGate {
+
+public:
+
+    TransmitGate();
+
+    // Frames are held while the latest serving cell sample is below these thresholds
+    TransmitGate& minRsrp(int dBm) {
+        minRsrp_ = dBm;
+        return *this;
+    }
+
+    TransmitGate& minSinr(int dB) {
+        minSinr_ = dB;
+        return *this;
+    }
+
+    bool allowed(const LinkQualityMonitor& link) const;
+
+    void success(void);
+    void failure(TxFailure failure);
+
+    // atResult is the result of Cellular.command(), cmeError is the +CME ERROR code or -1
+    static TxFailure classify(int atResult, int cmeError, bool registered);
+
+    // Number of modem-level faults since the last successful transmission
+    unsigned modemFaults(void) const {
+        return backoff_[(unsigned)TxFailure::MODEM].failures;
+    }
+
+private:
+
+    struct Backoff {
+        unsigned failures;
+        system_tick_t until;
+    };
+
+    Backoff backoff_[(unsigned)TxFailure::COUNT];
+    int minRsrp_;
+    int minSinr_;
+};
+
+} // particle
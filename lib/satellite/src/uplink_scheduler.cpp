@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "uplink_scheduler.h"
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("ncp.uplink");
+
+namespace particle {
+
+using namespace constrained;
+
+namespace {
+
+#define SATELLITE_UPLINK_MAX_WINDOW_MS (2 * 60 * 1000)
+#define SATELLITE_UPLINK_MAX_FRAMES (64)
+
+} // namespace annonymous
+
+UplinkScheduler::UplinkScheduler() :
+        period_(0),
+        maxWindow_(SATELLITE_UPLINK_MAX_WINDOW_MS),
+        maxFrames_(SATELLITE_UPLINK_MAX_FRAMES),
+        windowStart_(0),
+        lastWindow_(0),
+        open_(false),
+        flushRequested_(false) {
+}
+
+bool UplinkScheduler::process(bool busy) {
+    if (!enabled()) {
+        return false;
+    }
+    if (open_) {
+        auto duration = millis() - windowStart_;
+        if (!busy || duration >= maxWindow_) {
+            Log.info("Uplink window closed after %lu ms%s", duration, busy ? ", traffic left" : "");
+            open_ = false;
+        }
+        return false;
+    }
+    if (!flushRequested_ && lastWindow_ && millis() - lastWindow_ < period_) {
+        return false;
+    }
+    flushRequested_ = false;
+    open_ = true;
+    windowStart_ = millis();
+    // Windows keep their cadence even if one runs late
+    lastWindow_ = (lastWindow_ && millis() - lastWindow_ < 2 * period_) ? lastWindow_ + period_ : millis();
+    Log.info("Uplink window opened");
+    if (onWindowOpen_) {
+        onWindowOpen_();
+    }
+    return true;
+}
+
+bool UplinkScheduler::allowed(MessagePriority priority) const {
+    return windowOpen() || priority == MessagePriority::ALARM || priority == MessagePriority::RESPONSE;
+}
+
+system_tick_t UplinkScheduler::untilWindow() const {
+    if (windowOpen() || flushRequested_ || !lastWindow_) {
+        return 0;
+    }
+    auto elapsed = millis() - lastWindow_;
+    return (elapsed >= period_) ? 0 : period_ - elapsed;
+}
+
+} // namespace particle
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "Particle.h"
+
+#include "message_channel.h"
+
+#include <functional>
+
+namespace particle {
+
+// Collects telemetry and bulk uplinks over a period and releases them together in a planned radio
+// window. Registration checks, the downlink drain and diagnostics are done in the same window so that
+// the modem is woken up once per period instead of for every message
+class UplinkScheduler {
+
+public:
+
+    typedef std::function<void()> OnWindow;
+
+    UplinkScheduler();
+
+    // Period between windows, 0 disables windowing and frames are sent as soon as possible
+    UplinkScheduler& period(system_tick_t ms) {
+        period_ = ms;
+        return *this;
+    }
+
+    system_tick_t period(void) const {
+        return period_;
+    }
+
+    // Maximum number of frames that can be collected between windows. Must be set before
+    // Satellite::begin(), like the period
+    UplinkScheduler& maxFrames(size_t count) {
+        maxFrames_ = count;
+        return *this;
+    }
+
+    size_t maxFrames(void) const {
+        return maxFrames_;
+    }
+
+    // Maximum time a window is kept open
+    UplinkScheduler& maxWindow(system_tick_t ms) {
+        maxWindow_ = ms;
+        return *this;
+    }
+
+    // Called when a window opens, e.g. to queue the data sampled since the last window
+    UplinkScheduler& onWindowOpen(OnWindow callback) {
+        onWindowOpen_ = std::move(callback);
+        return *this;
+    }
+
+    bool enabled(void) const {
+        return period_ > 0;
+    }
+
+    // busy is true while there are frames to send or a downlink is expected. Returns true once
+    // when a window opens
+    bool process(bool busy);
+
+    // Opens a window with the next call to process()
+    void flush(void) {
+        flushRequested_ = true;
+    }
+
+    // Frames may be sent, always true when windowing is disabled
+    bool windowOpen(void) const {
+        return !enabled() || open_;
+    }
+
+    // True only while a planned window is open, never when windowing is disabled
+    bool inWindow(void) const {
+        return enabled() && open_;
+    }
+
+    // Alarms and responses to the Cloud are never held
+    bool allowed(constrained::MessagePriority priority) const;
+
+    // Time until the next window opens, 0 if it is open
+    system_tick_t untilWindow(void) const;
+
+private:
+
+    system_tick_t period_;
+    system_tick_t maxWindow_;
+    size_t maxFrames_;
+    system_tick_t windowStart_;
+    system_tick_t lastWindow_;
+    OnWindow onWindowOpen_;
+    bool open_;
+    bool flushRequested_;
+};
+
+} // particle
@@ -18,6 +18,10 @@
 #include "Particle.h"
 #include "satellite.h"
 #include "modem_manager.h"
+#include "connectivity_manager.h"
+#include "coverage_memory.h"
+#include "event_log.h"
+#include "hex_to_bytes.h"
 
 SYSTEM_MODE(SEMI_AUTOMATIC);
 
@@ -25,31 +29,43 @@ SerialLogHandler logHandler(LOG_LEVEL_ALL);
 
 Satellite satellite;
 ModemManager modem;
+ConnectivityManager connectivity;
+CoverageMemory coverage;
 
-// NOTE: Set both of the following options to 0 for normal operation, or 1 to TEST forced switching between radios
-//       based on the timeouts that follow.  e.g. if FORCE_CELLULAR_TO_SATELLITE_SWITCH is set to 1 and
-//       FORCE_RADIO_CELLULAR_TO_SATELLITE_SWITCH_TIMEOUT is set to 600000, the application will switch from Cellular
-//       to Satellite after 10 minutes.
-#define FORCE_CELLULAR_TO_SATELLITE_SWITCH (0)
-#define FORCE_SATELLITE_TO_CELLULAR_SWITCH (0)
-#define FORCE_RADIO_CELLULAR_TO_SATELLITE_SWITCH_TIMEOUT (10 * 60 * 1000)
-#define FORCE_RADIO_SATELLITE_TO_CELLULAR_SWITCH_TIMEOUT (10 * 60 * 1000)
-
-// These are pretty standard timeouts.  It is NOT recommended to set them below 10 minutes.
-// There is no CELLULAR_CONNECTED_TIMEOUT because if it's connected there's no reason to switch to satellite.
-// Satellite can take a long time to initially connect so it's not recommended to set the DISCONN. timeout too low.
-#define CELLULAR_DISCONNECTED_TIMEOUT (10 * 60 * 1000)
-#define SATELLITE_CONNECTED_TIMEOUT (10 * 60 * 1000)
-#define SATELLITE_DISCONNECTED_TIMEOUT (20 * 60 * 1000)
+// NOTE: Set the following option to 0 for normal operation, or 1 to TEST forced switching between radios
+//       every FORCE_RADIO_SWITCH_INTERVAL regardless of the connection state.
+#define FORCE_RADIO_SWITCH (0)
+#define FORCE_RADIO_SWITCH_INTERVAL (10 * 60 * 1000)
+
+// Radio selection is otherwise left to the DefaultRadioPolicy of the connectivity manager. It is NOT
+// recommended to set its outage timeouts below a few minutes, satellite can take a long time to initially connect.
+
+// Interval at which cellular signal quality is sampled for the radio policy
+#define SIGNAL_SAMPLE_INTERVAL (60000)
 
 // NOT recommended to set the publish interval below 10 seconds when on satellite
 #define PUBLISH_INTERVAL (30000)
 
 // Start up on Cellular (1) Start up on Satellite (0)
 // NOTE: This is just for testing, you should always start on Cellular and only switch
-// to Satellite if cellular signal drops.
+// to Satellite if cellular signal drops. Cellular is skipped at locations where it was never available.
 #define START_ON_CELLULAR (1)
 
+// Satellite low power mode (1): PSM and eDRX are enabled and the device sleeps until the satellite
+// library or the next publish needs it. The publish interval should then be raised to many minutes.
+#define SATELLITE_LOW_POWER (0)
+#define MIN_SLEEP_DURATION (5000)
+
+// Period of the satellite uplink window (0 sends each publish right away). Publishes made between
+// windows are queued and sent together, alarms are never held
+#define SATELLITE_UPLINK_WINDOW_PERIOD (0)
+
+// The binary event log is sent to the Cloud as "evlog" events while on cellular, decode them with
+// tools/decode_event_log.py. Chunks are hex encoded so they must fit in half of a publish
+#define EVENT_LOG_UPLOAD_INTERVAL (60 * 60 * 1000)
+#define EVENT_LOG_CHUNK_SIZE (384)
+#define EVENT_LOG_MAX_CHUNKS (4)
+
 typedef enum AppPublishState {
     WaitForConnnect,
     GetGNSSLocation,
@@ -57,87 +73,145 @@ typedef enum AppPublishState {
 } AppPublishState;
 
 uint32_t lastPublish = 0;
-uint32_t connectedStartTime = 0;
-uint32_t disconnectedStartTime = 0;
-uint32_t connectedDurationAccum = 0;
-uint32_t disconnectedDurationAccum = 0;
-uint32_t radioTime = 0;
 
 int publishCount = 1;
 int satPublishSuccess = 0;
 int satPublishFailures = 0;
 AppPublishState publishState = AppPublishState::WaitForConnnect;
 
+// Bearer to bring up once the radio switch has completed, the modem callbacks only set it
+Bearer pendingBearerStart = Bearer::NONE;
 
-void updateConnectionTimers(bool force=false) {
-    int connected = 0;
-    static int lastConnected = -1;
-    static radio_type_t lastRadio = RADIO_UNKNOWN;
-    radio_type_t radio = modem.radioEnabled();
 
-    if (radio == RADIO_CELLULAR) {
-        if (Particle.connected()) {
-            connected = 1;
-        }
-    } else if (radio == RADIO_SATELLITE) {
-        if (satellite.connected()) {
-            connected = 1;
+#if FORCE_RADIO_SWITCH
+// Switches radios at a fixed interval, for testing
+class ForcedSwitchPolicy : public RadioPolicy {
+public:
+    RadioAction decide(const LinkState& state) override {
+        if (state.onBearer < FORCE_RADIO_SWITCH_INTERVAL) {
+            return RadioAction::STAY;
         }
+        return (state.bearer == Bearer::CELLULAR) ? RadioAction::SWITCH_SATELLITE : RadioAction::SWITCH_CELLULAR;
     }
+};
+
+ForcedSwitchPolicy forcedSwitchPolicy;
+#endif // FORCE_RADIO_SWITCH
 
-    // reset timers on radio change only
-    if (lastRadio != radio) {
-        connectedStartTime = 0;
-        disconnectedStartTime = 0;
-        connectedDurationAccum = 0;
-        disconnectedDurationAccum = 0;
-        lastConnected = -1;
-        radioTime = millis();
-        lastRadio = radio;
+Bearer activeBearer() {
+    switch (modem.radioEnabled()) {
+        case RADIO_CELLULAR: return Bearer::CELLULAR;
+        case RADIO_SATELLITE: return Bearer::SATELLITE;
+        default: return Bearer::NONE;
     }
+}
 
-    // make sure these are equal on first run
-    if (lastConnected == -1) {
-        lastConnected = connected;
+bool bearerConnected() {
+    switch (activeBearer()) {
+        case Bearer::CELLULAR: return Particle.connected();
+        case Bearer::SATELLITE: return satellite.connected();
+        default: return false;
     }
+}
 
-    // accumulate connected/disconnected time only
-    if (connected) {
-        if (lastConnected != connected) {
-            // save disconnectedDurationAccum if we just switched from disconnected to connected
-            if (disconnectedStartTime) {
-                disconnectedDurationAccum = millis() - disconnectedStartTime;
-            }
-            // add any connected time accumulated
-            if (connectedDurationAccum) {
-                connectedStartTime = millis() - connectedDurationAccum;
-            }
-            lastConnected = connected;
-        }
-        if (!connectedStartTime) {
-            connectedStartTime = millis();
-        }
+void startSatellite() {
+    RGB.control(true);
+    RGB.color(0,255,0);
+
+    Log.info("SATELLITE BEGIN --------------------");
+    satellite.power().mode(SATELLITE_LOW_POWER ? PowerMode::LOW_POWER : PowerMode::ALWAYS_ON);
+    satellite.uplink().period(SATELLITE_UPLINK_WINDOW_PERIOD);
+    if (satellite.begin() == SYSTEM_ERROR_NONE) {
+        satellite.process();
+
+        Log.info("SATELLITE CONNECT ---------------------");
+        satellite.connect();
     } else {
-        if (lastConnected != connected) {
-            if (connectedStartTime) {
-                // save connectedDurationAccum if we just switched from connected to disconnected
-                connectedDurationAccum = millis() - connectedStartTime;
-            }
-            if (disconnectedDurationAccum) {
-                // add any disconnected time accumulated
-                disconnectedStartTime = millis() - disconnectedDurationAccum;
+        Log.error("Error initializing Satellite radio");
+        RGB.color(255,0,0);
+    }
+}
+
+int switchRadio(Bearer bearer) {
+    EventLog::instance().record(EventId::BEARER_SWITCH, bearer);
+    pendingBearerStart = Bearer::NONE;
+    if (bearer == Bearer::SATELLITE) {
+        // NOTE: Very important to disconnect both Cloud and Cellular before switching to Satellite
+        Particle.disconnect();
+        waitFor(Particle.disconnected, 60000);
+        Cellular.disconnect();
+
+        Log.info("RADIO SATELLITE --------------------");
+        publishState = AppPublishState::WaitForConnnect;
+        return modem.radioEnable(RADIO_SATELLITE, [](int result) {
+            if (result == SYSTEM_ERROR_NONE) {
+                pendingBearerStart = Bearer::SATELLITE;
             }
-            lastConnected = connected;
-        }
-        if (!disconnectedStartTime) {
-            disconnectedStartTime = millis();
+        });
+    }
+
+    // NOTE: Very important to disconnect Satellite before switching to Cellular
+    satellite.disconnect();
+    satellite.process(); // process disconnect
+    RGB.control(false);
+
+    Log.info("RADIO CELLULAR --------------------");
+    publishState = AppPublishState::WaitForConnnect;
+    return modem.radioEnable(RADIO_CELLULAR, [](int result) {
+        if (result == SYSTEM_ERROR_NONE) {
+            pendingBearerStart = Bearer::CELLULAR;
         }
+    });
+}
+
+// Looks for cellular coverage while on satellite without swapping eSIM profiles. The scan takes the
+// radio away from satellite, so it is only made while satellite has nothing to do. The connectivity
+// manager retries a probe that couldn't be made
+int probeCellular() {
+    if (modem.busy() || !satellite.idle()) {
+        return SYSTEM_ERROR_BUSY;
+    }
+    satellite.disconnect();
+    satellite.process(); // process disconnect
+    int networks = modem.probeCellular();
+    if (networks <= 0) {
+        // Stay on satellite, the policy won't switch
+        satellite.connect();
     }
+    return networks;
+}
+
+// Sleeps until the satellite library has scheduled work or the next publish is due
+void sleepUntilNextWake() {
+    system_tick_t sleepMs = satellite.nextWake();
+    system_tick_t sincePublish = millis() - lastPublish;
+    sleepMs = std::min<system_tick_t>(sleepMs, (sincePublish >= PUBLISH_INTERVAL) ? 0 : PUBLISH_INTERVAL - sincePublish);
+    if (sleepMs < MIN_SLEEP_DURATION) {
+        return;
+    }
+    Log.info("Sleeping for %lu ms", sleepMs);
+    EventLog::instance().record(EventId::SLEEP, sleepMs);
+    // Keep the modem powered so that it stays registered in PSM/eDRX
+    System.sleep(SystemSleepConfiguration()
+            .mode(SystemSleepMode::STOP)
+            .duration(sleepMs)
+            .network(NETWORK_INTERFACE_CELLULAR, SystemSleepNetworkFlag::INACTIVE_STANDBY));
+}
 
-    static uint32_t lastCheck = millis();
-    if (force || millis() - lastCheck > 5000) {
-        lastCheck = millis();
-        Log.info("[%s] Con: %lu, Dis: %lu ConAccum: %lu, DisAccum: %lu", satellite.connected() ? "CONNECTED" : "DISCONNECTED", millis() - connectedStartTime, millis() - disconnectedStartTime, connectedDurationAccum, disconnectedDurationAccum);
+// Sends the oldest event log records over cellular, they are removed once published
+void uploadEventLog() {
+    uint8_t chunk[EVENT_LOG_CHUNK_SIZE];
+    char hex[EVENT_LOG_CHUNK_SIZE * 2 + 1];
+    for (int i = 0; i < EVENT_LOG_MAX_CHUNKS && Particle.connected(); ++i) {
+        size_t n = EventLog::instance().read(chunk, sizeof(chunk));
+        if (!n) {
+            break;
+        }
+        toHex(chunk, n, hex, sizeof(hex));
+        if (!Particle.publish("evlog", hex)) {
+            break;
+        }
+        EventLog::instance().consume();
     }
 }
 
@@ -175,105 +249,81 @@ void setup()
     pinMode(D7, OUTPUT);
     digitalWrite(D7, LOW);
 
+    EventLog::instance().begin();
+    coverage.begin();
+    connectivity.coverage(&coverage)
+            .onSwitch(switchRadio)
+            .onProbe(probeCellular);
+#if FORCE_RADIO_SWITCH
+    connectivity.policy(&forcedSwitchPolicy);
+#endif // FORCE_RADIO_SWITCH
+
     // Make sure we start up with Cellular enabled,
     // it is less expensive and can handle larger payloads.
     Log.info("RADIO CELLULAR --------------------");
     modem.begin();
 
 #if START_ON_CELLULAR
-    // Start on Cellular
-    modem.radioEnable(RADIO_CELLULAR);
-    updateConnectionTimers(true /* forced log */);
-
-    Particle.connect();
-    waitFor(Particle.connected, 120000);
+    if (coverage.preferredBearer() == Bearer::CELLULAR) {
+        // Start on Cellular
+        modem.radioEnable(RADIO_CELLULAR);
+        connectivity.begin(Bearer::CELLULAR);
 
+        Particle.connect();
+        waitFor(Particle.connected, 120000);
+    } else {
+        Log.info("No cellular coverage at the last known position");
+        modem.radioEnable(RADIO_SATELLITE);
+        connectivity.begin(Bearer::SATELLITE);
+        startSatellite();
+    }
 #else
     // Start on Satellite
     modem.radioEnable(RADIO_SATELLITE);
-    updateConnectionTimers(true /* forced log */);
-    RGB.control(true);
-    RGB.color(0,255,0);
-
-    if (satellite.begin() == SYSTEM_ERROR_NONE) {
-        satellite.process();
-
-        satellite.connect();
-    } else {
-        Log.error("Error initializing Satellite radio");
-        RGB.color(255,0,0);
-    }
+    connectivity.begin(Bearer::SATELLITE);
+    startSatellite();
 #endif // START_ON_CELLULAR
 }
 
 void loop()
 {
-    updateConnectionTimers();
-
-    // If on Cellular connection, if no signal for 10 minutes, switch to Satellite
-    if ( (modem.radioEnabled() == RADIO_CELLULAR) &&
-
-#if FORCE_CELLULAR_TO_SATELLITE_SWITCH
-            (radioTime && (millis() - radioTime > FORCE_RADIO_CELLULAR_TO_SATELLITE_SWITCH_TIMEOUT))
-#else
-            (disconnectedStartTime && (millis() - disconnectedStartTime > CELLULAR_DISCONNECTED_TIMEOUT))
-#endif // FORCE_RADIO_CELLULAR_TO_SATELLITE_SWITCH_TIMEOUT
-            )
-    {
-        Log.info("SWITCH to SATELLITE --------------------");
-        // NOTE: Very important to disconnect both Cloud and Cellular before switching to Satellite
-        Particle.disconnect();
-        waitFor(Particle.disconnected, 60000);
-        Cellular.disconnect();
-
-        Log.info("RADIO SATELLITE --------------------");
-        if (modem.radioEnable(RADIO_SATELLITE) == SYSTEM_ERROR_NONE) {
-            updateConnectionTimers(true /* forced log */);
-            RGB.control(true);
-            RGB.color(0,255,0);
-
-            Log.info("SATELLITE BEGIN --------------------");
-            if (satellite.begin() == SYSTEM_ERROR_NONE) {
-                satellite.process();
-
-                Log.info("SATELLITE CONNECT ---------------------");
-                satellite.connect();
-            } else {
-                Log.error("Error initializing Satellite radio");
-                RGB.color(255,0,0);
-            }
+    // Drive any pending eSIM profile switch
+    modem.process();
+
+    // Bring up the new bearer outside of the modem callbacks, the connection is picked up by the
+    // connectivity manager and the publish state machine
+    if (!modem.busy() && pendingBearerStart != Bearer::NONE) {
+        Bearer bearer = pendingBearerStart;
+        pendingBearerStart = Bearer::NONE;
+        if (bearer == Bearer::SATELLITE) {
+            startSatellite();
+        } else {
+            Log.info("CELLULAR CONNECT ---------------------");
+            Particle.connect();
         }
-        publishState = AppPublishState::WaitForConnnect;
     }
-    // If on Satellite connection, if connected or disconnected for 10 minutes, switch to Cellular
-    //
-    // Note: we don't want to camp on Satellite if Cellular is available, but
-    //       the only way to know if Cellular is available is to go test it again.
-    else if ( (modem.radioEnabled() == RADIO_SATELLITE) &&
-
-#if FORCE_SATELLITE_TO_CELLULAR_SWITCH
-            (radioTime && (millis() - radioTime > FORCE_RADIO_SATELLITE_TO_CELLULAR_SWITCH_TIMEOUT))
-#else
-            ( (disconnectedStartTime && (millis() - disconnectedStartTime > SATELLITE_DISCONNECTED_TIMEOUT)) || (connectedStartTime && (millis() - connectedStartTime > SATELLITE_CONNECTED_TIMEOUT)) )
-#endif // FORCE_RADIO_SATELLITE_TO_CELLULAR_SWITCH_TIMEOUT
-            )
-    {
-        Log.info("SWITCH to CELLULAR --------------------");
-        // NOTE: Very important to disconnect Satellite before switching to Cellular
-        satellite.disconnect();
-        satellite.process(); // process disconnect
-        RGB.control(false);
-
-        Log.info("RADIO CELLULAR --------------------");
-        if (modem.radioEnable(RADIO_CELLULAR) == SYSTEM_ERROR_NONE) {
-            updateConnectionTimers(true /* forced log */);
 
-            Log.info("CELLULAR CONNECT ---------------------");
-            Particle.connect();
-            waitFor(Particle.connected, 120000);
+    if (!modem.busy()) {
+        Bearer bearer = activeBearer();
+        static uint32_t lastSignalSample = 0;
+        if (bearer == Bearer::CELLULAR && millis() - lastSignalSample > SIGNAL_SAMPLE_INTERVAL) {
+            lastSignalSample = millis();
+            connectivity.addSignalSample(bearer, (int)Cellular.RSSI().getQuality());
+        }
+        GnssPositioningInfo fix = {};
+        if (satellite.gnss().lastFix(&fix) && fix.valid) {
+            coverage.position(fix.latitude, fix.longitude);
+        }
+        connectivity.process(bearer, bearerConnected());
+
+        static uint32_t lastEventLogUpload = 0;
+        if (bearer == Bearer::CELLULAR && Particle.connected() &&
+                (!lastEventLogUpload || millis() - lastEventLogUpload > EVENT_LOG_UPLOAD_INTERVAL)) {
+            lastEventLogUpload = millis();
+            uploadEventLog();
         }
-        publishState = AppPublishState::WaitForConnnect;
     }
+    EventLog::instance().process();
 
     // Attempt to publish
     if (millis() - lastPublish > PUBLISH_INTERVAL) {
@@ -289,13 +339,16 @@ void loop()
 
             case AppPublishState::GetGNSSLocation:
             {
-                satellite.getGNSSLocation();
-                if (modem.radioEnabled() == RADIO_SATELLITE) {
-                    // Make sure we re-connect to Skylo NTN after getting gnss fix
-                    satellite.process(true /* force updateRegistration */);
+                // Use the cached fix if it is recent enough, otherwise wait for a GNSS session without blocking
+                static bool fixRequested = false;
+                if (satellite.gnss().fixAge() < PUBLISH_INTERVAL || (fixRequested && !satellite.gnss().active())) {
+                    fixRequested = false;
+                    lastPublish = millis() - PUBLISH_INTERVAL + 2000; // Ensure we don't try to publish immediately after using GNSS
+                    publishState = AppPublishState::PublishGNSSLocation;
+                } else if (!fixRequested) {
+                    satellite.gnss().requestFix();
+                    fixRequested = true;
                 }
-                lastPublish = millis() - PUBLISH_INTERVAL + 2000; // Ensure we don't try to publish immediately after using GNSS
-                publishState = AppPublishState::PublishGNSSLocation;
                 break;
             }
 
@@ -310,9 +363,17 @@ void loop()
                 if (satellite.connected())
                 {
                     Log.info("SATELLITE PUBLISH: {\"count\",%d} ------------------", publishCount);
-                    auto satPublishResult = satellite.publish(1 /* code */, data);
-                    satPublishResult < 0 ? satPublishFailures++ : satPublishSuccess++;
-                    Log.info("Satellite publish successes/total %d/%d ", satPublishSuccess, satPublishSuccess + satPublishFailures);
+                    // A publish only counts as a success once the cloud has acknowledged it
+                    auto satPublishResult = satellite.publish(1 /* code */, data, PublishOptions().onComplete([](int error, system_tick_t latency) {
+                        error < 0 ? satPublishFailures++ : satPublishSuccess++;
+                        EventLog::instance().record(EventId::PUBLISH_DONE, error, latency);
+                        Log.info("Satellite publish %s, latency: %lu ms", error < 0 ? "failed" : "acknowledged", latency);
+                        Log.info("Satellite publish successes/total %d/%d ", satPublishSuccess, satPublishSuccess + satPublishFailures);
+                    }));
+                    if (satPublishResult < 0) {
+                        satPublishFailures++;
+                        Log.info("Satellite publish successes/total %d/%d ", satPublishSuccess, satPublishSuccess + satPublishFailures);
+                    }
                     lastPublish = millis();
                 }
                 else if (Particle.connected())
@@ -339,12 +400,19 @@ void loop()
 
     }
 
-    if (modem.radioEnabled() == RADIO_SATELLITE) {
+    if (modem.busy()) {
+        // The modem is being reconfigured
+    } else if (modem.radioEnabled() == RADIO_SATELLITE) {
         satellite.process();
 
         if (satellite.connected()) {
             RGB.color(0,255,255);
         }
+#if SATELLITE_LOW_POWER
+        sleepUntilNextWake();
+#endif // SATELLITE_LOW_POWER
+    } else {
+        satellite.gnss().process();
     }
 }
 
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2024 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Throughput and latency benchmarks for the protocol library and the AT response parser, see README.md
+// in this directory
+
+#include "Particle.h"
+
+#include <pb_encode.h>
+#include <cloud/cloud_new.pb.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <check.h>
+
+#include "cloud_protocol.h"
+#include "message_channel.h"
+#include "frame_codec.h"
+#include "util/protobuf.h"
+#include "at_response.h"
+
+SYSTEM_MODE(MANUAL);
+
+SerialLogHandler logHandler(LOG_LEVEL_WARN);
+
+using namespace particle;
+using namespace particle::constrained;
+
+#define PB_CLOUD(_name) particle_cloud_##_name
+
+// Number of operations per benchmark, each one runs for well under a second on the device
+#define BENCHMARK_OPS (1000)
+#define BENCHMARK_WARMUP_OPS (20)
+
+// Counts operator new calls. Buffers that spark::Vector grows with realloc() are not counted. Set to 0
+// if the toolchain doesn't allow the allocation functions to be replaced
+#define BENCHMARK_COUNT_ALLOCATIONS (1)
+
+namespace {
+
+// Must match RequestType in cloud_protocol.cpp
+const unsigned EVENT_REQUEST = 2;
+const unsigned DIAGNOSTICS_REQUEST = 3;
+
+const int EVENT_CODE = 1;
+
+// Responses as they are passed to the Cellular.command() callbacks
+const char CEREG_LINE[] = "\r\n+CEREG: 2,1,\"0BA1\",\"08A1B20F\",9\r\n";
+const char QENG_LINE[] = "\r\n+QENG: \"servingcell\",\"NOCONN\",\"eMTC\",\"FDD\",310,410,8A1B20F,281,5110,12,3,3,0BA1,"
+        "-105,-12,-73,90,-\r\n";
+
+// Keeps the parsed values from being optimized away
+volatile int parseSink = 0;
+
+uint32_t allocCount = 0;
+uint32_t allocBytes = 0;
+bool countAllocs = false;
+
+// Last frame handed to the network, kept in static memory so that capturing it doesn't allocate
+char sentFrame[256];
+size_t sentFrameSize = 0;
+
+// Measures the time and allocations of the sections between resume() and pause()
+class Bench {
+public:
+    explicit Bench(const char* name) :
+            name_(name),
+            ticks_(0),
+            start_(0),
+            allocs_(0),
+            bytes_(0) {
+    }
+
+    void resume() {
+        allocCount = 0;
+        allocBytes = 0;
+        countAllocs = true;
+        start_ = System.ticks();
+    }
+
+    void pause() {
+        ticks_ += System.ticks() - start_;
+        countAllocs = false;
+        allocs_ += allocCount;
+        bytes_ += allocBytes;
+    }
+
+    void report(unsigned ops, uint32_t wireBytes) const {
+        uint64_t ns = ticks_ * 1000 / System.ticksPerMicrosecond();
+        Serial.printlnf("BENCH {\"bench\":\"%s\",\"ops\":%u,\"ns_per_op\":%lu,\"allocs_per_op\":%.2f,"
+                "\"bytes_per_op\":%.1f,\"wire_bytes_per_op\":%.1f}", name_, ops, (unsigned long)(ns / ops),
+                (double)allocs_ / ops, (double)bytes_ / ops, (double)wireBytes / ops);
+    }
+
+private:
+    const char* name_;
+    uint64_t ticks_;
+    uint32_t start_;
+    uint64_t allocs_;
+    uint64_t bytes_;
+};
+
+template<typename F>
+void runBench(const char* name, F op) {
+    for (unsigned i = 0; i < BENCHMARK_WARMUP_OPS; ++i) {
+        Bench warmup(name);
+        op(warmup);
+    }
+    Bench b(name);
+    uint32_t wireBytes = 0;
+    for (unsigned i = 0; i < BENCHMARK_OPS; ++i) {
+        sentFrameSize = 0;
+        op(b);
+        wireBytes += sentFrameSize;
+    }
+    b.report(BENCHMARK_OPS, wireBytes);
+}
+
+int captureFrame(util::Buffer data, int port, MessageChannel::OnAck onAck) {
+    sentFrameSize = std::min(data.size(), sizeof(sentFrame));
+    std::memcpy(sentFrame, data.data(), sentFrameSize);
+    if (onAck) {
+        onAck(0 /* error */);
+    }
+    return 0;
+}
+
+int makeFrame(util::Buffer& frame, const FrameHeader& h, const util::Buffer& payload) {
+    char header[MAX_FRAME_HEADER_SIZE] = {};
+    size_t headerSize = CHECK(encodeFrameHeader(header, sizeof(header), h));
+    CHECK(frame.resize(headerSize + payload.size()));
+    std::memcpy(frame.data(), header, headerSize);
+    std::memcpy(frame.data() + headerSize, payload.data(), payload.size());
+    return 0;
+}
+
+// Completes the request in the last sent frame so that requests don't pile up between operations
+int respondToSentFrame(MessageChannel* channel, CloudProtocol* proto) {
+    FrameHeader req;
+    CHECK(decodeFrameHeader(sentFrame, sentFrameSize, req));
+    util::Buffer resp;
+    CHECK(makeFrame(resp, FrameHeader().frameType(FrameType::RESPONSE).requestId(req.requestId()), util::Buffer()));
+    return channel ? channel->receive(std::move(resp), MessageChannelBase::DEFAULT_PORT) :
+            proto->receive(std::move(resp), MessageChannelBase::DEFAULT_PORT);
+}
+
+Variant sampleData() {
+    Variant data;
+    data.set("count", 1234);
+    data.set("lat", 37.7749);
+    data.set("long", -122.4194);
+    return data;
+}
+
+int makeEventRequest(util::Buffer& frame) {
+    String cbor;
+    OutputStringStream s(cbor);
+    CHECK(encodeToCBOR(sampleData(), s));
+    PB_CLOUD(EventRequest) msg = {};
+    msg.which_type = PB_CLOUD(EventRequest_code_tag);
+    msg.type.code = EVENT_CODE;
+    msg.data.arg = &cbor;
+    msg.data.funcs.encode = [](auto strm, auto field, auto arg) {
+        auto cbor = (const String*)*arg;
+        return pb_encode_tag_for_field(strm, field) &&
+                pb_encode_string(strm, (const uint8_t*)cbor->c_str(), cbor->length());
+    };
+    util::Buffer payload;
+    CHECK(util::encodeProtobuf(payload, &msg, &PB_CLOUD(EventRequest_msg)));
+    return makeFrame(frame, FrameHeader().frameType(FrameType::REQUEST).requestTypeOrResultCode(EVENT_REQUEST).requestId(1),
+            payload);
+}
+
+const uint32_t DIAG_IDS[] = {
+    DIAG_ID_SATELLITE_MSG_FRAMES_SENT,
+    DIAG_ID_SATELLITE_MSG_BYTES_SENT,
+    DIAG_ID_SATELLITE_MSG_FRAMES_RECEIVED,
+    DIAG_ID_SATELLITE_MSG_BYTES_RECEIVED
+};
+
+int makeDiagnosticsRequest(util::Buffer& frame) {
+    PB_CLOUD(DiagnosticsRequest) msg = {};
+    msg.ids.funcs.encode = [](auto strm, auto field, auto arg) {
+        for (auto id: DIAG_IDS) {
+            if (!pb_encode_tag_for_field(strm, field) || !pb_encode_varint(strm, id)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    util::Buffer payload;
+    CHECK(util::encodeProtobuf(payload, &msg, &PB_CLOUD(DiagnosticsRequest_msg)));
+    return makeFrame(frame, FrameHeader().frameType(FrameType::REQUEST).requestTypeOrResultCode(DIAGNOSTICS_REQUEST).requestId(2),
+            payload);
+}
+
+CloudProtocol proto;
+MessageChannel channel;
+
+util::Buffer eventRequest;
+util::Buffer diagRequest;
+
+void runBenchmarks() {
+    runBench("frame_encode", [](Bench& b) {
+        char buf[MAX_FRAME_HEADER_SIZE];
+        FrameHeader h;
+        h.frameType(FrameType::REQUEST).requestTypeOrResultCode(EVENT_REQUEST).requestId(1234);
+        b.resume();
+        encodeFrameHeader(buf, sizeof(buf), h);
+        b.pause();
+    });
+
+    runBench("frame_decode", [](Bench& b) {
+        char buf[MAX_FRAME_HEADER_SIZE];
+        encodeFrameHeader(buf, sizeof(buf), FrameHeader().frameType(FrameType::REQUEST).requestTypeOrResultCode(EVENT_REQUEST).requestId(1234));
+        FrameHeader h;
+        b.resume();
+        decodeFrameHeader(buf, sizeof(buf), h);
+        b.pause();
+    });
+
+    // CBOR and protobuf encoding of the event, request bookkeeping and the hand-off to the network
+    runBench("publish_encode", [](Bench& b) {
+        auto data = sampleData();
+        b.resume();
+        proto.publish(EVENT_CODE, std::move(data));
+        proto.run();
+        b.pause();
+        respondToSentFrame(nullptr, &proto);
+    });
+
+    // Protobuf and CBOR decoding of an event from the Cloud, including its response
+    runBench("event_request_decode", [](Bench& b) {
+        util::Buffer frame(eventRequest.data(), eventRequest.size());
+        b.resume();
+        proto.receive(std::move(frame), MessageChannelBase::DEFAULT_PORT);
+        proto.run();
+        b.pause();
+    });
+
+    runBench("diagnostics_round_trip", [](Bench& b) {
+        util::Buffer frame(diagRequest.data(), diagRequest.size());
+        b.resume();
+        proto.receive(std::move(frame), MessageChannelBase::DEFAULT_PORT);
+        proto.run();
+        b.pause();
+    });
+
+    // AtResponse against the sscanf() formats it replaced, on the most frequently polled responses
+    runBench("at_parse_cereg", [](Bench& b) {
+        b.resume();
+        AtResponse resp;
+        int mode = 0, stat = 0, act = 0;
+        char tac[5] = {}, cellId[9] = {};
+        if (resp.parse(CEREG_LINE, sizeof(CEREG_LINE) - 1, "+CEREG") && resp.getInt(0, &mode) && resp.getInt(1, &stat)) {
+            resp.getString(2, tac, sizeof(tac));
+            resp.getString(3, cellId, sizeof(cellId));
+            resp.getInt(4, &act);
+        }
+        b.pause();
+        parseSink = stat + act + tac[0] + cellId[0];
+    });
+
+    runBench("at_sscanf_cereg", [](Bench& b) {
+        b.resume();
+        int mode = 0, stat = 0, act = 0;
+        char tac[5] = {}, cellId[9] = {};
+        sscanf(CEREG_LINE, "\r\n+CEREG: %d,%d,\"%4[0-9A-Fa-f]\",\"%8[0-9A-Fa-f]\",%d", &mode, &stat, tac, cellId, &act);
+        b.pause();
+        parseSink = stat + act + tac[0] + cellId[0];
+    });
+
+    runBench("at_parse_qeng", [](Bench& b) {
+        b.resume();
+        AtResponse resp;
+        int cellId = 0, band = 0, rsrp = 0, rsrq = 0, sinr = 0;
+        if (resp.parse(QENG_LINE, sizeof(QENG_LINE) - 1, "+QENG") && resp.count() >= 17 && resp.equals(0, "servingcell")) {
+            resp.getInt(6, &cellId, 16);
+            resp.getInt(9, &band);
+            resp.getInt(13, &rsrp);
+            resp.getInt(14, &rsrq);
+            resp.getInt(16, &sinr);
+        }
+        b.pause();
+        parseSink = cellId + band + rsrp + rsrq + sinr;
+    });
+
+    runBench("at_sscanf_qeng", [](Bench& b) {
+        b.resume();
+        int band = 0, rsrp = 0, rsrq = 0, sinr = 0;
+        unsigned cellId = 0;
+        sscanf(QENG_LINE, "\r\n+QENG: \"servingcell\",\"%*[^\"]\",\"%*[^\"]\",\"%*[^\"]\",%*d,%*d,%x,%*d,%*d,%d,%*d,%*d,%*[^,],%d,%d,%*d,%d",
+                &cellId, &band, &rsrp, &rsrq, &sinr);
+        b.pause();
+        parseSink = cellId + band + rsrp + rsrq + sinr;
+    });
+
+    // Request ID allocation, the pending request map and response matching
+    runBench("request_bookkeeping", [](Bench& b) {
+        b.resume();
+        channel.sendRequest(EVENT_REQUEST, [](int error, int result, util::Buffer data) {
+            return 0;
+        });
+        channel.run();
+        respondToSentFrame(&channel, nullptr);
+        b.pause();
+    });
+}
+
+} // namespace
+
+#if BENCHMARK_COUNT_ALLOCATIONS
+
+void* operator new(size_t size) {
+    if (countAllocs) {
+        ++allocCount;
+        allocBytes += size;
+    }
+    return std::malloc(size);
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+#endif // BENCHMARK_COUNT_ALLOCATIONS
+
+void setup() {
+    waitFor(Serial.isConnected, 30000);
+
+    proto.init(CloudProtocolConfig().onSend(captureFrame));
+    proto.connect();
+    proto.subscribe(EVENT_CODE, [](int code, Variant data) {});
+    channel.init(MessageChannelConfig().onSend(captureFrame));
+
+    if (makeEventRequest(eventRequest) < 0 || makeDiagnosticsRequest(diagRequest) < 0) {
+        Serial.println("Failed to build the test requests");
+        return;
+    }
+
+    Serial.printlnf("BENCH_RUN {\"version\":\"%s\",\"ops\":%u}", System.version().c_str(), BENCHMARK_OPS);
+    runBenchmarks();
+    Serial.println("BENCH_DONE");
+}
+
+void loop() {
+}
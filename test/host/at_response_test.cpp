@@ -0,0 +1,181 @@
+#include "host_test.h"
+
+#include "at_response.h"
+
+#include <cstring>
+#include <string>
+
+using namespace particle;
+
+namespace {
+
+// Parameters point into the line, which must outlive the response
+bool parse(AtResponse& resp, const char* line, const char* prefix) {
+    return resp.parse(line, std::strlen(line), prefix);
+}
+
+std::string stringAt(const AtResponse& resp, size_t index) {
+    char s[64] = {};
+    resp.getString(index, s, sizeof(s));
+    return s;
+}
+
+} // namespace
+
+TEST_CASE(at_response_parses_cereg_line) {
+    AtResponse resp;
+    EXPECT_TRUE(parse(resp, "\r\n+CEREG: 2,1,\"1A2B\",\"01234567\",9\r\n", "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 5u);
+    int value = 0;
+    EXPECT_TRUE(resp.getInt(1, &value));
+    EXPECT_EQUAL(value, 1);
+    EXPECT_TRUE(resp.isQuoted(2));
+    EXPECT_TRUE(!resp.isQuoted(4));
+    EXPECT_TRUE(resp.getInt(2, &value, 16));
+    EXPECT_EQUAL(value, 0x1a2b);
+    EXPECT_TRUE(resp.equals(3, "01234567"));
+}
+
+TEST_CASE(at_response_keeps_commas_in_quoted_fields) {
+    AtResponse resp;
+    EXPECT_TRUE(parse(resp, "+COPS: 0,0,\"Skylo, Inc.\",9", "+COPS"));
+    EXPECT_EQUAL(resp.count(), 4u);
+    EXPECT_TRUE(resp.equals(2, "Skylo, Inc."));
+    int value = 0;
+    EXPECT_TRUE(resp.getInt(3, &value));
+    EXPECT_EQUAL(value, 9);
+    // Anything between the closing quote and the delimiter is dropped
+    EXPECT_TRUE(parse(resp, "+QCFG: \"band\" ,0x1", "+QCFG"));
+    EXPECT_EQUAL(resp.count(), 2u);
+    EXPECT_TRUE(resp.equals(0, "band"));
+    EXPECT_TRUE(resp.equals(1, "0x1"));
+}
+
+TEST_CASE(at_response_keeps_empty_fields) {
+    AtResponse resp;
+    EXPECT_TRUE(parse(resp, "+CEREG: 2,,\"\", ,5", "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 5u);
+    int value = -1;
+    EXPECT_TRUE(!resp.getInt(1, &value));
+    EXPECT_TRUE(!resp.getInt(2, &value));
+    EXPECT_TRUE(!resp.getInt(3, &value));
+    EXPECT_EQUAL(value, -1);
+    EXPECT_TRUE(resp.equals(1, ""));
+    EXPECT_TRUE(resp.isQuoted(2));
+    EXPECT_TRUE(resp.equals(3, ""));
+    char s[8] = "x";
+    EXPECT_TRUE(resp.getString(2, s, sizeof(s)));
+    EXPECT_EQUAL(std::strlen(s), 0u);
+    EXPECT_TRUE(resp.getInt(4, &value));
+    EXPECT_EQUAL(value, 5);
+    // A trailing comma adds an empty field, a line without parameters has none
+    EXPECT_TRUE(parse(resp, "+CEREG: 2,\r\n", "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 2u);
+    EXPECT_TRUE(resp.equals(1, ""));
+    EXPECT_TRUE(parse(resp, "+CEREG:\r\n", "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 0u);
+    EXPECT_TRUE(parse(resp, "+CEREG", "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 0u);
+}
+
+TEST_CASE(at_response_handles_truncated_lines) {
+    AtResponse resp;
+    // Missing closing quote, the field ends with the line
+    EXPECT_TRUE(parse(resp, "+CEREG: 2,1,\"1A2\r\n", "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 3u);
+    EXPECT_TRUE(resp.isQuoted(2));
+    EXPECT_TRUE(resp.equals(2, "1A2"));
+    // The length is honoured even if the buffer goes on
+    std::string line = "+CEREG: 2,12345,\"1A2B\"";
+    EXPECT_TRUE(resp.parse(line.data(), 12, "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 2u);
+    EXPECT_EQUAL(stringAt(resp, 1), "12");
+    EXPECT_TRUE(resp.parse(line.data(), 19, "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 3u);
+    EXPECT_EQUAL(stringAt(resp, 2), "1A");
+    // Cut inside the prefix
+    EXPECT_TRUE(!resp.parse(line.data(), 4, "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 0u);
+    EXPECT_TRUE(!resp.parse(line.data(), 0, "+CEREG"));
+}
+
+TEST_CASE(at_response_rejects_prefix_mismatch) {
+    AtResponse resp;
+    EXPECT_TRUE(parse(resp, "+CEREG: 2,1", "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 2u);
+    EXPECT_TRUE(!parse(resp, "+CGREG: 2,1", "+CEREG"));
+    EXPECT_EQUAL(resp.count(), 0u);
+    // A longer command that starts with the prefix
+    EXPECT_TRUE(!parse(resp, "+QCFGEXT: \"nipds\",1", "+QCFG"));
+    EXPECT_TRUE(!parse(resp, "OK", "+CEREG"));
+    EXPECT_TRUE(!parse(resp, "", "+CEREG"));
+    EXPECT_TRUE(!parse(resp, "\r\n", "+CEREG"));
+}
+
+TEST_CASE(at_response_bounds_overlong_tokens) {
+    AtResponse resp;
+    std::string token(200, '7');
+    std::string line = "+QENG: \"" + token + "\"," + token;
+    EXPECT_TRUE(parse(resp, line.c_str(), "+QENG"));
+    EXPECT_EQUAL(resp.count(), 2u);
+    size_t size = 0;
+    EXPECT_TRUE(resp.data(0, &size) != nullptr);
+    EXPECT_EQUAL(size, token.size());
+    // Copies are truncated and terminated, and report that they didn't fit
+    char s[8] = {};
+    EXPECT_TRUE(!resp.getString(0, s, sizeof(s)));
+    EXPECT_EQUAL(std::string(s), "7777777");
+    AtBuffer buf = { s, 4 };
+    EXPECT_TRUE(!resp.getString(1, buf));
+    EXPECT_EQUAL(std::string(s), "777");
+    EXPECT_TRUE(!resp.getString(0, s, 0));
+    int value = 0;
+    double d = 0;
+    EXPECT_TRUE(!resp.getInt(1, &value));
+    EXPECT_TRUE(!resp.getDouble(1, &d));
+    EXPECT_EQUAL(value, 0);
+    // Parameters beyond MAX_PARAMS are dropped
+    line = "+QENG: 0";
+    for (size_t i = 1; i < AtResponse::MAX_PARAMS + 5; ++i) {
+        line += "," + std::to_string(i);
+    }
+    EXPECT_TRUE(parse(resp, line.c_str(), "+QENG"));
+    EXPECT_EQUAL(resp.count(), AtResponse::MAX_PARAMS);
+    EXPECT_TRUE(resp.getInt(AtResponse::MAX_PARAMS - 1, &value));
+    EXPECT_EQUAL(value, (int)AtResponse::MAX_PARAMS - 1);
+}
+
+TEST_CASE(at_response_rejects_out_of_range_index) {
+    AtResponse resp;
+    EXPECT_TRUE(parse(resp, "+CEREG: 2,1", "+CEREG"));
+    int value = -1;
+    EXPECT_TRUE(!resp.getInt(2, &value));
+    EXPECT_TRUE(!resp.getInt(AtResponse::MAX_PARAMS, &value));
+    EXPECT_TRUE(!resp.getInt((size_t)-1, &value));
+    EXPECT_EQUAL(value, -1);
+    char s[8] = "x";
+    EXPECT_TRUE(!resp.getString(2, s, sizeof(s)));
+    EXPECT_TRUE(!resp.getString(AtResponse::MAX_PARAMS + 1, s, sizeof(s)));
+    EXPECT_EQUAL(std::string(s), "x");
+    EXPECT_TRUE(resp.data(2, nullptr) == nullptr);
+    EXPECT_TRUE(!resp.equals(2, ""));
+    EXPECT_TRUE(!resp.isQuoted(2));
+    // Parameters of a previous line are not visible after a failed parse
+    EXPECT_TRUE(!parse(resp, "+CGREG: 2,1", "+CEREG"));
+    EXPECT_TRUE(!resp.getInt(0, &value));
+}
+
+TEST_CASE(at_response_rejects_malformed_numbers) {
+    AtResponse resp;
+    EXPECT_TRUE(parse(resp, "+QENG: 12ab,-105,0x1F,1.5", "+QENG"));
+    int value = 0;
+    EXPECT_TRUE(!resp.getInt(0, &value));
+    EXPECT_TRUE(resp.getInt(1, &value));
+    EXPECT_EQUAL(value, -105);
+    EXPECT_TRUE(resp.getInt(2, &value, 16));
+    EXPECT_EQUAL(value, 0x1f);
+    EXPECT_TRUE(!resp.getInt(3, &value));
+    double d = 0;
+    EXPECT_TRUE(resp.getDouble(3, &d));
+    EXPECT_TRUE(d == 1.5);
+}
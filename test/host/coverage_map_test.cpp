@@ -0,0 +1,191 @@
+#include "host_test.h"
+
+#include "coverage_map.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+struct Position {
+    double latitude;
+    double longitude;
+};
+
+// Home slot of a cell, as computed by CoverageMap
+size_t homeSlot(uint32_t hash) {
+    return (uint32_t)(hash * 2654435769u) % CoverageMap::SLOTS;
+}
+
+uint32_t hashOf(const Position& pos) {
+    return geohash(pos.latitude, pos.longitude, CoverageMap::DEFAULT_PRECISION);
+}
+
+// Positions in distinct cells along a grid, about 1 km apart
+std::vector<Position> gridPositions(size_t count) {
+    std::vector<Position> positions;
+    for (size_t i = 0; positions.size() < count; ++i) {
+        positions.push_back({ 46.0 + (i / 64) * 0.01, 7.0 + (i % 64) * 0.015 });
+    }
+    return positions;
+}
+
+// Picks positions that share a home slot with the first one, so that they sit in one probe sequence
+std::vector<Position> collidingPositions(size_t count) {
+    auto candidates = gridPositions(4096);
+    std::vector<Position> positions;
+    size_t home = homeSlot(hashOf(candidates[0]));
+    for (const auto& pos: candidates) {
+        if (homeSlot(hashOf(pos)) == home) {
+            positions.push_back(pos);
+            if (positions.size() == count) {
+                break;
+            }
+        }
+    }
+    return positions;
+}
+
+struct TrackPoint {
+    double latitude;
+    double longitude;
+    bool cellular;
+};
+
+std::vector<TrackPoint> loadTrack(const char* path) {
+    std::vector<TrackPoint> track;
+    FILE* f = std::fopen(path, "r");
+    if (!f) {
+        return track;
+    }
+    char line[128];
+    while (std::fgets(line, sizeof(line), f)) {
+        unsigned time = 0;
+        TrackPoint point = {};
+        int cellular = 0;
+        if (std::sscanf(line, "%u,%lf,%lf,%d", &time, &point.latitude, &point.longitude, &cellular) == 4) {
+            point.cellular = cellular;
+            track.push_back(point);
+        }
+    }
+    std::fclose(f);
+    return track;
+}
+
+} // namespace
+
+TEST_CASE(coverage_map_evicts_least_recently_used_cell) {
+    CoverageMap map;
+    auto positions = gridPositions(CoverageMap::MAX_CELLS + 1);
+    for (size_t i = 0; i < CoverageMap::MAX_CELLS; ++i) {
+        map.record(positions[i].latitude, positions[i].longitude, Bearer::CELLULAR, true);
+    }
+    EXPECT_EQUAL(map.size(), CoverageMap::MAX_CELLS);
+    // A lookup makes the oldest cell recently used, the second oldest goes instead
+    EXPECT_TRUE(map.find(positions[0].latitude, positions[0].longitude) != nullptr);
+    auto& last = positions[CoverageMap::MAX_CELLS];
+    map.record(last.latitude, last.longitude, Bearer::SATELLITE, true);
+    EXPECT_EQUAL(map.size(), CoverageMap::MAX_CELLS);
+    EXPECT_TRUE(map.find(positions[0].latitude, positions[0].longitude) != nullptr);
+    EXPECT_TRUE(map.find(positions[1].latitude, positions[1].longitude) == nullptr);
+    EXPECT_TRUE(map.lookup(positions[1].latitude, positions[1].longitude, Bearer::CELLULAR) == CoverageHint::UNKNOWN);
+    EXPECT_TRUE(map.lookup(last.latitude, last.longitude, Bearer::SATELLITE) == CoverageHint::AVAILABLE);
+}
+
+TEST_CASE(coverage_map_eviction_keeps_probe_sequence) {
+    CoverageMap map;
+    auto cluster = collidingPositions(4);
+    EXPECT_EQUAL(cluster.size(), 4u);
+    // The first cell of the cluster is the oldest and gets evicted from the head of the sequence
+    for (const auto& pos: cluster) {
+        map.record(pos.latitude, pos.longitude, Bearer::CELLULAR, false);
+    }
+    auto others = gridPositions(4096);
+    size_t added = 0;
+    for (const auto& pos: others) {
+        if (map.size() == CoverageMap::MAX_CELLS) {
+            break;
+        }
+        if (!map.find(pos.latitude, pos.longitude)) {
+            map.record(pos.latitude, pos.longitude, Bearer::CELLULAR, true);
+            ++added;
+        }
+    }
+    EXPECT_EQUAL(map.size(), CoverageMap::MAX_CELLS);
+    for (size_t i = 1; i < cluster.size(); ++i) {
+        EXPECT_TRUE(map.find(cluster[i].latitude, cluster[i].longitude) != nullptr);
+    }
+    Position extra = { 10.0, 10.0 };
+    map.record(extra.latitude, extra.longitude, Bearer::CELLULAR, true);
+    EXPECT_TRUE(map.find(cluster[0].latitude, cluster[0].longitude) == nullptr);
+    // Without the backward shift the hole would hide the rest of the cluster
+    for (size_t i = 1; i < cluster.size(); ++i) {
+        EXPECT_TRUE(map.lookup(cluster[i].latitude, cluster[i].longitude, Bearer::CELLULAR) == CoverageHint::UNAVAILABLE);
+    }
+    EXPECT_TRUE(added > 0);
+}
+
+TEST_CASE(coverage_map_matches_reference_under_churn) {
+    // Random inserts and lookups over more cells than fit, checked against a plain LRU model
+    CoverageMap map;
+    auto positions = gridPositions(300);
+    std::map<uint32_t, uint32_t> model; // Hash to last use
+    uint32_t clock = 0;
+    std::srand(1);
+    for (int step = 0; step < 20000; ++step) {
+        const auto& pos = positions[std::rand() % positions.size()];
+        uint32_t hash = hashOf(pos);
+        if (std::rand() % 3) {
+            map.record(pos.latitude, pos.longitude, Bearer::SATELLITE, true);
+            if (!model.count(hash) && model.size() == CoverageMap::MAX_CELLS) {
+                auto oldest = model.begin();
+                for (auto it = model.begin(); it != model.end(); ++it) {
+                    if (it->second < oldest->second) {
+                        oldest = it;
+                    }
+                }
+                model.erase(oldest);
+            }
+            model[hash] = ++clock;
+        } else {
+            bool found = map.find(pos.latitude, pos.longitude) != nullptr;
+            EXPECT_EQUAL(found, model.count(hash) > 0);
+            if (found) {
+                model[hash] = ++clock;
+            }
+        }
+        EXPECT_EQUAL(map.size(), model.size());
+    }
+}
+
+TEST_CASE(coverage_map_replays_track) {
+    // See data/track.csv, the return leg is predicted from what was recorded on the way out
+    auto track = loadTrack("data/track.csv");
+    EXPECT_TRUE(track.size() > 100);
+    size_t half = track.size() / 2;
+    CoverageMap map;
+    for (size_t i = 0; i < half; ++i) {
+        map.record(track[i].latitude, track[i].longitude, Bearer::CELLULAR, track[i].cellular);
+    }
+    EXPECT_TRUE(map.size() < CoverageMap::MAX_CELLS);
+    size_t predicted = 0;
+    size_t correct = 0;
+    for (size_t i = half; i < track.size(); ++i) {
+        auto hint = map.lookup(track[i].latitude, track[i].longitude, Bearer::CELLULAR);
+        if (hint != CoverageHint::UNKNOWN) {
+            ++predicted;
+            if ((hint == CoverageHint::AVAILABLE) == track[i].cellular) {
+                ++correct;
+            }
+        }
+        map.record(track[i].latitude, track[i].longitude, Bearer::CELLULAR, track[i].cellular);
+    }
+    // Only fixes that land in a cell not crossed on the way out, or in a cell at a coverage edge,
+    // may go wrong
+    EXPECT_TRUE(predicted * 100 >= (track.size() - half) * 95);
+    EXPECT_TRUE(correct * 100 >= predicted * 95);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+// Minimal test harness for the parts of the libraries that run on the host
+
+#include <cstdint>
+#include <cstdio>
+
+#include "spark_wiring_ticks.h"
+
+namespace test {
+
+typedef void (*TestFn)();
+
+struct TestCase {
+    const char* name;
+    TestFn fn;
+    TestCase* next;
+};
+
+class Registry {
+public:
+    static Registry& instance();
+
+    void add(TestCase* test);
+    int run(const char* filter);
+    void fail(const char* file, int line, const char* expr);
+
+private:
+    TestCase* first_ = nullptr;
+    TestCase* last_ = nullptr;
+    bool failed_ = false;
+};
+
+// Time returned by millis()
+void setMillis(system_tick_t ms);
+void advanceMillis(system_tick_t ms);
+
+} // namespace test
+
+#define TEST_CASE(_name) \
+        static void _name(); \
+        static test::TestCase _name##_case = { #_name, _name, nullptr }; \
+        static bool _name##_registered = (test::Registry::instance().add(&_name##_case), true); \
+        static void _name()
+
+#define EXPECT_TRUE(_expr) \
+        do { \
+            if (!(_expr)) { \
+                test::Registry::instance().fail(__FILE__, __LINE__, #_expr); \
+                return; \
+            } \
+        } while (false)
+
+#define EXPECT_EQUAL(_a, _b) EXPECT_TRUE((_a) == (_b))
@@ -0,0 +1,85 @@
+#include "host_test.h"
+
+#include "spark_wiring_logging.h"
+#include "spark_wiring_cellular.h"
+#include "diag_query/diag_query.h"
+
+#include <cstring>
+
+const Logger Log;
+CellularClass Cellular;
+
+namespace {
+
+system_tick_t now = 0;
+
+} // namespace
+
+system_tick_t millis() {
+    return now;
+}
+
+// There is no diagnostics service on the host
+UintDiagnosticSource::UintDiagnosticSource(uint16_t id, const char* name, const uint32_t* value) :
+        src_() {
+}
+
+IntDiagnosticSource::IntDiagnosticSource(uint16_t id, const char* name, const int32_t* value) :
+        src_() {
+}
+
+namespace test {
+
+Registry& Registry::instance() {
+    static Registry registry;
+    return registry;
+}
+
+void Registry::add(TestCase* test) {
+    if (last_) {
+        last_->next = test;
+    } else {
+        first_ = test;
+    }
+    last_ = test;
+}
+
+void Registry::fail(const char* file, int line, const char* expr) {
+    std::printf("  %s:%d: check failed: %s\n", file, line, expr);
+    failed_ = true;
+}
+
+int Registry::run(const char* filter) {
+    int total = 0;
+    int failures = 0;
+    for (auto t = first_; t; t = t->next) {
+        if (filter && !std::strstr(t->name, filter)) {
+            continue;
+        }
+        failed_ = false;
+        now = 0;
+        Cellular.reset();
+        t->fn();
+        ++total;
+        if (failed_) {
+            ++failures;
+        }
+        std::printf("%s %s\n", failed_ ? "FAIL" : "ok  ", t->name);
+    }
+    std::printf("%d tests, %d failed\n", total, failures);
+    return failures ? 1 : 0;
+}
+
+void setMillis(system_tick_t ms) {
+    now = ms;
+}
+
+void advanceMillis(system_tick_t ms) {
+    now += ms;
+}
+
+} // namespace test
+
+int main(int argc, char* argv[]) {
+    return test::Registry::instance().run(argc > 1 ? argv[1] : nullptr);
+}
@@ -0,0 +1,222 @@
+#include "host_test.h"
+
+#include "message_channel.h"
+#include "frame_codec.h"
+
+#include <cstring>
+
+using namespace particle;
+using namespace particle::constrained;
+
+namespace {
+
+// Network side of a MessageChannel under test
+struct FakeNetwork {
+    int result = 0; // Returned by the send callback
+    int sendCount = 0;
+    util::Buffer lastFrame;
+
+    MessageChannelConfig config() {
+        return MessageChannelConfig().onSend([this](util::Buffer data, int port, MessageChannel::OnAck onAck) {
+            if (result < 0) {
+                return result;
+            }
+            ++sendCount;
+            lastFrame = std::move(data);
+            if (onAck) {
+                onAck(0 /* error */);
+            }
+            return 0;
+        });
+    }
+
+    // Builds a response to the last sent request
+    util::Buffer response() const {
+        FrameHeader req;
+        decodeFrameHeader(lastFrame.data(), lastFrame.size(), req);
+        char buf[MAX_FRAME_HEADER_SIZE] = {};
+        int n = encodeFrameHeader(buf, sizeof(buf), FrameHeader().frameType(FrameType::RESPONSE).requestId(req.requestId()));
+        return util::Buffer(buf, n);
+    }
+};
+
+struct Completion {
+    int count = 0;
+    int error = 0;
+
+    MessageChannel::OnResponse handler() {
+        return [this](int err, int result, util::Buffer data) {
+            ++count;
+            error = err;
+            return 0;
+        };
+    }
+};
+
+void runFor(MessageChannel& channel, system_tick_t ms, system_tick_t step = 1000) {
+    for (system_tick_t t = 0; t < ms; t += step) {
+        test::advanceMillis(step);
+        channel.run();
+    }
+}
+
+} // namespace
+
+TEST_CASE(held_request_does_not_expire) {
+    FakeNetwork net;
+    net.result = Error::WOULD_BLOCK;
+    MessageChannel channel;
+    channel.init(net.config());
+    Completion done;
+    EXPECT_EQUAL(channel.sendRequest(1, done.handler(), RequestOptions().timeout(60000)), 0);
+    // Held by the network for longer than the request timeout
+    runFor(channel, 5 * 60000);
+    EXPECT_EQUAL(done.count, 0);
+    EXPECT_EQUAL(net.sendCount, 0);
+    EXPECT_TRUE(channel.hasPendingMessages());
+    // The timeout starts once the frame is sent
+    net.result = 0;
+    channel.run();
+    EXPECT_EQUAL(net.sendCount, 1);
+    runFor(channel, 59000);
+    EXPECT_EQUAL(done.count, 0);
+    EXPECT_EQUAL(channel.receive(net.response(), MessageChannelBase::DEFAULT_PORT), 0);
+    EXPECT_EQUAL(done.count, 1);
+    EXPECT_EQUAL(done.error, 0);
+    EXPECT_EQUAL(channel.stats().lateResponses, 0u);
+}
+
+TEST_CASE(expired_request_is_failed_once_and_not_resent) {
+    FakeNetwork net;
+    net.result = Error::WOULD_BLOCK;
+    MessageChannel channel;
+    channel.init(net.config());
+    Completion done;
+    channel.sendRequest(1, done.handler(), RequestOptions().timeout(60000));
+    runFor(channel, 2 * 60000);
+    net.result = 0;
+    channel.run();
+    EXPECT_EQUAL(net.sendCount, 1);
+    runFor(channel, 60000);
+    EXPECT_EQUAL(done.count, 1);
+    EXPECT_EQUAL(done.error, (int)Error::TIMEOUT);
+    EXPECT_EQUAL(channel.stats().timeouts, 1u);
+    EXPECT_TRUE(!channel.hasPendingMessages());
+    runFor(channel, 60000);
+    EXPECT_EQUAL(net.sendCount, 1);
+    EXPECT_EQUAL(done.count, 1);
+}
+
+TEST_CASE(budget_held_request_does_not_expire) {
+    FakeNetwork net;
+    MessageChannel channel;
+    channel.init(net.config().onCanSend([](MessagePriority priority, size_t size) {
+        return millis() >= 3 * 60000;
+    }));
+    Completion done;
+    channel.sendRequest(1, done.handler(), RequestOptions().timeout(60000));
+    runFor(channel, 3 * 60000);
+    EXPECT_EQUAL(net.sendCount, 1);
+    EXPECT_EQUAL(done.count, 0);
+    EXPECT_EQUAL(channel.receive(net.response(), MessageChannelBase::DEFAULT_PORT), 0);
+    EXPECT_EQUAL(done.count, 1);
+    EXPECT_EQUAL(done.error, 0);
+}
+
+TEST_CASE(deferred_frame_is_counted_once) {
+    FakeNetwork net;
+    net.result = Error::WOULD_BLOCK;
+    MessageChannel channel;
+    channel.init(net.config());
+    channel.sendRequest(1, nullptr, RequestOptions().noResponse(true));
+    channel.sendRequest(1, nullptr, RequestOptions().noResponse(true));
+    runFor(channel, 60000, 10);
+    EXPECT_EQUAL(channel.stats().retries, 1u);
+    net.result = 0;
+    channel.run();
+    channel.run();
+    EXPECT_EQUAL(net.sendCount, 2);
+    // Only the first frame was offered to the network while it was blocked
+    EXPECT_EQUAL(channel.stats().retries, 1u);
+    EXPECT_EQUAL(channel.stats().framesSent, 2u);
+}
+
+TEST_CASE(rtt_excludes_queue_time) {
+    FakeNetwork net;
+    net.result = Error::WOULD_BLOCK;
+    MessageChannel channel;
+    channel.init(net.config());
+    Completion done;
+    channel.sendRequest(1, done.handler());
+    runFor(channel, 30000);
+    net.result = 0;
+    channel.run();
+    test::advanceMillis(1500);
+    channel.receive(net.response(), MessageChannelBase::DEFAULT_PORT);
+    EXPECT_EQUAL(done.count, 1);
+    EXPECT_EQUAL(channel.stats().rtt.count(), 1u);
+    EXPECT_EQUAL(channel.stats().rtt.max(), 1500u);
+}
+
+TEST_CASE(request_survives_longest_transmit_backoff) {
+    // Satellite::tx holds frames for up to 10 minutes while there is no coverage
+    FakeNetwork net;
+    net.result = Error::WOULD_BLOCK;
+    MessageChannel channel;
+    channel.init(net.config());
+    Completion done;
+    channel.sendRequest(1, done.handler());
+    runFor(channel, 10 * 60000);
+    EXPECT_EQUAL(done.count, 0);
+    net.result = 0;
+    channel.run();
+    channel.receive(net.response(), MessageChannelBase::DEFAULT_PORT);
+    EXPECT_EQUAL(done.count, 1);
+    EXPECT_EQUAL(done.error, 0);
+    EXPECT_EQUAL(channel.stats().lateResponses, 0u);
+}
+
+TEST_CASE(window_held_queue_uses_configured_limit) {
+    FakeNetwork net;
+    MessageChannel channel;
+    bool windowOpen = false;
+    channel.init(net.config().maxQueuedFrames(40).onCanSend([&windowOpen](MessagePriority priority, size_t size) {
+        return windowOpen;
+    }));
+    Completion done;
+    for (int i = 0; i < 40; ++i) {
+        test::advanceMillis(15000);
+        EXPECT_EQUAL(channel.sendRequest(1, done.handler(), RequestOptions().timeout(60000)), 0);
+        channel.run();
+    }
+    EXPECT_EQUAL(channel.sendRequest(1, done.handler(), RequestOptions().timeout(60000)), (int)Error::LIMIT_EXCEEDED);
+    EXPECT_EQUAL(channel.stats().queueOverflows, 1u);
+    EXPECT_EQUAL(done.count, 0);
+    EXPECT_EQUAL(net.sendCount, 0);
+    // Everything collected over the period goes out once the window opens
+    windowOpen = true;
+    runFor(channel, 40000);
+    EXPECT_EQUAL(net.sendCount, 40);
+    EXPECT_EQUAL(done.count, 0);
+}
+
+TEST_CASE(request_ack_marks_send_time_not_queue_time) {
+    // CloudProtocol measures the publish latency from this acknowledgement
+    FakeNetwork net;
+    net.result = Error::WOULD_BLOCK;
+    MessageChannel channel;
+    channel.init(net.config());
+    Completion done;
+    system_tick_t ackTime = 0;
+    int acks = 0;
+    channel.sendRequest(1, done.handler(), RequestOptions().onAck([&](int error) {
+        ++acks;
+        ackTime = millis();
+    }));
+    runFor(channel, 30000);
+    EXPECT_EQUAL(acks, 0);
+    net.result = 0;
+    channel.run();
+    EXPECT_EQUAL(acks, 1);
+    EXPECT_EQUAL(ackTime, 30000u);
+}
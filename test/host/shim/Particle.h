@@ -0,0 +1,11 @@
+#pragma once
+
+// Host replacement of the parts of Particle.h used by the libraries under test
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include "spark_wiring_ticks.h"
+#include "spark_wiring_logging.h"
+#include "system_error.h"
+#include "spark_wiring_cellular.h"
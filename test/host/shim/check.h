@@ -0,0 +1,10 @@
+#pragma once
+
+#define CHECK(_expr) \
+        ({ \
+            const auto _ret = _expr; \
+            if (_ret < 0) { \
+                return _ret; \
+            } \
+            _ret; \
+        })
@@ -0,0 +1,19 @@
+#pragma once
+
+// Host replacement of the Device OS diagnostics service, sources are never registered
+#include <cstdint>
+#include <cstddef>
+
+struct diag_source;
+
+typedef int (*diag_source_cmd_callback_fn)(const diag_source* src, int cmd, void* data);
+
+struct diag_source {
+    uint16_t size;
+    uint16_t flags;
+    uint16_t id;
+    uint16_t type;
+    const char* name;
+    void* data;
+    diag_source_cmd_callback_fn callback;
+};
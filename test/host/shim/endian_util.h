@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+namespace particle {
+
+// The host is assumed to be little endian
+inline uint32_t nativeToBigEndian(uint32_t value) {
+    return __builtin_bswap32(value);
+}
+
+inline uint32_t bigEndianToNative(uint32_t value) {
+    return __builtin_bswap32(value);
+}
+
+} // namespace particle
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+namespace particle {
+
+// Shared ownership is enough for the host, Device OS uses an intrusive counter
+struct RefCount {
+    virtual ~RefCount() = default;
+};
+
+template<typename T>
+using RefCountPtr = std::shared_ptr<T>;
+
+template<typename T, typename... ArgsT>
+RefCountPtr<T> makeRefCountPtr(ArgsT&&... args) {
+    return std::make_shared<T>(std::forward<ArgsT>(args)...);
+}
+
+} // namespace particle
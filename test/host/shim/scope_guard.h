@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+
+namespace particle {
+
+class ScopeGuard {
+public:
+    explicit ScopeGuard(std::function<void()> fn) :
+            fn_(std::move(fn)),
+            dismissed_(false) {
+    }
+
+    ~ScopeGuard() {
+        if (!dismissed_) {
+            fn_();
+        }
+    }
+
+    void dismiss() {
+        dismissed_ = true;
+    }
+
+private:
+    std::function<void()> fn_;
+    bool dismissed_;
+};
+
+} // namespace particle
+
+#define NAMED_SCOPE_GUARD(_name, _code) \
+        ::particle::ScopeGuard _name([&]() _code)
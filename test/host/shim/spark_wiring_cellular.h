@@ -0,0 +1,52 @@
+#pragma once
+
+// Host replacement of Cellular.command(). The tests set the response lines and the final result
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "spark_wiring_ticks.h"
+
+enum {
+    TYPE_UNKNOWN = 0x280000,
+    TYPE_OK = 0x110000,
+    TYPE_ERROR = 0x120000,
+    TYPE_PLUS = 0x200000
+};
+
+enum {
+    WAIT = -1,
+    RESP_OK = -2,
+    RESP_ERROR = -3
+};
+
+class CellularClass {
+public:
+    // Passed to the callback of the next command, each as TYPE_PLUS
+    std::vector<std::string> lines;
+    int result = RESP_OK;
+    unsigned commands = 0;
+
+    template<typename T>
+    int command(int (*cb)(int type, const char* buf, int len, T* param), T* param, system_tick_t timeout,
+            const char* fmt, ...) {
+        ++commands;
+        for (const auto& line: lines) {
+            cb(TYPE_PLUS, line.c_str(), (int)line.size(), param);
+        }
+        return result;
+    }
+
+    int command(system_tick_t timeout, const char* fmt, ...) {
+        ++commands;
+        return result;
+    }
+
+    void reset() {
+        lines.clear();
+        result = RESP_OK;
+        commands = 0;
+    }
+};
+
+extern CellularClass Cellular;
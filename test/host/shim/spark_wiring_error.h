@@ -0,0 +1,32 @@
+#pragma once
+
+#include "system_error.h"
+
+namespace particle {
+
+class Error {
+public:
+    enum Type {
+        NONE = SYSTEM_ERROR_NONE,
+        UNKNOWN = SYSTEM_ERROR_UNKNOWN,
+        BUSY = SYSTEM_ERROR_BUSY,
+        NOT_SUPPORTED = SYSTEM_ERROR_NOT_SUPPORTED,
+        CANCELLED = SYSTEM_ERROR_CANCELLED,
+        TIMEOUT = SYSTEM_ERROR_TIMEOUT,
+        NOT_FOUND = SYSTEM_ERROR_NOT_FOUND,
+        TOO_LARGE = SYSTEM_ERROR_TOO_LARGE,
+        NOT_ENOUGH_DATA = SYSTEM_ERROR_NOT_ENOUGH_DATA,
+        LIMIT_EXCEEDED = SYSTEM_ERROR_LIMIT_EXCEEDED,
+        INVALID_STATE = SYSTEM_ERROR_INVALID_STATE,
+        WOULD_BLOCK = SYSTEM_ERROR_WOULD_BLOCK,
+        PROTOCOL = SYSTEM_ERROR_PROTOCOL,
+        NO_MEMORY = SYSTEM_ERROR_NO_MEMORY,
+        INVALID_ARGUMENT = SYSTEM_ERROR_INVALID_ARGUMENT,
+        BAD_DATA = SYSTEM_ERROR_BAD_DATA,
+        ENCODING_FAILED = SYSTEM_ERROR_ENCODING_FAILED
+    };
+};
+
+} // namespace particle
+
+using particle::Error;
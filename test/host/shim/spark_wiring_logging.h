@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+
+enum LogLevel {
+    LOG_LEVEL_ALL = 1,
+    LOG_LEVEL_TRACE = 1,
+    LOG_LEVEL_INFO = 30,
+    LOG_LEVEL_WARN = 40,
+    LOG_LEVEL_ERROR = 50,
+    LOG_LEVEL_NONE = 70
+};
+
+// Logging is discarded on the host
+class Logger {
+public:
+    void trace(const char* fmt, ...) const {
+    }
+
+    void info(const char* fmt, ...) const {
+    }
+
+    void warn(const char* fmt, ...) const {
+    }
+
+    void error(const char* fmt, ...) const {
+    }
+
+    void log(LogLevel level, const char* fmt, ...) const {
+    }
+
+    void printf(LogLevel level, const char* fmt, ...) const {
+    }
+
+    void print(LogLevel level, const char* str) const {
+    }
+
+    void dump(LogLevel level, const void* data, size_t size) const {
+    }
+
+    bool isLevelEnabled(LogLevel level) const {
+        return false;
+    }
+};
+
+extern const Logger Log;
+
+#define LOG_SOURCE_CATEGORY(_name)
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <map>
+#include <utility>
+
+namespace particle {
+
+// The parts of particle::Map used by the libraries, backed by std::map
+template<typename KeyT, typename ValueT>
+class Map {
+public:
+    typedef std::map<KeyT, ValueT> Impl;
+
+    bool set(const KeyT& key, ValueT value) {
+        m_[key] = std::move(value);
+        return true;
+    }
+
+    bool remove(const KeyT& key) {
+        return m_.erase(key) > 0;
+    }
+
+    typename Impl::iterator find(const KeyT& key) {
+        return m_.find(key);
+    }
+
+    typename Impl::iterator erase(typename Impl::iterator it) {
+        return m_.erase(it);
+    }
+
+    int size() const {
+        return m_.size();
+    }
+
+    auto begin() {
+        return m_.begin();
+    }
+
+    auto end() {
+        return m_.end();
+    }
+
+    friend void swap(Map& a, Map& b) {
+        a.m_.swap(b.m_);
+    }
+
+private:
+    Impl m_;
+};
+
+} // namespace particle
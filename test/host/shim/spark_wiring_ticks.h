@@ -0,0 +1,8 @@
+#pragma once
+
+// Host replacement of the Device OS tick functions, driven by the tests
+#include <cstdint>
+
+typedef uint32_t system_tick_t;
+
+system_tick_t millis();
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+namespace spark {
+
+// The parts of spark::Vector used by the libraries, backed by std::vector
+template<typename T>
+class Vector {
+public:
+    Vector() = default;
+
+    explicit Vector(int size) :
+            v_(size) {
+    }
+
+    Vector(const T* data, int size) :
+            v_(data, data + size) {
+    }
+
+    T* data() {
+        return v_.data();
+    }
+
+    const T* data() const {
+        return v_.data();
+    }
+
+    int size() const {
+        return v_.size();
+    }
+
+    bool isEmpty() const {
+        return v_.empty();
+    }
+
+    bool resize(int size) {
+        v_.resize(size);
+        return true;
+    }
+
+    bool append(T value) {
+        v_.push_back(std::move(value));
+        return true;
+    }
+
+    void removeAt(int i, int n = 1) {
+        v_.erase(v_.begin() + i, v_.begin() + i + n);
+    }
+
+    void clear() {
+        v_.clear();
+    }
+
+    T& first() {
+        return v_.front();
+    }
+
+    T& at(int i) {
+        return v_.at(i);
+    }
+
+    const T& at(int i) const {
+        return v_.at(i);
+    }
+
+    auto begin() {
+        return v_.begin();
+    }
+
+    auto end() {
+        return v_.end();
+    }
+
+    auto begin() const {
+        return v_.begin();
+    }
+
+    auto end() const {
+        return v_.end();
+    }
+
+private:
+    std::vector<T> v_;
+};
+
+} // namespace spark
+
+using spark::Vector;
@@ -0,0 +1,24 @@
+#pragma once
+
+// Subset of the Device OS system error codes
+enum system_error_t {
+    SYSTEM_ERROR_NONE = 0,
+    SYSTEM_ERROR_UNKNOWN = -100,
+    SYSTEM_ERROR_BUSY = -110,
+    SYSTEM_ERROR_NOT_SUPPORTED = -120,
+    SYSTEM_ERROR_CANCELLED = -140,
+    SYSTEM_ERROR_TIMEOUT = -160,
+    SYSTEM_ERROR_NOT_FOUND = -170,
+    SYSTEM_ERROR_TOO_LARGE = -190,
+    SYSTEM_ERROR_NOT_ENOUGH_DATA = -191,
+    SYSTEM_ERROR_LIMIT_EXCEEDED = -200,
+    SYSTEM_ERROR_INVALID_STATE = -210,
+    SYSTEM_ERROR_WOULD_BLOCK = -221,
+    SYSTEM_ERROR_PROTOCOL = -240,
+    SYSTEM_ERROR_NO_MEMORY = -260,
+    SYSTEM_ERROR_INVALID_ARGUMENT = -270,
+    SYSTEM_ERROR_BAD_DATA = -280,
+    SYSTEM_ERROR_ENCODING_FAILED = -350,
+    SYSTEM_ERROR_AT_NOT_OK = -1200,
+    SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED = -1210
+};
@@ -0,0 +1,156 @@
+#include "host_test.h"
+
+#include "transmit_gate.h"
+
+#include <cstdio>
+#include <string>
+
+using namespace particle;
+
+namespace {
+
+const system_tick_t LINK_SAMPLE_MAX_AGE = 5 * 60 * 1000;
+
+// Serving cell line with the given RSRP and raw SINR, reported in 1/5 dB offset by -20 dB
+std::string servingCell(int rsrp, int sinrRaw) {
+    char line[160];
+    std::snprintf(line, sizeof(line), "+QENG: \"servingcell\",\"NOCONN\",\"eMTC\",\"FDD\",310,410,8A1B20F,281,5110,12,3,3,"
+            "0BA1,%d,-12,-73,%d,-", rsrp, sinrRaw);
+    return line;
+}
+
+int sampleLink(LinkQualityMonitor& link, int rsrp, int sinrRaw) {
+    Cellular.lines = { servingCell(rsrp, sinrRaw) };
+    return link.sample();
+}
+
+// Checks that the gate holds frames for exactly the given time and advances the clock past it
+bool heldFor(const TransmitGate& gate, const LinkQualityMonitor& link, system_tick_t delay) {
+    if (delay > 0) {
+        test::advanceMillis(delay - 1);
+        if (gate.allowed(link)) {
+            return false;
+        }
+        test::advanceMillis(1);
+    }
+    return gate.allowed(link);
+}
+
+struct BackoffCase {
+    TxFailure failure;
+    system_tick_t base;
+    system_tick_t max;
+};
+
+const BackoffCase BACKOFF_CASES[] = {
+    { TxFailure::BUSY, 2000, 30000 },
+    { TxFailure::NO_COVERAGE, 30000, 10 * 60 * 1000 },
+    { TxFailure::MODEM, 5000, 60000 }
+};
+
+} // namespace
+
+TEST_CASE(transmit_gate_backoff_doubles_up_to_cap) {
+    LinkQualityMonitor link;
+    for (const auto& c: BACKOFF_CASES) {
+        TransmitGate gate;
+        EXPECT_TRUE(gate.allowed(link));
+        system_tick_t expected = c.base;
+        bool capped = false;
+        for (int i = 0; i < 10; ++i) {
+            gate.failure(c.failure);
+            EXPECT_TRUE(heldFor(gate, link, expected));
+            capped = capped || expected == c.max;
+            expected = std::min(expected * 2, c.max);
+        }
+        EXPECT_TRUE(capped);
+        // Success resets the backoff, the next failure starts from the base delay again
+        gate.success();
+        EXPECT_TRUE(gate.allowed(link));
+        gate.failure(c.failure);
+        EXPECT_TRUE(heldFor(gate, link, c.base));
+    }
+}
+
+TEST_CASE(transmit_gate_backoff_is_kept_per_failure_class) {
+    LinkQualityMonitor link;
+    TransmitGate gate;
+    for (int i = 0; i < 3; ++i) {
+        gate.failure(TxFailure::MODEM);
+    }
+    EXPECT_EQUAL(gate.modemFaults(), 3u);
+    // A busy modem after a run of faults doesn't extend the modem backoff, and vice versa
+    gate.failure(TxFailure::BUSY);
+    EXPECT_TRUE(heldFor(gate, link, 20000));
+    gate.failure(TxFailure::BUSY);
+    EXPECT_TRUE(heldFor(gate, link, 4000));
+    EXPECT_EQUAL(gate.modemFaults(), 3u);
+    gate.success();
+    EXPECT_EQUAL(gate.modemFaults(), 0u);
+}
+
+TEST_CASE(transmit_gate_classifies_failures) {
+    EXPECT_TRUE(TransmitGate::classify(RESP_ERROR, 3, false) == TxFailure::NO_COVERAGE);
+    EXPECT_TRUE(TransmitGate::classify(WAIT, -1, true) == TxFailure::MODEM);
+    EXPECT_TRUE(TransmitGate::classify(RESP_ERROR, 3, true) == TxFailure::BUSY);
+    EXPECT_TRUE(TransmitGate::classify(RESP_ERROR, 30, true) == TxFailure::NO_COVERAGE);
+    EXPECT_TRUE(TransmitGate::classify(RESP_ERROR, 31, true) == TxFailure::NO_COVERAGE);
+    EXPECT_TRUE(TransmitGate::classify(RESP_ERROR, 32, true) == TxFailure::NO_COVERAGE);
+    EXPECT_TRUE(TransmitGate::classify(RESP_ERROR, 4, true) == TxFailure::REJECTED);
+    EXPECT_TRUE(TransmitGate::classify(RESP_ERROR, 50, true) == TxFailure::REJECTED);
+    EXPECT_TRUE(TransmitGate::classify(RESP_ERROR, -1, true) == TxFailure::MODEM);
+    EXPECT_TRUE(TransmitGate::classify(RESP_ERROR, 100, true) == TxFailure::MODEM);
+}
+
+TEST_CASE(transmit_gate_rejected_frame_does_not_hold_the_queue) {
+    // Satellite::tx() drops a rejected frame, the frames behind it go out without a backoff
+    LinkQualityMonitor link;
+    TransmitGate gate;
+    gate.failure(TransmitGate::classify(RESP_ERROR, 50, true));
+    EXPECT_TRUE(gate.allowed(link));
+    EXPECT_EQUAL(gate.modemFaults(), 0u);
+}
+
+TEST_CASE(transmit_gate_holds_frames_on_poor_link) {
+    LinkQualityMonitor link;
+    TransmitGate gate;
+    EXPECT_EQUAL(sampleLink(link, -105, 90), 0);
+    EXPECT_TRUE(gate.allowed(link));
+    // Below the RSRP threshold
+    EXPECT_EQUAL(sampleLink(link, -131, 90), 0);
+    EXPECT_TRUE(!gate.allowed(link));
+    EXPECT_EQUAL(sampleLink(link, -130, 90), 0);
+    EXPECT_TRUE(gate.allowed(link));
+    // Below the SINR threshold, raw 45 is -11 dB
+    EXPECT_EQUAL(sampleLink(link, -105, 45), 0);
+    EXPECT_TRUE(!gate.allowed(link));
+    EXPECT_EQUAL(sampleLink(link, -105, 50), 0);
+    EXPECT_TRUE(gate.allowed(link));
+    // Custom thresholds
+    gate.minRsrp(-100);
+    EXPECT_TRUE(!gate.allowed(link));
+}
+
+TEST_CASE(transmit_gate_ignores_stale_link_sample) {
+    LinkQualityMonitor link;
+    TransmitGate gate;
+    EXPECT_EQUAL(sampleLink(link, -140, 0), 0);
+    EXPECT_TRUE(!gate.allowed(link));
+    test::advanceMillis(LINK_SAMPLE_MAX_AGE - 1);
+    EXPECT_TRUE(!gate.allowed(link));
+    test::advanceMillis(1);
+    EXPECT_TRUE(gate.allowed(link));
+}
+
+TEST_CASE(transmit_gate_keeps_last_sample_without_measurements) {
+    LinkQualityMonitor link;
+    TransmitGate gate;
+    EXPECT_EQUAL(sampleLink(link, -140, 0), 0);
+    // Not camped on a cell, the poor sample still holds frames until it goes stale
+    Cellular.lines = { "+QENG: \"servingcell\",\"SEARCH\"" };
+    EXPECT_EQUAL(link.sample(), (int)SYSTEM_ERROR_NOT_FOUND);
+    EXPECT_TRUE(!gate.allowed(link));
+    Cellular.result = RESP_ERROR;
+    EXPECT_EQUAL(link.sample(), (int)SYSTEM_ERROR_AT_NOT_OK);
+    EXPECT_EQUAL(link.count(), 1u);
+}
@@ -0,0 +1,35 @@
+#include "host_test.h"
+
+#include "uplink_scheduler.h"
+
+using namespace particle;
+using namespace particle::constrained;
+
+TEST_CASE(radio_can_be_borrowed_with_windowing_disabled) {
+    // Satellite::idle() checks inWindow(), a cellular probe must not be refused because frames flow freely
+    UplinkScheduler uplink;
+    EXPECT_TRUE(!uplink.enabled());
+    EXPECT_TRUE(!uplink.process(true));
+    EXPECT_TRUE(uplink.windowOpen());
+    EXPECT_TRUE(!uplink.inWindow());
+    EXPECT_TRUE(uplink.allowed(MessagePriority::TELEMETRY));
+    EXPECT_EQUAL(uplink.untilWindow(), 0u);
+}
+
+TEST_CASE(radio_is_busy_only_while_a_window_is_open) {
+    test::setMillis(1000); // A window at time 0 reads as none yet
+    UplinkScheduler uplink;
+    uplink.period(60000);
+    EXPECT_TRUE(uplink.process(true));
+    EXPECT_TRUE(uplink.inWindow());
+    EXPECT_TRUE(!uplink.process(false));
+    EXPECT_TRUE(!uplink.inWindow());
+    EXPECT_TRUE(!uplink.windowOpen());
+    EXPECT_TRUE(!uplink.allowed(MessagePriority::TELEMETRY));
+    EXPECT_TRUE(uplink.allowed(MessagePriority::ALARM));
+    test::advanceMillis(30000);
+    EXPECT_EQUAL(uplink.untilWindow(), 30000u);
+    test::advanceMillis(30000);
+    EXPECT_TRUE(uplink.process(true));
+    EXPECT_TRUE(uplink.inWindow());
+}
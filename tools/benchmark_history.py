@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Records protocol benchmark results and compares them with earlier runs.
+
+The benchmark app in test/benchmark prints one "BENCH {...}" line per benchmark over USB serial.
+Capture the output and pass it to this script:
+
+    particle serial monitor --follow | tee bench.log
+    benchmark_history.py bench.log
+
+Each run is appended to test/benchmark/history.jsonl with the current commit, and compared with
+the previous run, or with the run of a given commit (--baseline). The script exits with status 1 if
+any benchmark got slower than the threshold or allocates more than before.
+"""
+
+import argparse
+import datetime
+import json
+import os
+import subprocess
+import sys
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+HISTORY_FILE = os.path.join(REPO_DIR, 'test', 'benchmark', 'history.jsonl')
+
+
+def git_commit():
+    try:
+        return subprocess.check_output(['git', 'rev-parse', '--short', 'HEAD'], cwd=REPO_DIR,
+                                       text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return 'unknown'
+
+
+def parse_log(path):
+    results = {}
+    device_os = None
+    with open(path, errors='replace') as f:
+        for line in f:
+            if 'BENCH_RUN ' in line:
+                device_os = json.loads(line.split('BENCH_RUN ', 1)[1]).get('version')
+            elif 'BENCH ' in line:
+                r = json.loads(line.split('BENCH ', 1)[1])
+                results[r.pop('bench')] = r
+    return device_os, results
+
+
+def load_history():
+    if not os.path.exists(HISTORY_FILE):
+        return []
+    with open(HISTORY_FILE) as f:
+        return [json.loads(line) for line in f if line.strip()]
+
+
+def compare(base, run, threshold):
+    regressed = False
+    print('%-24s %12s %12s %8s %10s %10s' % ('benchmark', 'ns/op', 'base', 'delta', 'allocs/op', 'base'))
+    for name, r in sorted(run['results'].items()):
+        b = base['results'].get(name) if base else None
+        if not b:
+            print('%-24s %12d %12s %8s %10.2f %10s' % (name, r['ns_per_op'], '-', '-', r['allocs_per_op'], '-'))
+            continue
+        delta = (r['ns_per_op'] - b['ns_per_op']) / b['ns_per_op'] if b['ns_per_op'] else 0.0
+        flag = ''
+        if delta > threshold or r['allocs_per_op'] > b['allocs_per_op']:
+            flag = '  REGRESSION'
+            regressed = True
+        print('%-24s %12d %12d %+7.1f%% %10.2f %10.2f%s' % (name, r['ns_per_op'], b['ns_per_op'], delta * 100,
+                                                           r['allocs_per_op'], b['allocs_per_op'], flag))
+    return regressed
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Track protocol benchmark results')
+    parser.add_argument('log', help='serial output of the benchmark app')
+    parser.add_argument('--baseline', help='commit to compare with, defaults to the previous run')
+    parser.add_argument('--threshold', type=float, default=10.0, help='allowed slowdown in percent')
+    parser.add_argument('--no-save', action='store_true', help="don't append the run to the history")
+    args = parser.parse_args()
+
+    device_os, results = parse_log(args.log)
+    if not results:
+        print('No benchmark results found', file=sys.stderr)
+        return 2
+    run = {
+        'commit': git_commit(),
+        'date': datetime.datetime.now(datetime.timezone.utc).isoformat(timespec='seconds'),
+        'device_os': device_os,
+        'results': results,
+    }
+    history = load_history()
+    if args.baseline:
+        matches = [h for h in history if h['commit'] == args.baseline]
+        base = matches[-1] if matches else None
+        if not base:
+            print('No run recorded for %s' % args.baseline, file=sys.stderr)
+    else:
+        base = history[-1] if history else None
+    if base:
+        print('Comparing with %s (%s)' % (base['commit'], base['date']))
+    regressed = compare(base, run, args.threshold / 100)
+    if not args.no_save:
+        with open(HISTORY_FILE, 'a') as f:
+            f.write(json.dumps(run, sort_keys=True) + '\n')
+    return 1 if regressed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
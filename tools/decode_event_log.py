@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Decodes the binary event log written by EventLog (lib/satellite/src/event_log.h).
+
+Input is either the hex encoded chunks published as "evlog" events, one per line, or the log file
+copied from the device's flash filesystem (/usr/satellite/events):
+
+    decode_event_log.py chunks.txt
+    particle subscribe evlog | decode_event_log.py -
+    decode_event_log.py --file events
+"""
+
+import argparse
+import datetime
+import struct
+import sys
+
+CHUNK_VERSION = 1
+FILE_MAGIC = 0x45564C31
+
+TX_FAILURE = ['BUSY', 'NO_COVERAGE', 'MODEM', 'REJECTED']
+RECOVERY_STEP = ['REOPEN_NIPD', 'REATTACH', 'CFUN_CYCLE', 'POWER_CYCLE']
+BEARER = ['NONE', 'CELLULAR', 'SATELLITE']
+
+
+def enum(names):
+    return lambda v: names[v] if 0 <= v < len(names) else str(v)
+
+
+# Must match EventId in event_log.h: name and a formatter for each argument
+EVENTS = {
+    1: ('BOOT', [('reason', str)]),
+    2: ('TX', [('bytes', str)]),
+    3: ('TX_FAILED', [('result', str), ('cme', str), ('class', enum(TX_FAILURE))]),
+    4: ('RX', [('bytes', str)]),
+    5: ('REGISTRATION', [('registered', str)]),
+    6: ('RECOVERY', [('step', enum(RECOVERY_STEP))]),
+    7: ('BAND_DRIFT', []),
+    8: ('UPLINK_WINDOW', [('pending', str)]),
+    9: ('RTT', [('ms', str)]),
+    10: ('GNSS_FIX', [('ms', str), ('sats', str)]),
+    11: ('BEARER_SWITCH', [('bearer', enum(BEARER))]),
+    12: ('SLEEP', [('ms', str)]),
+    13: ('PUBLISH_DONE', [('error', str), ('latency_ms', str)]),
+}
+
+
+def read_varint(data, offs):
+    value = 0
+    shift = 0
+    while True:
+        if offs >= len(data):
+            raise ValueError('Truncated record')
+        b = data[offs]
+        offs += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return value, offs
+        shift += 7
+
+
+def unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def decode_records(data, base_time):
+    """Yields (boot, time since boot in ms, event name, [(arg name, value)])"""
+    boot = 0
+    t = base_time
+    offs = 0
+    while offs < len(data):
+        header = data[offs]
+        offs += 1
+        event_id = header & 0x1F
+        count = header >> 5
+        delta, offs = read_varint(data, offs)
+        args = []
+        for _ in range(count):
+            v, offs = read_varint(data, offs)
+            args.append(unzigzag(v))
+        if event_id == 1:
+            boot += 1
+            t = delta
+        else:
+            t = (t + delta) & 0xFFFFFFFF
+        name, fmts = EVENTS.get(event_id, ('EVENT_%d' % event_id, []))
+        named = []
+        for i, v in enumerate(args):
+            arg_name, fmt = fmts[i] if i < len(fmts) else ('arg%d' % i, str)
+            named.append((arg_name, fmt(v)))
+        yield boot, t, name, named
+
+
+def print_records(data, base_time, unix_time=0, export_millis=0):
+    records = list(decode_records(data, base_time))
+    last_boot = records[-1][0] if records else 0
+    for boot, t, name, args in records:
+        stamp = '%10.3f' % (t / 1000.0)
+        # Only the records since the last boot share the clock of the export time
+        if unix_time and boot == last_boot:
+            wall = unix_time - (export_millis - t) / 1000.0
+            stamp += ' ' + datetime.datetime.utcfromtimestamp(wall).strftime('%Y-%m-%d %H:%M:%S')
+        line = '%s [boot %+d] %s' % (stamp, boot - last_boot, name)
+        if args:
+            line += ' ' + ' '.join('%s=%s' % a for a in args)
+        print(line)
+
+
+def decode_chunk(chunk):
+    if len(chunk) < 13 or chunk[0] != CHUNK_VERSION:
+        raise ValueError('Unsupported chunk')
+    base_time, unix_time, export_millis = struct.unpack_from('<III', chunk, 1)
+    print_records(chunk[13:], base_time, unix_time, export_millis)
+
+
+def decode_file(data):
+    # RecordHeader (magic, size, CRC-32) followed by EventLog::Record
+    magic, size, _ = struct.unpack_from('<III', data, 0)
+    if magic != FILE_MAGIC:
+        raise ValueError('Not an event log file')
+    base_time, used = struct.unpack_from('<II', data, 12)
+    print_records(data[20:20 + used], base_time)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode the satellite event log')
+    parser.add_argument('input', help='file with hex chunks, one per line, or - for stdin')
+    parser.add_argument('--file', action='store_true', help='input is the event log file from flash')
+    args = parser.parse_args()
+    if args.file:
+        with open(args.input, 'rb') as f:
+            decode_file(f.read())
+        return
+    src = sys.stdin if args.input == '-' else open(args.input)
+    for line in src:
+        # Accept raw hex or lines where the hex data is the last word, e.g. from particle subscribe
+        words = line.replace('"', ' ').split()
+        if not words:
+            continue
+        try:
+            decode_chunk(bytes.fromhex(words[-1]))
+        except ValueError as e:
+            print('Skipping line: %s' % e, file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()